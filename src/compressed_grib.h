@@ -0,0 +1,482 @@
+// compressed_grib.h
+// Random access into gzip and zstd compressed GRIB files. The scan that
+// indexes the messages decompresses the file once, front to back, and
+// records checkpoints along the uncompressed stream; reading message N
+// later resumes from the nearest checkpoint at or before it instead of
+// decompressing from the start.
+//
+// gzip: every kCompressedSpan bytes of output, at a deflate block boundary,
+// the compressed bit position and the last 32 KB of output (the history the
+// following blocks may refer back to) are kept, as in zlib's zran.c. The
+// start of each gzip member is a checkpoint that needs no history, so
+// block-compressed files (bgzip, pigz --independent) cost little.
+// zstd: frame starts are checkpoints and need no history, so files written
+// as independent frames (the zstd seekable format, pzstd) get random
+// access. A single-frame file has only its start; there a cursor left
+// where the previous read stopped keeps sequential access cheap.
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+#if defined(GRIBVIEW_HAVE_ZLIB)
+#include <zlib.h>
+#endif
+#if defined(GRIBVIEW_HAVE_ZSTD)
+#include <zstd.h>
+#endif
+
+enum class GribCompression
+{
+    None,
+    Gzip,
+    Zstd
+};
+
+static const uint64_t kCompressedSpan = 4u << 20;        // output between checkpoints that carry history
+static const uint64_t kCompressedStartSpan = 256u << 10; // output between member/frame-start checkpoints
+static const size_t kCompressedWindow = 32768;           // deflate history
+static const size_t kCompressedInput = 256u << 10;       // read size on the compressed side
+static const size_t kCompressedOutput = 256u << 10;      // decoded bytes buffered for small reads
+
+// By magic number rather than extension, so renamed files work too.
+static GribCompression DetectGribCompression(const std::string &path)
+{
+    unsigned char magic[4] = {0, 0, 0, 0};
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f)
+        return GribCompression::None;
+    size_t n = fread(magic, 1, sizeof(magic), f);
+    fclose(f);
+    if (n >= 2 && magic[0] == 0x1f && magic[1] == 0x8b)
+        return GribCompression::Gzip;
+    if (n == 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd)
+        return GribCompression::Zstd;
+    return GribCompression::None;
+}
+
+static const char *GribCompressionName(GribCompression kind)
+{
+    if (kind == GribCompression::Gzip)
+        return "gzip";
+    if (kind == GribCompression::Zstd)
+        return "zstd";
+    return "none";
+}
+
+// False when gribview was built without the library for 'kind'.
+static bool GribCompressionSupported(GribCompression kind)
+{
+#if defined(GRIBVIEW_HAVE_ZLIB)
+    if (kind == GribCompression::Gzip)
+        return true;
+#endif
+#if defined(GRIBVIEW_HAVE_ZSTD)
+    if (kind == GribCompression::Zstd)
+        return true;
+#endif
+    return kind == GribCompression::None;
+}
+
+struct CompressedCheckpoint
+{
+    uint64_t out = 0;                  // offset in the uncompressed stream
+    uint64_t in = 0;                   // offset in the file of the first whole byte to read
+    int bits = 0;                      // gzip: bits of the byte before 'in' that are still unread
+    bool streamStart = true;           // gzip member or zstd frame start: no history needed
+    std::vector<unsigned char> window; // gzip: up to 32 KB of output before 'out'
+};
+
+// One position in the uncompressed stream of a compressed file, read
+// forward. Given 'record', the checkpoints passed on the way are appended
+// to it (the indexing pass).
+class CompressedDecoder
+{
+public:
+    CompressedDecoder() = default;
+    CompressedDecoder(const CompressedDecoder &) = delete;
+    CompressedDecoder &operator=(const CompressedDecoder &) = delete;
+    ~CompressedDecoder() { Close(); }
+
+    bool Start(const std::string &path, GribCompression kind, const CompressedCheckpoint &point,
+               std::string &error, std::vector<CompressedCheckpoint> *record = nullptr)
+    {
+        Close();
+        if (!GribCompressionSupported(kind) || kind == GribCompression::None)
+        {
+            error = std::string("gribview was built without ") + GribCompressionName(kind) + " support";
+            return false;
+        }
+        m_Kind = kind;
+        m_Record = record;
+        m_Error.clear();
+        m_End = false;
+        m_Produced = point.out;
+        m_OutPos = m_OutLen = 0;
+        m_File = fopen(path.c_str(), "rb");
+        if (!m_File)
+        {
+            error = "cannot open " + path;
+            return false;
+        }
+        m_InBase = point.in - (point.bits ? 1 : 0);
+        m_InPos = m_InLen = 0;
+        m_In.resize(kCompressedInput);
+        m_Out.resize(kCompressedOutput);
+#if defined(_WIN32)
+        bool seeked = _fseeki64(m_File, (long long)m_InBase, SEEK_SET) == 0;
+#else
+        bool seeked = fseeko(m_File, (off_t)m_InBase, SEEK_SET) == 0;
+#endif
+        if (!seeked)
+        {
+            error = "cannot seek in " + path;
+            Close();
+            return false;
+        }
+#if defined(GRIBVIEW_HAVE_ZLIB)
+        if (kind == GribCompression::Gzip)
+        {
+            m_Z = z_stream();
+            m_Raw = !point.streamStart;
+            if (inflateInit2(&m_Z, m_Raw ? -15 : 15 + 32) != Z_OK)
+            {
+                error = "cannot initialise zlib";
+                Close();
+                return false;
+            }
+            m_ZOpen = true;
+            if (point.bits)
+            {
+                int c = fgetc(m_File);
+                m_InBase++;
+                if (c == EOF || inflatePrime(&m_Z, point.bits, c >> (8 - point.bits)) != Z_OK)
+                {
+                    error = "cannot resume gzip data in " + path;
+                    Close();
+                    return false;
+                }
+            }
+            if (m_Raw && !point.window.empty())
+                inflateSetDictionary(&m_Z, point.window.data(), (uInt)point.window.size());
+            m_Ring.assign(kCompressedWindow, 0);
+            m_RingPos = m_RingFill = 0;
+            if (m_Record)
+                Mark(true);
+        }
+#endif
+#if defined(GRIBVIEW_HAVE_ZSTD)
+        if (kind == GribCompression::Zstd)
+        {
+            m_ZD = ZSTD_createDStream();
+            if (!m_ZD || ZSTD_isError(ZSTD_initDStream(m_ZD)))
+            {
+                error = "cannot initialise zstd";
+                Close();
+                return false;
+            }
+            m_FrameStart = true;
+        }
+#endif
+        return true;
+    }
+
+    // Up to 'len' bytes; fewer only at the end of the data or on an error.
+    size_t Read(void *buffer, size_t len)
+    {
+        unsigned char *dst = (unsigned char *)buffer;
+        size_t done = 0;
+        while (done < len)
+        {
+            if (m_OutPos == m_OutLen && !Produce())
+                break;
+            size_t n = std::min(len - done, m_OutLen - m_OutPos);
+            memcpy(dst + done, m_Out.data() + m_OutPos, n);
+            m_OutPos += n;
+            done += n;
+        }
+        return done;
+    }
+
+    bool Skip(uint64_t bytes)
+    {
+        while (bytes > 0)
+        {
+            if (m_OutPos == m_OutLen && !Produce())
+                return false;
+            size_t n = (size_t)std::min<uint64_t>(bytes, m_OutLen - m_OutPos);
+            m_OutPos += n;
+            bytes -= n;
+        }
+        return true;
+    }
+
+    // Offset in the uncompressed stream of the next byte Read returns.
+    uint64_t Position() const { return m_Produced - (m_OutLen - m_OutPos); }
+    bool IsOpen() const { return m_File != nullptr; }
+    const std::string &Error() const { return m_Error; }
+
+    void Close()
+    {
+#if defined(GRIBVIEW_HAVE_ZLIB)
+        if (m_ZOpen)
+            inflateEnd(&m_Z);
+        m_ZOpen = false;
+#endif
+#if defined(GRIBVIEW_HAVE_ZSTD)
+        if (m_ZD)
+            ZSTD_freeDStream(m_ZD);
+        m_ZD = nullptr;
+#endif
+        if (m_File)
+            fclose(m_File);
+        m_File = nullptr;
+    }
+
+private:
+    bool Fill()
+    {
+        if (m_InPos < m_InLen)
+            return true;
+        m_InBase += m_InLen;
+        m_InPos = 0;
+        m_InLen = fread(m_In.data(), 1, m_In.size(), m_File);
+        return m_InLen > 0;
+    }
+
+    // Decodes the next run of output into m_Out.
+    bool Produce()
+    {
+        m_OutPos = m_OutLen = 0;
+        if (!m_File)
+            return false;
+#if defined(GRIBVIEW_HAVE_ZLIB)
+        if (m_Kind == GribCompression::Gzip)
+            ProduceGzip();
+#endif
+#if defined(GRIBVIEW_HAVE_ZSTD)
+        if (m_Kind == GribCompression::Zstd)
+            ProduceZstd();
+#endif
+        return m_OutLen > 0;
+    }
+
+    // Appends a checkpoint at the current decoder position unless the
+    // previous one is too close.
+    void Mark(bool streamStart)
+    {
+        uint64_t span = streamStart ? kCompressedStartSpan : kCompressedSpan;
+        if (!m_Record->empty() && m_Produced - m_Record->back().out < span)
+            return;
+        CompressedCheckpoint p;
+        p.out = m_Produced;
+        p.in = m_InBase + m_InPos;
+        p.streamStart = streamStart;
+#if defined(GRIBVIEW_HAVE_ZLIB)
+        if (!streamStart)
+        {
+            p.bits = m_Z.data_type & 7;
+            p.window.resize(m_RingFill);
+            size_t first = (m_RingPos + kCompressedWindow - m_RingFill) % kCompressedWindow;
+            for (size_t k = 0; k < m_RingFill; k++)
+                p.window[k] = m_Ring[(first + k) % kCompressedWindow];
+        }
+#endif
+        m_Record->push_back(std::move(p));
+    }
+
+#if defined(GRIBVIEW_HAVE_ZLIB)
+    // Keeps the last 32 KB of output for the next checkpoint's history.
+    void Remember(const unsigned char *data, size_t n)
+    {
+        if (n >= kCompressedWindow)
+        {
+            data += n - kCompressedWindow;
+            n = kCompressedWindow;
+        }
+        size_t head = std::min(n, kCompressedWindow - m_RingPos);
+        memcpy(m_Ring.data() + m_RingPos, data, head);
+        memcpy(m_Ring.data(), data + head, n - head);
+        m_RingPos = (m_RingPos + n) % kCompressedWindow;
+        m_RingFill = std::min(kCompressedWindow, m_RingFill + n);
+    }
+
+    // After the end of a gzip member: moves on to the next one, if any.
+    bool NextMember()
+    {
+        if (m_Raw)
+        {
+            // Raw inflate leaves the CRC32 and length trailer unread.
+            for (int k = 0; k < 8; k++)
+            {
+                if (!Fill())
+                    return false;
+                m_InPos++;
+            }
+        }
+        if (!Fill() || m_In[m_InPos] != 0x1f) // end of file, or padding after the last member
+            return false;
+        inflateReset2(&m_Z, 15 + 32);
+        m_Raw = false;
+        m_RingFill = 0;
+        if (m_Record)
+            Mark(true);
+        return true;
+    }
+
+    void ProduceGzip()
+    {
+        while (m_OutLen < m_Out.size() && !m_End)
+        {
+            if (!Fill())
+            {
+                m_End = true; // a truncated member ends the data too (file still being written)
+                break;
+            }
+            m_Z.next_in = m_In.data() + m_InPos;
+            m_Z.avail_in = (uInt)(m_InLen - m_InPos);
+            m_Z.next_out = m_Out.data() + m_OutLen;
+            m_Z.avail_out = (uInt)(m_Out.size() - m_OutLen);
+            // Z_BLOCK stops at every deflate block boundary, where the
+            // indexing pass may place a checkpoint.
+            int ret = inflate(&m_Z, m_Record ? Z_BLOCK : Z_NO_FLUSH);
+            size_t produced = (size_t)(m_Z.next_out - (m_Out.data() + m_OutLen));
+            m_InPos = (size_t)(m_Z.next_in - m_In.data());
+            if (m_Record)
+                Remember(m_Out.data() + m_OutLen, produced);
+            m_OutLen += produced;
+            m_Produced += produced;
+            if (ret == Z_STREAM_END)
+            {
+                if (!NextMember())
+                    m_End = true;
+            }
+            else if (ret != Z_OK && ret != Z_BUF_ERROR)
+            {
+                m_Error = std::string("corrupt gzip data") + (m_Z.msg ? std::string(": ") + m_Z.msg : "");
+                m_End = true;
+            }
+            else if (m_Record && (m_Z.data_type & 128) && !(m_Z.data_type & 64))
+                Mark(false);
+        }
+    }
+#endif
+
+#if defined(GRIBVIEW_HAVE_ZSTD)
+    void ProduceZstd()
+    {
+        while (m_OutLen < m_Out.size() && !m_End)
+        {
+            if (!Fill())
+            {
+                // zstd may still hold output for input it has consumed (the
+                // last block of a frame without a checksum): drain it first.
+                ZSTD_inBuffer in = {nullptr, 0, 0};
+                ZSTD_outBuffer out = {m_Out.data(), m_Out.size(), m_OutLen};
+                size_t ret = ZSTD_decompressStream(m_ZD, &out, &in);
+                if (ZSTD_isError(ret))
+                    m_Error = std::string("corrupt zstd data: ") + ZSTD_getErrorName(ret);
+                size_t produced = out.pos - m_OutLen;
+                m_Produced += produced;
+                m_OutLen = out.pos;
+                if (produced == 0 || ZSTD_isError(ret))
+                    m_End = true;
+                continue;
+            }
+            if (m_FrameStart && m_Record)
+                Mark(true);
+            ZSTD_inBuffer in = {m_In.data(), m_InLen, m_InPos};
+            ZSTD_outBuffer out = {m_Out.data(), m_Out.size(), m_OutLen};
+            size_t ret = ZSTD_decompressStream(m_ZD, &out, &in);
+            if (ZSTD_isError(ret))
+            {
+                m_Error = std::string("corrupt zstd data: ") + ZSTD_getErrorName(ret);
+                m_End = true;
+                break;
+            }
+            m_Produced += out.pos - m_OutLen;
+            m_OutLen = out.pos;
+            m_InPos = in.pos;
+            m_FrameStart = ret == 0; // the stream stops at frame ends, so 'in' is the next frame
+        }
+    }
+#endif
+
+    GribCompression m_Kind = GribCompression::None;
+    FILE *m_File = nullptr;
+    std::vector<CompressedCheckpoint> *m_Record = nullptr;
+    std::string m_Error;
+    bool m_End = false;
+    std::vector<unsigned char> m_In;
+    size_t m_InPos = 0, m_InLen = 0;
+    uint64_t m_InBase = 0; // file offset of m_In[0]
+    std::vector<unsigned char> m_Out;
+    size_t m_OutPos = 0, m_OutLen = 0;
+    uint64_t m_Produced = 0; // uncompressed offset of m_Out[m_OutLen]
+#if defined(GRIBVIEW_HAVE_ZLIB)
+    z_stream m_Z = z_stream();
+    bool m_ZOpen = false;
+    bool m_Raw = false;
+    std::vector<unsigned char> m_Ring;
+    size_t m_RingPos = 0, m_RingFill = 0;
+#endif
+#if defined(GRIBVIEW_HAVE_ZSTD)
+    ZSTD_DStream *m_ZD = nullptr;
+    bool m_FrameStart = true;
+#endif
+};
+
+// The checkpoints of one compressed file, and a cursor for reads that
+// follow each other.
+class CompressedGribIndex
+{
+public:
+    std::string path;
+    GribCompression kind = GribCompression::None;
+    uint64_t compressedBytes = 0;
+    uint64_t uncompressedBytes = 0;
+    std::vector<CompressedCheckpoint> points;
+
+    // Copies 'size' uncompressed bytes at 'offset' to 'dst'. Safe to call
+    // from several threads; only one at a time uses the cursor.
+    bool ReadAt(uint64_t offset, void *dst, size_t size, std::string &error)
+    {
+        if (points.empty())
+        {
+            error = path + " has no checkpoint index";
+            return false;
+        }
+        auto after = std::upper_bound(points.begin(), points.end(), offset,
+                                      [](uint64_t o, const CompressedCheckpoint &p) { return o < p.out; });
+        const CompressedCheckpoint &point = *(after == points.begin() ? after : after - 1);
+        std::unique_lock<std::mutex> lock(m_CursorMutex, std::try_to_lock);
+        CompressedDecoder local;
+        CompressedDecoder &d = lock.owns_lock() ? m_Cursor : local;
+        bool resume = d.IsOpen() && d.Position() <= offset && d.Position() >= point.out;
+        if (!resume && !d.Start(path, kind, point, error))
+            return false;
+        if (!d.Skip(offset - d.Position()) || d.Read(dst, size) != size)
+        {
+            error = d.Error().empty() ? "unexpected end of compressed data in " + path : d.Error() + " in " + path;
+            d.Close();
+            return false;
+        }
+        return true;
+    }
+
+    size_t MemoryBytes() const
+    {
+        size_t bytes = sizeof(*this) + points.capacity() * sizeof(CompressedCheckpoint) + path.capacity();
+        for (const CompressedCheckpoint &p : points)
+            bytes += p.window.capacity();
+        return bytes;
+    }
+
+private:
+    std::mutex m_CursorMutex;
+    CompressedDecoder m_Cursor; // left where the last read stopped
+};
@@ -5,6 +5,8 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <cstdint>
 #include <cmath>
 #include <algorithm>
 #include <limits>
@@ -13,7 +15,14 @@
 #include <cctype>  // for isspace
 #include <cstdarg>
 #include <filesystem>
+#include <fstream>
 #include <sstream>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
 #include "imgui.h"
 #include "imgui_impl_sdl2.h"
 #include "imgui_impl_opengl3.h"
@@ -21,6 +30,16 @@
 #include <GL/glew.h>
 #include <png.h>
 #include <eccodes.h>
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#endif
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 extern "C"
 {
@@ -44,6 +63,50 @@ extern "C"
 
 // Your colormap data/structures:
 #include "colormap512.h"
+#include "compressed_grib.h"
+
+// ----------------------------------------------------------
+// Grids. Messages on the same grid share one GridGeometry (see InternGrid),
+// so a file with thousands of fields on a few grids keeps a few grid
+// definitions and lookup tables, not thousands.
+// ----------------------------------------------------------
+// How a grid is laid out on the canvas (see AcquireGridWarp).
+struct GridWarp
+{
+    std::string error;           // set if the grid cannot be shown
+    bool warped = false;         // false: regular lat/lon, the grid is the raster
+    long width = 0, height = 0;  // raster size (the grid size when not warped)
+    double north = 0.0, west = 0.0, step = 0.0; // first pixel centre and spacing, degrees
+    bool global = false;         // the raster wraps around in longitude
+    std::vector<int32_t> pointOfPixel; // grid point under each raster pixel, -1 outside the grid
+
+    // Reduced grids (pl points on each row) have no pixel table: the raster
+    // line gives the row and the longitude the point, both in O(1).
+    std::vector<uint32_t> rowStart;  // first point of each row, then the point count
+    std::vector<int32_t> lineRows;   // per raster line, the rows just north and south of it
+    std::vector<float> lineWeight;   // per raster line, weight of the southern row
+    std::vector<double> rowLat;      // latitude of each row, in storage order
+    double rowWest = 0.0;            // longitude of the first point of every row
+    double rowSpan = 360.0;          // first to last point of a row, when rows are not global
+};
+
+struct GridGeometry
+{
+    uint64_t hash = 0; // of the grid section (md5GridSection); 0 for the unknown grid
+    std::string gridType;
+    long Ni = 0, Nj = 0;
+    long numberOfPoints = 0;
+    bool iNegative = false, jConsecutive = false, jPositive = false;
+    double lat1 = 0.0, lat2 = 0.0, lon1 = 0.0, lon2 = 0.0;
+    std::shared_ptr<const GridWarp> warp; // built on first use, under g_GeometryMutex
+};
+
+// Placeholder for messages whose grid has not been read.
+static const std::shared_ptr<GridGeometry> &UnknownGrid()
+{
+    static const std::shared_ptr<GridGeometry> unknown = std::make_shared<GridGeometry>();
+    return unknown;
+}
 
 // ----------------------------------------------------------
 // Structure to hold one GRIB message
@@ -55,9 +118,7 @@ struct GribMessage
     std::string shortName;
     long dataTime;
     long dataDate;
-    long Ni;
-    long Nj;
-    double lat1, lat2, lon1, lon2;
+    std::shared_ptr<GridGeometry> grid; // shared with every message on the same grid, never null
     double minVal, maxVal;
     std::string parameterUnits;
     std::string parameterName;
@@ -66,6 +127,16 @@ struct GribMessage
     // the file path and the file offset at which this message starts.
     std::string filePath;
     long fileOffset;
+    size_t messageSize; // encoded length in bytes, 0 if unknown
+    uint64_t contentHash; // XXH64 of the encoded bytes, 0 if not computed
+
+    // Set by UpdateDuplicates (message indices, -1 for none):
+    int duplicateOf;  // first loaded message with the same bytes
+    int conflictWith; // another message with the same keys but different data
+
+    // Its file was rewritten (watch mode): the message keeps its index but
+    // is no longer shown, indexed or read.
+    bool stale;
 
     // The eccodes handle for on-demand (reopened later if needed):
     codes_handle *message;
@@ -79,7 +150,11 @@ struct GribMessage
     // New: selection flag for multi-select
     bool selected;
 
-    GribMessage() : message(nullptr), fullyPopulated(false), selected(false) {}
+    GribMessage()
+        : grid(UnknownGrid()), fileOffset(0), messageSize(0), contentHash(0), duplicateOf(-1), conflictWith(-1), stale(false), message(nullptr),
+          fullyPopulated(false), selected(false)
+    {
+    }
 };
 
 // ----------------------------------------------------------
@@ -109,6 +184,7 @@ static float g_OffsetX = 0.0f;
 static float g_OffsetY = 0.0f;
 static bool g_IsPanning = false;
 static ImVec2 g_PanStart;
+static ImVec2 g_CanvasSize(0.0f, 0.0f); // visible canvas area, in pixels
 
 // Save‐image path
 static char g_SaveImagePath[512] = "coloured.png";
@@ -118,6 +194,7 @@ static bool g_ShowInspector = false;
 static int g_InspectorIndex = -1; // which message are we inspecting?
 static char g_SaveGribPath[512] = "selection.grib";
 static char g_SaveSinglePath[512] = "message.grib";
+static char g_ViewPath[512] = "table.view";
 static std::string g_SaveSelectionStatus;
 static bool g_SaveSelectionSuccess = false;
 static int g_LastSelectionAnchor = -1;
@@ -125,9 +202,12 @@ static int g_ScrollPendingIndex = -1;
 static bool g_RequestFileDialog = false;
 static std::string g_LastOpenedDir;
 static bool g_AddMarkerMode = false;
+static char g_MarkersImportPath[512] = "stations.csv";
 static int g_DraggingMarkerIndex = -1;
 static std::string g_ExtractionStatus;
 static char g_MarkersCsvPath[512] = "markers.csv";
+static char g_RegionsCsvPath[512] = "regions.csv";
+static char g_ProfileCsvPath[512] = "profile.csv";
 static bool g_ExtractionRunning = false;
 static size_t g_ExtractionNextIndex = 0;
 static int g_PlotClickRequest = -1;
@@ -137,22 +217,92 @@ static const char *kUpdateUrl = "https://filippi.github.io/gribview/";
 
 struct MarkerSample
 {
-    std::string messageKey;
+    int messageIndex; // index into g_GribMessages (stable, messages are never reordered)
     double value;
 };
 
+enum MarkerInterp
+{
+    kInterpNearest,
+    kInterpBilinear,
+    kInterpInverseDistance,
+    kInterpCount
+};
+
+static const char *kInterpNames[kInterpCount] = {"nearest", "bilinear", "inverse distance"};
+
+// Grid points and weights giving a marker's value on one grid (see BuildSampleStencil).
+struct SampleStencil
+{
+    int count = 0;
+    int32_t point[4] = {};
+    double weight[4] = {};
+};
+
 struct Marker
 {
     int id;
     double lat;
     double lon;
+    std::string name; // station name from an imported list, empty for "M<id>"
     std::vector<MarkerSample> series;
-    char csvPath[512];
     std::string status;
+    int interp = kInterpNearest;
+    // One stencil per grid the marker was sampled on; cleared when it moves.
+    std::vector<std::pair<std::shared_ptr<GridGeometry>, SampleStencil>> stencils;
 };
 
 static std::vector<Marker> g_Markers;
 
+// Area statistics regions; see the Regions section.
+struct RegionRun
+{
+    uint32_t first, count;
+    float weight; // cos(lat) of the row; unused when the mask has pointWeights
+};
+
+struct RegionMask
+{
+    std::vector<RegionRun> runs;
+    std::vector<float> pointWeights; // one per point, for grids whose rows are not parallels
+    size_t points = 0;
+};
+
+struct RegionSample
+{
+    int messageIndex;
+    double mean, min, max, percentile; // NaN without valid points
+    uint32_t points;                   // valid (not missing) points
+};
+
+struct Region
+{
+    int id;
+    bool box;
+    std::vector<std::pair<double, double>> vertices; // lat, lon; longitudes unwrapped along the outline
+    std::vector<RegionSample> series;
+    std::vector<std::pair<std::shared_ptr<GridGeometry>, std::shared_ptr<const RegionMask>>> masks;
+    RegionSample current{-1, 0.0, 0.0, 0.0, 0.0, 0}; // the selected message's, shown in the panel
+};
+
+static std::vector<Region> g_Regions;
+
+// Vertical profile / time x level matrix; see the Vertical profiles section.
+struct ProfileMatrix
+{
+    Marker probe;                    // copy of the marker, so later edits do not mix in
+    std::string parameter, levelType;
+    std::vector<std::string> times;  // validity labels, one row each
+    std::vector<std::string> levels; // level labels, one column each
+    std::vector<double> levelValues;
+    std::vector<int> messages;       // times x levels, -1 where there is no message
+    std::vector<double> values;      // times x levels, NaN where missing
+    size_t next = 0;                 // next cell to extract
+    bool running = false;
+};
+
+static ProfileMatrix g_Profile;
+
 // For the GRIB table and keys select popup
 struct UiState
 {
@@ -167,16 +317,346 @@ struct UiState
 static void LoadGribFileAppend(const std::string &path);
 static void ConfigureEcCodesEnvironment();
 static codes_handle *ReopenGribMessage(GribMessage &gm);
+static codes_handle *EnsureMessageHandle(GribMessage &gm);
 static void GetMessageValuesAndRange(codes_handle *h,
                                      std::vector<double> &outValues,
                                      double &outMinVal,
                                      double &outMaxVal);
 static void ClearAllSelections();
+static void ClearRegionSeries();
+static void ClearProfile();
 static void RefreshSelectionState(bool requestScroll, int preferredIndex);
 static void UpdateWindowTitle();
 static void EnsureParameterInfo(GribMessage &gm);
 static void OpenUrl(const char *url);
 static void SetWindowIcon(SDL_Window *window);
+static void ApplyTableFilter();
+static void StopWatch();
+static bool StartStdinStream(std::string &error);
+
+// ----------------------------------------------------------
+// Session tracing (--trace out.json). Scoped events go to a buffer owned by
+// the recording thread, so recording takes no lock; the buffers are written
+// as Chrome/Perfetto trace-event JSON at exit. When tracing is off a scope
+// costs one relaxed atomic load.
+// ----------------------------------------------------------
+struct TraceEvent
+{
+    const char *name; // static strings only
+    const char *category;
+    int64_t startUs;
+    int64_t durationUs;
+    long long arg; // e.g. message index, -1 if none
+    const char *argName;
+};
+
+struct TraceBuffer
+{
+    int order = 0;     // registration order; the UI thread is 1
+    long long tid = 0; // as the OS reports it
+    std::vector<TraceEvent> events;
+};
+
+static std::atomic<bool> g_TraceEnabled{false};
+static std::string g_TracePath;
+static const std::chrono::steady_clock::time_point g_TraceStart = std::chrono::steady_clock::now();
+static std::mutex g_TraceBuffersMutex; // guards registration only
+static std::vector<std::unique_ptr<TraceBuffer>> g_TraceBuffers;
+
+// The id a debugger or system profiler shows for the calling thread. SDL
+// gives the Windows one; on macOS it is the pthread handle.
+static long long OsThreadId()
+{
+#if defined(__linux__)
+    return (long long)syscall(SYS_gettid);
+#else
+    return (long long)SDL_ThreadID();
+#endif
+}
+
+static TraceBuffer &ThreadTraceBuffer()
+{
+    thread_local TraceBuffer *buffer = nullptr;
+    if (!buffer)
+    {
+        std::lock_guard<std::mutex> lock(g_TraceBuffersMutex);
+        g_TraceBuffers.push_back(std::make_unique<TraceBuffer>());
+        buffer = g_TraceBuffers.back().get();
+        buffer->order = (int)g_TraceBuffers.size();
+        buffer->tid = OsThreadId();
+    }
+    return *buffer;
+}
+
+static int64_t TraceNowUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - g_TraceStart).count();
+}
+
+struct ScopedTrace
+{
+    const char *name;
+    const char *category;
+    long long arg;
+    const char *argName;
+    int64_t start;
+    ScopedTrace(const char *n, const char *cat, long long a = -1, const char *an = "message")
+        : name(n), category(cat), arg(a), argName(an),
+          start(g_TraceEnabled.load(std::memory_order_relaxed) ? TraceNowUs() : -1) {}
+    ~ScopedTrace()
+    {
+        if (start >= 0)
+            ThreadTraceBuffer().events.push_back({name, category, start, TraceNowUs() - start, arg, argName});
+    }
+};
+
+static void StartTrace(const std::string &path)
+{
+    g_TracePath = path;
+    ThreadTraceBuffer(); // the UI thread registers first
+    g_TraceEnabled = true;
+}
+
+// Call once all worker threads have finished; main does so on every return
+// through a TraceFileGuard.
+static bool WriteTraceFile()
+{
+    if (!g_TraceEnabled)
+        return true;
+    g_TraceEnabled = false;
+    FILE *f = fopen(g_TracePath.c_str(), "w");
+    if (!f)
+        return false;
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    std::lock_guard<std::mutex> lock(g_TraceBuffersMutex);
+    fprintf(f, "{\"ph\":\"M\",\"pid\":1,\"tid\":%lld,\"name\":\"process_name\",\"args\":{\"name\":\"gribview\"}}",
+            g_TraceBuffers.empty() ? 0LL : g_TraceBuffers.front()->tid);
+    for (const auto &buffer : g_TraceBuffers)
+    {
+        std::string threadName = buffer->order == 1 ? "ui" : "worker " + std::to_string(buffer->order - 1);
+        fprintf(f, ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":%lld,\"name\":\"thread_name\",\"args\":{\"name\":\"%s\"}}",
+                buffer->tid, threadName.c_str());
+        for (const TraceEvent &e : buffer->events)
+        {
+            fprintf(f, ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%lld,\"name\":\"%s\",\"cat\":\"%s\",\"ts\":%lld,\"dur\":%lld",
+                    buffer->tid, e.name, e.category, (long long)e.startUs, (long long)e.durationUs);
+            if (e.arg >= 0)
+                fprintf(f, ",\"args\":{\"%s\":%lld}", e.argName, e.arg);
+            fprintf(f, "}");
+        }
+    }
+    fprintf(f, "\n]}\n");
+    return fclose(f) == 0;
+}
+
+// ----------------------------------------------------------
+// Performance counters for the HUD (View > Performance HUD, F3). Stage
+// timers only record on the UI thread, so export workers do not blur the
+// numbers of the message on screen.
+// ----------------------------------------------------------
+enum PerfStage
+{
+    kPerfReopen,
+    kPerfDecode,
+    kPerfMinMax,
+    kPerfWarp,
+    kPerfColormap,
+    kPerfUpload,
+    kPerfStageCount
+};
+static const char *kPerfStageNames[kPerfStageCount] = {"reopen", "decode", "min/max", "warp", "colormap", "upload"};
+static const int kPerfFrameHistory = 120;
+
+struct PerfStats
+{
+    std::thread::id uiThread = std::this_thread::get_id();
+    double stageMs[kPerfStageCount] = {};  // since the last selection change
+    float frameMs[kPerfFrameHistory] = {};
+    int frameHead = 0;
+    size_t scanMessages = 0;  // last file scan
+    uint64_t scanBytes = 0;
+    double scanSeconds = 0.0;
+    double scanHashSeconds = 0.0; // part of scanSeconds spent on content hashes
+    uint64_t handleHits = 0;  // message handle already open
+    uint64_t handleMisses = 0;
+    uint64_t queryHits = 0;   // query column index reused
+    uint64_t queryMisses = 0;
+};
+static PerfStats g_Perf;
+static bool g_ShowPerfHud = false;
+
+struct ScopedPerfTimer
+{
+    PerfStage stage;
+    ScopedTrace trace;
+    std::chrono::steady_clock::time_point start;
+    explicit ScopedPerfTimer(PerfStage s, long long arg = -1)
+        : stage(s), trace(kPerfStageNames[s], "message", arg), start(std::chrono::steady_clock::now()) {}
+    ~ScopedPerfTimer()
+    {
+        if (std::this_thread::get_id() == g_Perf.uiThread)
+            g_Perf.stageMs[stage] += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+
+static void ResetPerfStages()
+{
+    for (double &ms : g_Perf.stageMs)
+        ms = 0.0;
+}
+
+static double PerfRatio(uint64_t hits, uint64_t misses)
+{
+    uint64_t total = hits + misses;
+    return total ? 100.0 * (double)hits / (double)total : 0.0;
+}
+
+static void RecordFrameTime(float seconds)
+{
+    g_Perf.frameMs[g_Perf.frameHead] = seconds * 1000.0f;
+    g_Perf.frameHead = (g_Perf.frameHead + 1) % kPerfFrameHistory;
+}
+
+// Overlay in the top-right corner of the canvas.
+static void DrawPerfHud()
+{
+    if (!g_ShowPerfHud)
+        return;
+    // Walking every message is cheap but not free on huge tables; refresh
+    // the resident-bytes figures a few times per second only.
+    static int refresh = 0;
+    static size_t openHandles = 0;
+    static uint64_t handleBytes = 0;
+    if (refresh-- <= 0)
+    {
+        refresh = 20;
+        openHandles = 0;
+        handleBytes = 0;
+        for (const GribMessage &gm : g_GribMessages)
+        {
+            if (gm.message)
+            {
+                openHandles++;
+                handleBytes += gm.messageSize;
+            }
+        }
+    }
+    float avg = 0.0f, worst = 0.0f;
+    for (float ms : g_Perf.frameMs)
+    {
+        avg += ms;
+        worst = std::max(worst, ms);
+    }
+    avg /= (float)kPerfFrameHistory;
+    const ImGuiViewport *vp = ImGui::GetMainViewport();
+    ImGui::SetNextWindowPos(ImVec2(vp->WorkPos.x + vp->WorkSize.x - 10.0f, vp->WorkPos.y + 10.0f),
+                            ImGuiCond_Always, ImVec2(1.0f, 0.0f));
+    ImGui::SetNextWindowBgAlpha(0.75f);
+    ImGuiWindowFlags flags = ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_AlwaysAutoResize |
+                             ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoFocusOnAppearing |
+                             ImGuiWindowFlags_NoNav | ImGuiWindowFlags_NoInputs;
+    if (ImGui::Begin("##perfhud", nullptr, flags))
+    {
+        ImGui::Text("Frame %.2f ms avg, %.2f ms worst", avg, worst);
+        ImGui::PlotLines("##frames", g_Perf.frameMs, kPerfFrameHistory, g_Perf.frameHead, nullptr,
+                         0.0f, std::max(33.0f, worst), ImVec2(220.0f, 40.0f));
+        ImGui::Separator();
+        ImGui::TextUnformatted("Last selection");
+        double total = 0.0;
+        for (int s = 0; s < kPerfStageCount; s++)
+        {
+            ImGui::Text("  %-9s %8.2f ms", kPerfStageNames[s], g_Perf.stageMs[s]);
+            total += g_Perf.stageMs[s];
+        }
+        ImGui::Text("  %-9s %8.2f ms", "total", total);
+        ImGui::Separator();
+        if (g_Perf.scanSeconds > 0.0)
+        {
+            ImGui::Text("Scan %.0f msg/s, %.0f MB/s", (double)g_Perf.scanMessages / g_Perf.scanSeconds,
+                        (double)g_Perf.scanBytes / (1024.0 * 1024.0) / g_Perf.scanSeconds);
+            ImGui::Text("  hashing %.1f%% of the scan", 100.0 * g_Perf.scanHashSeconds / g_Perf.scanSeconds);
+        }
+        ImGui::Text("Handle cache %.0f%% hit (%llu/%llu)", PerfRatio(g_Perf.handleHits, g_Perf.handleMisses),
+                    (unsigned long long)g_Perf.handleHits,
+                    (unsigned long long)(g_Perf.handleHits + g_Perf.handleMisses));
+        ImGui::Text("Query columns %.0f%% hit", PerfRatio(g_Perf.queryHits, g_Perf.queryMisses));
+        double texMb = g_TextureID ? (double)g_TexWidth * (double)g_TexHeight * 4.0 / (1024.0 * 1024.0) : 0.0;
+        ImGui::Text("Resident: %zu handles (%.1f MB), texture %.1f MB", openHandles,
+                    (double)handleBytes / (1024.0 * 1024.0), texMb);
+    }
+    ImGui::End();
+}
+
+// ----------------------------------------------------------
+// Memory accounting (View > Memory, --mem-report). Long-lived structures
+// are measured by walking them (see ComputeMemoryReport); short-lived
+// buffers such as decoded fields, RGBA images and export blocks are
+// charged while they exist, from any thread, so their peaks are kept.
+// ----------------------------------------------------------
+enum MemCategory
+{
+    kMemMetadata,
+    kMemHandles,
+    kMemDecoded,
+    kMemStaging,
+    kMemTextures,
+    kMemMarkers,
+    kMemIndexes,
+    kMemGrids,
+    kMemCategoryCount
+};
+static const char *kMemCategoryNames[kMemCategoryCount] = {"metadata", "open handles", "decoded fields",
+                                                           "RGBA/IO staging", "textures", "marker series",
+                                                           "view/query indexes", "grid geometry"};
+static std::atomic<uint64_t> g_MemLive[kMemCategoryCount];
+static std::atomic<uint64_t> g_MemPeak[kMemCategoryCount];
+static uint64_t g_MemLimitBytes = 0;        // 0: no warning
+static const double kMemWarnFraction = 0.9; // warn from 90% of the limit
+static bool g_ShowMemory = false;
+
+static void NoteMemPeak(MemCategory category, uint64_t bytes)
+{
+    uint64_t peak = g_MemPeak[category].load();
+    while (bytes > peak && !g_MemPeak[category].compare_exchange_weak(peak, bytes))
+    {
+    }
+}
+
+struct ScopedMemCharge
+{
+    MemCategory category;
+    uint64_t bytes = 0;
+    explicit ScopedMemCharge(MemCategory c, uint64_t n = 0) : category(c) { Set(n); }
+    ~ScopedMemCharge() { Set(0); }
+    ScopedMemCharge(const ScopedMemCharge &) = delete;
+    ScopedMemCharge &operator=(const ScopedMemCharge &) = delete;
+    // Changes the amount held, e.g. once a buffer has its final size.
+    void Set(uint64_t n)
+    {
+        if (n >= bytes)
+            NoteMemPeak(category, g_MemLive[category].fetch_add(n - bytes) + (n - bytes));
+        else
+            g_MemLive[category].fetch_sub(bytes - n);
+        bytes = n;
+    }
+};
+
+template <typename T>
+static uint64_t VectorBytes(const std::vector<T> &v)
+{
+    return (uint64_t)v.capacity() * sizeof(T);
+}
+
+static uint64_t VectorBytes(const std::vector<bool> &v)
+{
+    return (uint64_t)v.capacity() / 8;
+}
+
+// Heap block owned by a string; short ones are stored inline.
+static uint64_t StringHeapBytes(const std::string &s)
+{
+    return s.capacity() > 15 ? (uint64_t)s.capacity() + 1 : 0;
+}
 
 // ----------------------------------------------------------
 // Destroy texture helper
@@ -201,38 +681,35 @@ static void OpenUrl(const char *url)
     }
 }
 
-// Load window icon from PNG (tools/icon.png) if available
-static void SetWindowIcon(SDL_Window *window)
+// Read a PNG as 8-bit RGBA rows (width * 4 bytes each).
+static bool ReadPngRGBA(const char *path, std::vector<unsigned char> &rgba, int &width, int &height)
 {
-    if (!window)
-        return;
-    const char *iconPath = "tools/icon.png";
-    FILE *fp = fopen(iconPath, "rb");
+    FILE *fp = fopen(path, "rb");
     if (!fp)
-        return;
+        return false;
     png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
     if (!png)
     {
         fclose(fp);
-        return;
+        return false;
     }
     png_infop info = png_create_info_struct(png);
     if (!info)
     {
         png_destroy_read_struct(&png, NULL, NULL);
         fclose(fp);
-        return;
+        return false;
     }
     if (setjmp(png_jmpbuf(png)))
     {
         png_destroy_read_struct(&png, &info, NULL);
         fclose(fp);
-        return;
+        return false;
     }
     png_init_io(png, fp);
     png_read_info(png, info);
-    int width = png_get_image_width(png, info);
-    int height = png_get_image_height(png, info);
+    width = png_get_image_width(png, info);
+    height = png_get_image_height(png, info);
     png_byte color_type = png_get_color_type(png, info);
     png_byte bit_depth = png_get_bit_depth(png, info);
     if (bit_depth == 16)
@@ -241,6 +718,8 @@ static void SetWindowIcon(SDL_Window *window)
         png_set_palette_to_rgb(png);
     if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8)
         png_set_expand_gray_1_2_4_to_8(png);
+    if (color_type == PNG_COLOR_TYPE_GRAY || color_type == PNG_COLOR_TYPE_GRAY_ALPHA)
+        png_set_gray_to_rgb(png);
     if (png_get_valid(png, info, PNG_INFO_tRNS))
         png_set_tRNS_to_alpha(png);
     if (color_type == PNG_COLOR_TYPE_RGB ||
@@ -248,17 +727,28 @@ static void SetWindowIcon(SDL_Window *window)
         color_type == PNG_COLOR_TYPE_PALETTE)
         png_set_filler(png, 0xFF, PNG_FILLER_AFTER);
     png_read_update_info(png, info);
-    int rowbytes = png_get_rowbytes(png, info);
-    std::vector<png_byte> imageData(rowbytes * height);
+    size_t rowbytes = png_get_rowbytes(png, info);
+    rgba.assign(rowbytes * height, 0);
     std::vector<png_bytep> rowPointers(height);
     for (int y = 0; y < height; y++)
-        rowPointers[y] = (png_bytep)&imageData[y * rowbytes];
+        rowPointers[y] = (png_bytep)&rgba[y * rowbytes];
     png_read_image(png, rowPointers.data());
     png_destroy_read_struct(&png, &info, NULL);
     fclose(fp);
+    return rowbytes == (size_t)width * 4;
+}
 
+// Load window icon from PNG (tools/icon.png) if available
+static void SetWindowIcon(SDL_Window *window)
+{
+    if (!window)
+        return;
+    std::vector<unsigned char> imageData;
+    int width = 0, height = 0;
+    if (!ReadPngRGBA("tools/icon.png", imageData, width, height))
+        return;
     SDL_Surface *surf = SDL_CreateRGBSurfaceWithFormatFrom(
-        imageData.data(), width, height, 32, rowbytes, SDL_PIXELFORMAT_RGBA32);
+        imageData.data(), width, height, 32, width * 4, SDL_PIXELFORMAT_RGBA32);
     if (surf)
     {
         SDL_SetWindowIcon(window, surf);
@@ -271,6 +761,7 @@ static void SetWindowIcon(SDL_Window *window)
 // ----------------------------------------------------------
 static GLuint CreateTextureFromData(const unsigned char *data, int width, int height)
 {
+    ScopedPerfTimer timer(kPerfUpload);
     GLuint tex;
     glGenTextures(1, &tex);
     glBindTexture(GL_TEXTURE_2D, tex);
@@ -316,14 +807,16 @@ static void UpdateSavePathsForDir(const std::filesystem::path &dir)
     SetPathBuffer(g_SaveGribPath, IM_ARRAYSIZE(g_SaveGribPath), (base / "selection.grib").string());
     SetPathBuffer(g_SaveSinglePath, IM_ARRAYSIZE(g_SaveSinglePath), (base / "message.grib").string());
     SetPathBuffer(g_MarkersCsvPath, IM_ARRAYSIZE(g_MarkersCsvPath), (base / "markers.csv").string());
+    SetPathBuffer(g_RegionsCsvPath, IM_ARRAYSIZE(g_RegionsCsvPath), (base / "regions.csv").string());
+    SetPathBuffer(g_ProfileCsvPath, IM_ARRAYSIZE(g_ProfileCsvPath), (base / "profile.csv").string());
+    SetPathBuffer(g_ViewPath, IM_ARRAYSIZE(g_ViewPath), (base / "table.view").string());
 }
 
 static void EnsureParameterInfo(GribMessage &gm)
 {
     if (!gm.parameterName.empty() && !gm.parameterUnits.empty())
         return;
-    if (!gm.message)
-        gm.message = ReopenGribMessage(gm);
+    EnsureMessageHandle(gm);
     if (!gm.message)
         return;
     if (gm.parameterName.empty())
@@ -368,19 +861,235 @@ static void UpdateWindowTitle()
     SDL_SetWindowTitle(g_Window, title.c_str());
 }
 
-static std::string BuildMessageKey(const GribMessage &gm)
+// ----------------------------------------------------------
+// Message view
+// g_GribMessages is append-only: messages are never reordered or erased
+// while loaded, so a message index stays valid for markers, the inspector
+// and the selection. The table shows g_View.order filtered by the
+// visibility bitset; sort, delete and undo only shuffle integers.
+// ----------------------------------------------------------
+struct ViewState
+{
+    std::vector<int> order;    // every message index, in display order
+    std::vector<bool> visible; // per message index, false once removed
+};
+
+static ViewState g_View;
+static std::vector<ViewState> g_ViewUndo;
+static const size_t kMaxViewUndo = 32;
+static std::vector<int> g_ViewRows;     // visible message indices in display order
+static std::vector<int> g_RowOfMessage; // message index -> row in g_ViewRows, or -1
+static char g_FilterText[512] = "";
+static std::string g_FilterError;
+static std::vector<uint8_t> g_FilterMask; // per message, empty when no filter is set
+
+// ----------------------------------------------------------
+// Duplicate detection. Every message is hashed (XXH64) while it is
+// scanned, from the bytes the scan has already read. Overlapping archives
+// then show up as messages with equal hash and length; with
+// g_CollapseDuplicates only the first one loaded stays in the view, so
+// saves write it once. Messages with the same identifying keys but
+// different bytes are flagged as conflicts in the table and left alone.
+// ----------------------------------------------------------
+static inline uint64_t HashRotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t HashRead64(const unsigned char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v; // little-endian hosts; the hashes never leave the process
+}
+
+static inline uint64_t HashRound(uint64_t acc, uint64_t input)
+{
+    acc += input * 0xC2B2AE3D27D4EB4FULL;
+    return HashRotl(acc, 31) * 0x9E3779B185EBCA87ULL;
+}
+
+static inline uint64_t HashMerge(uint64_t acc, uint64_t v)
+{
+    acc ^= HashRound(0, v);
+    return acc * 0x9E3779B185EBCA87ULL + 0x85EBCA77C2B2AE63ULL;
+}
+
+// XXH64 (seed 0), written out to avoid a dependency for fifty lines.
+static uint64_t ContentHash(const void *data, size_t len)
+{
+    const uint64_t p1 = 0x9E3779B185EBCA87ULL, p2 = 0xC2B2AE3D27D4EB4FULL, p3 = 0x165667B19E3779F9ULL;
+    const uint64_t p4 = 0x85EBCA77C2B2AE63ULL, p5 = 0x27D4EB2F165667C5ULL;
+    const unsigned char *p = (const unsigned char *)data;
+    const unsigned char *end = p + len;
+    uint64_t h;
+    if (len >= 32)
+    {
+        uint64_t v1 = p1 + p2, v2 = p2, v3 = 0, v4 = 0 - p1;
+        for (; p + 32 <= end; p += 32)
+        {
+            v1 = HashRound(v1, HashRead64(p));
+            v2 = HashRound(v2, HashRead64(p + 8));
+            v3 = HashRound(v3, HashRead64(p + 16));
+            v4 = HashRound(v4, HashRead64(p + 24));
+        }
+        h = HashRotl(v1, 1) + HashRotl(v2, 7) + HashRotl(v3, 12) + HashRotl(v4, 18);
+        h = HashMerge(HashMerge(HashMerge(HashMerge(h, v1), v2), v3), v4);
+    }
+    else
+        h = p5;
+    h += (uint64_t)len;
+    for (; p + 8 <= end; p += 8)
+        h = HashRotl(h ^ HashRound(0, HashRead64(p)), 27) * p1 + p4;
+    if (p + 4 <= end)
+    {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        h = HashRotl(h ^ ((uint64_t)v * p1), 23) * p2 + p3;
+        p += 4;
+    }
+    for (; p < end; p++)
+        h = HashRotl(h ^ (*p * p5), 11) * p1;
+    h ^= h >> 33;
+    h *= p2;
+    h ^= h >> 29;
+    h *= p3;
+    h ^= h >> 32;
+    return h;
+}
+
+static bool g_CollapseDuplicates = false; // View > Collapse Duplicates, --dedup
+static bool g_ContentHashing = true;      // off only to measure what hashing costs the scan
+static std::unordered_map<uint64_t, int> g_FirstWithContent;  // hash ^ length -> message index
+static std::unordered_map<uint64_t, int> g_FirstWithIdentity; // hash of the identifying keys -> message index
+static size_t g_DedupChecked = 0; // messages already entered in the two maps
+static size_t g_DuplicateCount = 0;
+static size_t g_ConflictCount = 0;
+
+// The keys that say which field a message is; two messages that agree on
+// all of them are expected to carry the same data.
+static uint64_t MessageIdentityHash(const GribMessage &gm)
+{
+    static const char *const keys[] = {"shortName", "paramId", "typeOfLevel", "level", "dataDate", "dataTime",
+                                       "stepRange", "step", "number", "class", "stream", "expver", "Ni", "Nj"};
+    std::string identity;
+    for (const char *key : keys)
+    {
+        auto it = gm.keyValueMap.find(key);
+        if (it != gm.keyValueMap.end())
+            identity += it->second;
+        identity += '\x1f';
+    }
+    return ContentHash(identity.data(), identity.size());
+}
+
+// Enters the messages loaded since the last call. Duplicates point at the
+// first message loaded with the same bytes, so which copy is kept does not
+// depend on the view order.
+static void UpdateDuplicates()
+{
+    for (size_t i = g_DedupChecked; i < g_GribMessages.size(); i++)
+    {
+        GribMessage &gm = g_GribMessages[i];
+        if (gm.contentHash == 0 || gm.stale)
+            continue;
+        auto content = g_FirstWithContent.emplace(gm.contentHash ^ (uint64_t)gm.messageSize, (int)i);
+        if (!content.second)
+        {
+            gm.duplicateOf = content.first->second;
+            g_DuplicateCount++;
+            continue;
+        }
+        auto identity = g_FirstWithIdentity.emplace(MessageIdentityHash(gm), (int)i);
+        if (!identity.second)
+        {
+            GribMessage &first = g_GribMessages[identity.first->second];
+            gm.conflictWith = identity.first->second;
+            g_ConflictCount++;
+            if (first.conflictWith < 0)
+            {
+                first.conflictWith = (int)i;
+                g_ConflictCount++;
+            }
+        }
+    }
+    g_DedupChecked = g_GribMessages.size();
+}
+
+static void ResetDuplicates()
+{
+    g_FirstWithContent.clear();
+    g_FirstWithIdentity.clear();
+    g_DedupChecked = 0;
+    g_DuplicateCount = 0;
+    g_ConflictCount = 0;
+}
+
+// After messages went stale: the first copies may be among them.
+static void RebuildDuplicates()
 {
-    return gm.filePath + "|" + std::to_string(gm.fileOffset);
+    ResetDuplicates();
+    for (GribMessage &gm : g_GribMessages)
+    {
+        gm.duplicateOf = -1;
+        gm.conflictWith = -1;
+    }
+    UpdateDuplicates();
+}
+
+static void RebuildViewRows()
+{
+    g_ViewRows.clear();
+    g_RowOfMessage.assign(g_GribMessages.size(), -1);
+    for (int idx : g_View.order)
+    {
+        if (!g_View.visible[idx] || g_GribMessages[idx].stale)
+            continue;
+        if (idx < (int)g_FilterMask.size() && !g_FilterMask[idx])
+            continue;
+        if (g_CollapseDuplicates && g_GribMessages[idx].duplicateOf >= 0)
+            continue;
+        g_RowOfMessage[idx] = (int)g_ViewRows.size();
+        g_ViewRows.push_back(idx);
+    }
 }
 
-static GribMessage *FindMessageByKey(const std::string &key)
+// Append messages loaded since the last call to the end of the view.
+static void SyncViewWithMessages()
 {
-    for (auto &gm : g_GribMessages)
+    for (size_t i = g_View.visible.size(); i < g_GribMessages.size(); i++)
     {
-        if (BuildMessageKey(gm) == key)
-            return &gm;
+        g_View.order.push_back((int)i);
+        g_View.visible.push_back(true);
     }
-    return nullptr;
+    UpdateDuplicates();
+    if (g_FilterText[0])
+        ApplyTableFilter();
+    else
+        RebuildViewRows();
+}
+
+static void ResetViewState()
+{
+    g_View = ViewState();
+    g_ViewUndo.clear();
+    g_ViewRows.clear();
+    g_RowOfMessage.clear();
+    g_FilterMask.clear();
+}
+
+static int RowOfMessage(int msgIndex)
+{
+    if (msgIndex < 0 || msgIndex >= (int)g_RowOfMessage.size())
+        return -1;
+    return g_RowOfMessage[msgIndex];
+}
+
+static void PushViewUndo()
+{
+    if (g_ViewUndo.size() >= kMaxViewUndo)
+        g_ViewUndo.erase(g_ViewUndo.begin());
+    g_ViewUndo.push_back(g_View);
 }
 
 static ImU32 MarkerColor(int idx)
@@ -407,280 +1116,1284 @@ static ImVec4 MarkerColorVec4(int idx)
     return ImGui::ColorConvertU32ToFloat4(c);
 }
 
-static bool LatLonToGrid(const GribMessage &gm, double lat, double lon, double &fi, double &fj, int &i, int &j)
+// ----------------------------------------------------------
+// Grid geometry. A regular lat/lon grid is drawn as stored, one texel per
+// point. Any other Ni x Nj grid (Lambert conformal, polar stereographic,
+// rotated lat/lon, Gaussian, or a lat/lon grid in an unusual scanning
+// order) is warped onto a lat/lon raster: ecCodes gives the latitude and
+// longitude of every point, each grid cell is rasterised as two triangles,
+// and every raster pixel records the nearest cell corner. The table is
+// built once per grid, in parallel, and kept on the shared GridGeometry.
+// Display, hover picking and marker sampling all go through it.
+// ----------------------------------------------------------
+static const size_t kWarpPixelsPerPoint = 2;  // raster detail; cells are never all the same size
+static const long kWarpMaxSide = 8192;
+
+static bool g_LinearReduced = false; // View > Interpolate Reduced Grids
+static std::mutex g_GeometryMutex; // guards g_GridRegistry and GridGeometry::warp
+static std::unordered_map<uint64_t, std::shared_ptr<GridGeometry>> g_GridRegistry;
+
+// Hash of the grid definition (md5GridSection), or of the basic grid keys
+// for messages without one.
+static uint64_t GridHashOf(codes_handle *h)
 {
-    if (gm.Ni <= 1 || gm.Nj <= 1)
-        return false;
-    double latRange = fabs(gm.lat1 - gm.lat2);
-    if (latRange < 1e-9)
-        return false;
-    double lonRange = gm.lon2 - gm.lon1;
-    if (lonRange < 0)
-        lonRange += 360.0;
-    if (lonRange <= 0)
-        lonRange = 360.0;
-    bool desc = (gm.lat1 > gm.lat2);
-    fj = desc ? (gm.lat1 - lat) / latRange : (lat - gm.lat1) / latRange;
-    fj = std::clamp(fj, 0.0, 1.0);
-    double dlon = lon - gm.lon1;
-    while (dlon < 0.0)
-        dlon += 360.0;
-    while (dlon > lonRange && lonRange < 360.0)
-        dlon -= 360.0;
-    fi = lonRange > 1e-9 ? (dlon / lonRange) : 0.0;
-    fi = std::clamp(fi, 0.0, 1.0);
-    i = (int)std::round(fi * (double)(gm.Ni - 1));
-    j = (int)std::round(fj * (double)(gm.Nj - 1));
-    if (i < 0)
-        i = 0;
-    if (j < 0)
-        j = 0;
-    if (i >= gm.Ni)
-        i = (int)gm.Ni - 1;
-    if (j >= gm.Nj)
-        j = (int)gm.Nj - 1;
-    return true;
+    char buf[256];
+    size_t len = sizeof(buf);
+    if (codes_get_string(h, "md5GridSection", buf, &len) == 0 && len > 1)
+        return ContentHash(buf, strlen(buf));
+    long ni = 0, nj = 0;
+    double lat1 = 0, lon1 = 0, lat2 = 0, lon2 = 0;
+    codes_get_long(h, "Ni", &ni);
+    codes_get_long(h, "Nj", &nj);
+    codes_get_double(h, "latitudeOfFirstGridPointInDegrees", &lat1);
+    codes_get_double(h, "longitudeOfFirstGridPointInDegrees", &lon1);
+    codes_get_double(h, "latitudeOfLastGridPointInDegrees", &lat2);
+    codes_get_double(h, "longitudeOfLastGridPointInDegrees", &lon2);
+    char type[64] = "";
+    size_t typeLen = sizeof(type);
+    codes_get_string(h, "gridType", type, &typeLen);
+    len = (size_t)snprintf(buf, sizeof(buf), "%s %ld %ld %.6f %.6f %.6f %.6f", type, ni, nj, lat1, lon1, lat2, lon2);
+    return ContentHash(buf, std::min(len, sizeof(buf) - 1));
 }
 
-static bool LatLonToScreen(const GribMessage &gm, double lat, double lon, float contentX, float contentY, ImVec2 &outPos)
+// Grid of a message being scanned: looked up by hash, and only read from
+// the handle the first time that grid is seen.
+static std::shared_ptr<GridGeometry> InternGrid(codes_handle *h)
 {
-    double fi, fj;
-    int ii, jj;
-    if (!LatLonToGrid(gm, lat, lon, fi, fj, ii, jj))
-        return false;
-    float px = contentX + g_OffsetX + (float)fi * (float)(gm.Ni - 1) * g_Zoom;
-    float py = contentY + g_OffsetY + (float)fj * (float)(gm.Nj - 1) * g_Zoom;
-    outPos = ImVec2(px, py);
-    return true;
+    uint64_t hash = GridHashOf(h);
+    {
+        std::lock_guard<std::mutex> lock(g_GeometryMutex);
+        auto it = g_GridRegistry.find(hash);
+        if (it != g_GridRegistry.end())
+            return it->second;
+    }
+    auto grid = std::make_shared<GridGeometry>();
+    grid->hash = hash;
+    char type[64] = "";
+    size_t typeLen = sizeof(type);
+    if (codes_get_string(h, "gridType", type, &typeLen) == 0)
+        grid->gridType = type;
+    long iNegative = 0, jConsecutive = 0, jPositive = 0;
+    codes_get_long(h, "Ni", &grid->Ni);
+    codes_get_long(h, "Nj", &grid->Nj);
+    codes_get_long(h, "numberOfDataPoints", &grid->numberOfPoints);
+    codes_get_long(h, "iScansNegatively", &iNegative);
+    codes_get_long(h, "jPointsAreConsecutive", &jConsecutive);
+    codes_get_long(h, "jScansPositively", &jPositive);
+    grid->iNegative = iNegative != 0;
+    grid->jConsecutive = jConsecutive != 0;
+    grid->jPositive = jPositive != 0;
+    codes_get_double(h, "latitudeOfFirstGridPointInDegrees", &grid->lat1);
+    codes_get_double(h, "latitudeOfLastGridPointInDegrees", &grid->lat2);
+    codes_get_double(h, "longitudeOfFirstGridPointInDegrees", &grid->lon1);
+    codes_get_double(h, "longitudeOfLastGridPointInDegrees", &grid->lon2);
+    std::lock_guard<std::mutex> lock(g_GeometryMutex);
+    return g_GridRegistry.emplace(hash, std::move(grid)).first->second;
 }
 
-static bool SampleValueFromData(const GribMessage &gm, const std::vector<double> &data, double lat, double lon, double &outVal)
+static void ClearGridRegistry()
 {
-    double fi, fj;
-    int ii, jj;
-    if (!LatLonToGrid(gm, lat, lon, fi, fj, ii, jj))
-        return false;
-    size_t idx = (size_t)jj * (size_t)gm.Ni + (size_t)ii;
-    if (idx >= data.size())
-        return false;
-    outVal = data[idx];
-    return true;
+    std::lock_guard<std::mutex> lock(g_GeometryMutex);
+    g_GridRegistry.clear();
 }
 
-static bool LoadMessageData(GribMessage &gm, std::vector<double> &outData)
+// Display table of the message's grid, or null if it has not been built.
+static std::shared_ptr<const GridWarp> WarpOf(const GribMessage &gm)
 {
-    if (!gm.message)
-        gm.message = ReopenGribMessage(gm);
-    if (!gm.message)
-        return false;
-    double minVal, maxVal;
-    GetMessageValuesAndRange(gm.message, outData, minVal, maxVal);
-    return !outData.empty();
+    std::lock_guard<std::mutex> lock(g_GeometryMutex);
+    return gm.grid->warp;
 }
 
-static void ClearMarkerSeries()
+// Bytes held by the registry, and what the same data would take if every
+// message kept its own copy (definition plus display table).
+static void GridRegistryBytes(size_t &grids, size_t &users, uint64_t &shared, uint64_t &unshared)
 {
-    for (auto &m : g_Markers)
+    std::lock_guard<std::mutex> lock(g_GeometryMutex);
+    grids = g_GridRegistry.size();
+    users = 0;
+    shared = g_GridRegistry.bucket_count() * sizeof(void *);
+    unshared = 0;
+    for (const auto &kv : g_GridRegistry)
     {
-        m.series.clear();
-        m.status.clear();
+        const GridGeometry &grid = *kv.second;
+        uint64_t own = sizeof(GridGeometry) + grid.gridType.capacity();
+        if (grid.warp)
+            own += sizeof(GridWarp) + VectorBytes(grid.warp->pointOfPixel) + VectorBytes(grid.warp->rowStart) +
+                   VectorBytes(grid.warp->lineRows) + VectorBytes(grid.warp->lineWeight) + VectorBytes(grid.warp->rowLat) + grid.warp->error.capacity();
+        size_t n = (size_t)std::max(1L, kv.second.use_count() - 1); // messages; the registry holds one
+        users += n;
+        shared += sizeof(kv) + own;
+        unshared += own * n;
     }
-    g_PlotClickedIndex = -1;
 }
-
-static void StartMarkerExtraction()
+// Runs fn(first, last) over [0, count) split into one slice per core.
+template <typename Fn>
+static void ParallelSlices(size_t count, Fn fn)
 {
-    if (g_Markers.empty() || g_GribMessages.empty())
-        return;
-    ClearMarkerSeries();
-    g_PlotClickedIndex = -1;
-    g_ExtractionStatus = "Extracting...";
-    size_t startIdx = (g_SelectedMessageIndex >= 0 && g_SelectedMessageIndex < (int)g_GribMessages.size())
-                          ? (size_t)g_SelectedMessageIndex
-                          : 0;
-    g_ExtractionNextIndex = startIdx;
-    g_ExtractionRunning = true;
+    size_t threads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), std::max<size_t>(1, count));
+    size_t per = (count + threads - 1) / threads;
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < threads; t++)
+        pool.emplace_back([&fn, t, per, count]() { fn(std::min(count, t * per), std::min(count, (t + 1) * per)); });
+    fn(0, std::min(count, per));
+    for (std::thread &th : pool)
+        th.join();
 }
 
-static void StepMarkerExtraction()
+// Longitude extent of the points: the largest empty stretch of longitudes
+// is taken as outside the grid. If it is no wider than a few grid steps the
+// grid goes all the way round.
+static void WarpLongitudeExtent(const std::vector<double> &lons, long fast, double &west, double &span, bool &global)
 {
-    if (!g_ExtractionRunning)
-        return;
-    if (g_Markers.empty() || g_GribMessages.empty())
+    bool used[360] = {};
+    for (double lon : lons)
+        used[(int)std::floor(fmod(fmod(lon, 360.0) + 360.0, 360.0)) % 360] = true;
+    int bestLen = 0, bestEnd = 0, run = 0;
+    for (int k = 0; k < 720; k++)
     {
-        g_ExtractionRunning = false;
-        g_ExtractionStatus = "No markers or messages";
-        return;
+        run = used[k % 360] ? 0 : std::min(run + 1, 360);
+        if (run > bestLen)
+        {
+            bestLen = run;
+            bestEnd = (k + 1) % 360;
+        }
     }
-    if (g_ExtractionNextIndex >= g_GribMessages.size())
+    // Typical longitude step between neighbouring points, from a sample.
+    std::vector<double> steps;
+    size_t n = lons.size();
+    size_t stride = std::max<size_t>(1, n / 2048);
+    for (size_t p = 0; p + (size_t)fast < n; p += stride)
     {
-        g_ExtractionRunning = false;
-        g_ExtractionStatus = "Extraction done";
+        for (size_t q : {p + 1, p + (size_t)fast})
+        {
+            double d = fabs(lons[q] - lons[p]);
+            d = std::min(d, 360.0 - fmod(d, 360.0));
+            steps.push_back(d);
+        }
+    }
+    double typical = 1.0;
+    if (!steps.empty())
+    {
+        std::nth_element(steps.begin(), steps.begin() + steps.size() * 9 / 10, steps.end());
+        typical = steps[steps.size() * 9 / 10];
+    }
+    global = (double)bestLen <= std::max(2.0, 3.0 * typical);
+    if (global)
+    {
+        west = 0.0;
+        span = 360.0;
         return;
     }
-    size_t idx = g_ExtractionNextIndex++;
-    GribMessage &gm = g_GribMessages[idx];
-    std::vector<double> data;
-    bool hasData = LoadMessageData(gm, data);
-    for (auto &m : g_Markers)
+    double lo = 360.0, hi = 0.0;
+    for (double lon : lons)
     {
-        MarkerSample samp;
-        samp.messageKey = BuildMessageKey(gm);
-        samp.value = std::numeric_limits<double>::quiet_NaN();
-        if (hasData)
-        {
-            double v = 0.0;
-            if (SampleValueFromData(gm, data, m.lat, m.lon, v))
-                samp.value = v;
-        }
-        m.series.push_back(samp);
+        double u = fmod(fmod(lon - (double)bestEnd, 360.0) + 360.0, 360.0);
+        lo = std::min(lo, u);
+        hi = std::max(hi, u);
     }
-    std::vector<double>().swap(data);
-    ClearAllSelections();
-    gm.selected = true;
-    g_LastSelectionAnchor = (int)idx;
-    RefreshSelectionState(true, (int)idx);
-    g_ExtractionStatus = "Frame " + std::to_string(idx + 1) + "/" + std::to_string(g_GribMessages.size());
+    west = (double)bestEnd + lo;
+    if (west >= 180.0)
+        west -= 360.0;
+    span = hi - lo;
 }
 
-static bool SaveMarkersCsv()
+// Fills pointOfPixel for rows [rowBegin, rowEnd) of the raster from the
+// cells of the grid; px/py are the points in raster pixel coordinates.
+static void RasteriseGridCells(GridWarp &warp, const std::vector<float> &px, const std::vector<float> &py,
+                               long fast, long slow, long rowBegin, long rowEnd)
 {
-    if (g_Markers.empty() || g_GribMessages.empty())
-        return false;
-    FILE *f = fopen(g_MarkersCsvPath, "w");
-    if (!f)
-        return false;
-    fprintf(f, "markerID");
-    for (const auto &col : g_UiState.displayedKeys)
-        fprintf(f, ",%s", col.c_str());
-    fprintf(f, ",lat,lon,value\n");
-    for (size_t mi = 0; mi < g_Markers.size(); mi++)
+    const float w = (float)warp.width;
+    auto triangle = [&](const float *x, const float *y, const int32_t *id)
     {
-        const Marker &m = g_Markers[mi];
-        for (size_t row = 0; row < m.series.size(); row++)
+        float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+        if (fabsf(area) < 1e-9f)
+            return;
+        long y0 = std::max(rowBegin, (long)std::ceil(std::min({y[0], y[1], y[2]})));
+        long y1 = std::min(rowEnd - 1, (long)std::floor(std::max({y[0], y[1], y[2]})));
+        long x0 = std::max(0L, (long)std::ceil(std::min({x[0], x[1], x[2]})));
+        long x1 = std::min(warp.width - 1, (long)std::floor(std::max({x[0], x[1], x[2]})));
+        float inv = 1.0f / area;
+        for (long r = y0; r <= y1; r++)
         {
-            const MarkerSample &s = m.series[row];
-            GribMessage *gm = FindMessageByKey(s.messageKey);
-            fprintf(f, "%zu", mi + 1);
-            for (const auto &col : g_UiState.displayedKeys)
+            int32_t *row = warp.pointOfPixel.data() + (size_t)r * (size_t)warp.width;
+            for (long c = x0; c <= x1; c++)
             {
-                fprintf(f, ",");
-                if (gm)
+                float fx = (float)c, fy = (float)r;
+                float b0 = ((x[1] - fx) * (y[2] - fy) - (x[2] - fx) * (y[1] - fy)) * inv;
+                float b1 = ((x[2] - fx) * (y[0] - fy) - (x[0] - fx) * (y[2] - fy)) * inv;
+                float b2 = 1.0f - b0 - b1;
+                if (b0 < -1e-5f || b1 < -1e-5f || b2 < -1e-5f)
+                    continue;
+                row[c] = b0 >= b1 && b0 >= b2 ? id[0] : (b1 >= b2 ? id[1] : id[2]);
+            }
+        }
+    };
+    for (long j = 0; j + 1 < slow; j++)
+    {
+        for (long i = 0; i + 1 < fast; i++)
+        {
+            int32_t id[4] = {(int32_t)(j * fast + i), (int32_t)(j * fast + i + 1),
+                             (int32_t)((j + 1) * fast + i + 1), (int32_t)((j + 1) * fast + i)};
+            float x[4], y[4];
+            float ymin = py[id[0]], ymax = ymin;
+            for (int k = 0; k < 4; k++)
+            {
+                x[k] = px[id[k]];
+                y[k] = py[id[k]];
+                ymin = std::min(ymin, y[k]);
+                ymax = std::max(ymax, y[k]);
+            }
+            if (ymax < (float)rowBegin || ymin > (float)rowEnd)
+                continue;
+            float xmin = x[0], xmax = x[0];
+            if (warp.global)
+            {
+                // Keep the cell in one piece across the seam.
+                for (int k = 1; k < 4; k++)
                 {
-                    auto it = gm->keyValueMap.find(col);
-                    if (it != gm->keyValueMap.end())
-                        fprintf(f, "%s", it->second.c_str());
+                    if (x[k] - x[0] > 0.5f * w)
+                        x[k] -= w;
+                    else if (x[0] - x[k] > 0.5f * w)
+                        x[k] += w;
+                    xmin = std::min(xmin, x[k]);
+                    xmax = std::max(xmax, x[k]);
                 }
+                if (xmax - xmin > 0.5f * w)
+                    continue; // a cell around the pole
+            }
+            int shifts = warp.global ? 3 : 1;
+            for (int s = 0; s < shifts; s++)
+            {
+                float dx = s == 0 ? 0.0f : (s == 1 ? w : -w);
+                float sx[4] = {x[0] + dx, x[1] + dx, x[2] + dx, x[3] + dx};
+                float tx[3] = {sx[0], sx[2], sx[3]}, ty[3] = {y[0], y[2], y[3]};
+                int32_t tid[3] = {id[0], id[2], id[3]};
+                triangle(sx, y, id);
+                triangle(tx, ty, tid);
             }
-            fprintf(f, ",%.6f,%.6f", m.lat, m.lon);
-            if (std::isnan(s.value))
-                fprintf(f, ",");
-            else
-                fprintf(f, ",%.10g", s.value);
-            fprintf(f, "\n");
         }
     }
-    fclose(f);
-    return true;
 }
 
-static void CreateMarkerAt(double lat, double lon)
+// Builds the warp table of an Ni x Nj grid from its point coordinates.
+static void BuildWarpTable(codes_handle *h, const GridGeometry &grid, GridWarp &warp)
 {
-    Marker m;
-    m.id = (int)g_Markers.size() + 1;
-    m.lat = lat;
-    m.lon = lon;
-    g_Markers.push_back(m);
+    size_t n = (size_t)grid.Ni * (size_t)grid.Nj;
+    if (n > (size_t)std::numeric_limits<int32_t>::max())
+    {
+        warp.error = "grid too large to warp";
+        return;
+    }
+    std::vector<double> lats(n), lons(n);
+    ScopedMemCharge coords(kMemStaging, VectorBytes(lats) + VectorBytes(lons));
+    size_t latCount = n, lonCount = n;
+    if (codes_get_double_array(h, "latitudes", lats.data(), &latCount) != 0 ||
+        codes_get_double_array(h, "longitudes", lons.data(), &lonCount) != 0 || latCount != n || lonCount != n)
+    {
+        warp.error = "ecCodes cannot compute the coordinates of this " + grid.gridType + " grid";
+        return;
+    }
+    long fast = grid.jConsecutive ? grid.Nj : grid.Ni;
+    long slow = grid.jConsecutive ? grid.Ni : grid.Nj;
+    double south = 90.0, north = -90.0;
+    for (double lat : lats)
+    {
+        south = std::min(south, lat);
+        north = std::max(north, lat);
+    }
+    double span = 0.0;
+    WarpLongitudeExtent(lons, fast, warp.west, span, warp.global);
+    double latSpan = std::max(north - south, 1e-6), lonSpan = std::max(span, 1e-6);
+    double d = std::sqrt(latSpan * lonSpan / (double)(n * kWarpPixelsPerPoint));
+    d = std::max({d, latSpan / (double)(kWarpMaxSide - 1), lonSpan / (double)(kWarpMaxSide - 1)});
+    warp.north = north;
+    if (warp.global)
+    {
+        warp.width = std::max(2L, (long)std::lround(360.0 / d));
+        warp.step = 360.0 / (double)warp.width;
+    }
+    else
+    {
+        warp.step = d;
+        warp.width = (long)std::ceil(lonSpan / d) + 1;
+    }
+    warp.height = (long)std::ceil(latSpan / warp.step) + 1;
+    std::vector<float> px(n), py(n);
+    ScopedMemCharge pixels(kMemStaging, VectorBytes(px) + VectorBytes(py));
+    ParallelSlices(n, [&](size_t first, size_t last)
+    {
+        for (size_t p = first; p < last; p++)
+        {
+            double u = fmod(fmod(lons[p] - warp.west, 360.0) + 360.0, 360.0);
+            if (!warp.global && u > 180.0 + 0.5 * span)
+                u -= 360.0; // rounding put it just west of the first column
+            px[p] = (float)(u / warp.step);
+            py[p] = (float)((warp.north - lats[p]) / warp.step);
+        }
+    });
+    warp.pointOfPixel.assign((size_t)warp.width * (size_t)warp.height, -1);
+    // Threads own bands of raster rows, so no pixel is written by two of them.
+    ParallelSlices((size_t)warp.height, [&](size_t first, size_t last)
+    {
+        if (first < last)
+            RasteriseGridCells(warp, px, py, fast, slow, (long)first, (long)last);
+    });
+    // Points on the edge of the grid lie on the edge of its cells, so the
+    // pixels holding them may have their centres just outside. Grow the
+    // table by one pixel to keep them pickable.
+    std::vector<int32_t> inner = warp.pointOfPixel;
+    ScopedMemCharge copy(kMemStaging, VectorBytes(inner));
+    long w = warp.width, rows = warp.height;
+    ParallelSlices((size_t)rows, [&](size_t first, size_t last)
+    {
+        for (long r = (long)first; r < (long)last; r++)
+        {
+            for (long c = 0; c < w; c++)
+            {
+                int32_t &p = warp.pointOfPixel[(size_t)r * w + c];
+                if (p >= 0)
+                    continue;
+                if (c > 0 && inner[(size_t)r * w + c - 1] >= 0)
+                    p = inner[(size_t)r * w + c - 1];
+                else if (c + 1 < w && inner[(size_t)r * w + c + 1] >= 0)
+                    p = inner[(size_t)r * w + c + 1];
+                else if (r > 0 && inner[(size_t)(r - 1) * w + c] >= 0)
+                    p = inner[(size_t)(r - 1) * w + c];
+                else if (r + 1 < rows && inner[(size_t)(r + 1) * w + c] >= 0)
+                    p = inner[(size_t)(r + 1) * w + c];
+            }
+        }
+    });
+    warp.warped = true;
 }
 
-static void RenumberMarkers()
+// Row tables of a reduced grid. The raster has one column per point of the
+// longest row; each raster line records the two rows around its latitude,
+// so finding a point is a division and a few loads.
+static void BuildReducedRows(codes_handle *h, const GridGeometry &grid, GridWarp &warp)
 {
-    for (size_t i = 0; i < g_Markers.size(); ++i)
-        g_Markers[i].id = (int)i + 1;
+    size_t rows = 0;
+    if (codes_get_size(h, "pl", &rows) != 0 || rows < 2)
+    {
+        warp.error = grid.gridType + " grid without a pl array";
+        return;
+    }
+    std::vector<long> pl(rows);
+    if (codes_get_long_array(h, "pl", pl.data(), &rows) != 0 || rows < 2)
+    {
+        warp.error = "cannot read the pl array";
+        return;
+    }
+    warp.rowStart.resize(rows + 1);
+    uint64_t total = 0;
+    long widest = 1;
+    for (size_t r = 0; r < rows; r++)
+    {
+        warp.rowStart[r] = (uint32_t)std::min<uint64_t>(total, UINT32_MAX);
+        total += (uint64_t)std::max(0L, pl[r]);
+        widest = std::max(widest, pl[r]);
+    }
+    warp.rowStart[rows] = (uint32_t)std::min<uint64_t>(total, UINT32_MAX);
+    if (total != (uint64_t)grid.numberOfPoints || total > (uint64_t)std::numeric_limits<int32_t>::max())
+    {
+        warp.rowStart.clear();
+        warp.error = "sub-area " + grid.gridType + " grids are not supported";
+        return;
+    }
+    // Row latitudes in storage order: the Gaussian latitudes when ecCodes
+    // has them, otherwise evenly spaced between the first and last row.
+    std::vector<double> &rowLat = warp.rowLat;
+    rowLat.resize(rows);
+    size_t distinct = rows;
+    if (grid.gridType == "reduced_gg" &&
+        codes_get_double_array(h, "distinctLatitudes", rowLat.data(), &distinct) == 0 && distinct == rows)
+    {
+        std::sort(rowLat.begin(), rowLat.end(), std::greater<double>());
+        if (grid.jPositive)
+            std::reverse(rowLat.begin(), rowLat.end());
+    }
+    else
+    {
+        for (size_t r = 0; r < rows; r++)
+            rowLat[r] = grid.lat1 + (grid.lat2 - grid.lat1) * (double)r / (double)(rows - 1);
+    }
+    double span = grid.lon2 - grid.lon1;
+    if (span < 0.0)
+        span += 360.0;
+    warp.rowWest = grid.lon1;
+    warp.global = span + 360.0 / (double)widest >= 359.999;
+    warp.rowSpan = warp.global ? 360.0 : std::max(span, 1e-9);
+    warp.west = grid.lon1 >= 180.0 ? grid.lon1 - 360.0 : grid.lon1;
+    // Walk the rows north to south, whatever their storage order.
+    std::vector<int32_t> byLat(rows);
+    for (size_t r = 0; r < rows; r++)
+        byLat[r] = (int32_t)r;
+    std::stable_sort(byLat.begin(), byLat.end(), [&](int32_t a, int32_t b) { return rowLat[a] > rowLat[b]; });
+    warp.north = rowLat[byLat.front()];
+    double south = rowLat[byLat.back()];
+    if (warp.global)
+    {
+        warp.width = std::clamp(widest, 2L, kWarpMaxSide);
+        warp.step = 360.0 / (double)warp.width;
+    }
+    else
+    {
+        // A tall, narrow area coarsens the step so that every line fits,
+        // rather than losing its south end.
+        warp.step = std::max({warp.rowSpan / (double)std::max(1L, widest - 1),
+                              warp.rowSpan / (double)(kWarpMaxSide - 1),
+                              (warp.north - south) / (double)(kWarpMaxSide - 1)});
+        warp.width = (long)std::ceil(warp.rowSpan / warp.step - 1e-9) + 1;
+    }
+    warp.height = (long)std::ceil((warp.north - south) / warp.step - 1e-9) + 1;
+    warp.lineRows.resize((size_t)warp.height * 2);
+    warp.lineWeight.resize((size_t)warp.height);
+    size_t k = 0;
+    for (long y = 0; y < warp.height; y++)
+    {
+        double lat = warp.north - (double)y * warp.step;
+        while (k + 2 < rows && rowLat[byLat[k + 1]] >= lat)
+            k++;
+        double latN = rowLat[byLat[k]], latS = rowLat[byLat[k + 1]];
+        warp.lineRows[2 * y] = byLat[k];
+        warp.lineRows[2 * y + 1] = byLat[k + 1];
+        warp.lineWeight[y] = latN > latS ? (float)std::clamp((latN - lat) / (latN - latS), 0.0, 1.0) : 0.0f;
+    }
+    warp.warped = true;
 }
 
-static void RemoveMarkerAt(size_t idx)
+// Position of a longitude along row r of a reduced grid, in points from the
+// row's first; false if the row does not reach that far.
+static bool ReducedPosition(const GridWarp &warp, int32_t r, double lon, double &pos, long &count)
 {
-    if (idx >= g_Markers.size())
-        return;
-    g_Markers.erase(g_Markers.begin() + idx);
-    RenumberMarkers();
-    ClearMarkerSeries();
-    g_ExtractionRunning = false;
-    g_ExtractionStatus = "Marker removed; cleared series";
+    count = (long)(warp.rowStart[r + 1] - warp.rowStart[r]);
+    if (count <= 0)
+        return false;
+    double u = fmod(fmod(lon - warp.rowWest, 360.0) + 360.0, 360.0);
+    if (warp.global)
+    {
+        pos = u * (double)count / 360.0;
+        return true;
+    }
+    if (u > warp.rowSpan + 0.5 * (360.0 - warp.rowSpan))
+        u -= 360.0; // just west of the first point
+    pos = count > 1 ? u / warp.rowSpan * (double)(count - 1) : 0.0;
+    return pos > -0.5 && pos < (double)count - 0.5;
 }
 
-static void DrawMarkersPlot(const ImVec2 &size)
+// Nearest point of a reduced grid to a longitude on a raster line.
+static long ReducedPointAt(const GridWarp &warp, long line, double lon)
 {
-    if (g_Markers.empty())
+    int32_t r = warp.lineRows[2 * line + (warp.lineWeight[line] < 0.5f ? 0 : 1)];
+    double pos;
+    long count;
+    if (!ReducedPosition(warp, r, lon, pos, count))
+        return -1;
+    long i = std::lround(pos);
+    i = warp.global ? i % count : std::clamp(i, 0L, count - 1);
+    return (long)warp.rowStart[r] + i;
+}
+
+// Fills a raster line from row r of a reduced grid, nearest or linear along
+// the row. Columns are evenly spaced, so the row position is stepped rather
+// than recomputed from the longitude; NaN where the row does not reach.
+static void ReducedRowToLine(const GridWarp &warp, const std::vector<double> &data, int32_t r, bool linear, double *line)
+{
+    double pos;
+    long count;
+    if (!ReducedPosition(warp, r, warp.west, pos, count))
     {
-        ImGui::Text("No marker data");
+        std::fill(line, line + warp.width, std::numeric_limits<double>::quiet_NaN());
         return;
     }
-    struct SeriesExtrema
-    {
-        double minVal = std::numeric_limits<double>::infinity();
-        double maxVal = -std::numeric_limits<double>::infinity();
-        size_t minIdx = 0;
-        size_t maxIdx = 0;
-        bool hasValue = false;
-    };
-    std::vector<SeriesExtrema> extrema(g_Markers.size());
-    g_PlotClickRequest = -1;
-    float width = size.x;
-    float height = size.y;
-    ImDrawList *dl = ImGui::GetWindowDrawList();
-    ImVec2 origin = ImGui::GetCursorScreenPos();
-    ImVec2 plotMin = origin;
-    ImVec2 plotMax(origin.x + width, origin.y + height);
-    dl->AddRectFilled(plotMin, plotMax, IM_COL32(30, 30, 30, 255));
-    dl->AddRect(plotMin, plotMax, IM_COL32(80, 80, 80, 255));
-    size_t maxCount = 0;
-    double vMin = std::numeric_limits<double>::infinity();
-    double vMax = -std::numeric_limits<double>::infinity();
-    for (size_t mi = 0; mi < g_Markers.size(); ++mi)
+    double dpos = warp.global ? warp.step * (double)count / 360.0 : warp.step / warp.rowSpan * (double)(count - 1);
+    const double *row = data.data() + warp.rowStart[r];
+    for (long x = 0; x < warp.width; x++, pos += dpos)
     {
-        const auto &m = g_Markers[mi];
-        if (m.series.size() > maxCount)
-            maxCount = m.series.size();
-        for (size_t k = 0; k < m.series.size(); ++k)
+        if (warp.global && pos >= (double)count)
+            pos -= (double)count;
+        else if (!warp.global && pos >= (double)count - 0.5)
         {
-            const auto &s = m.series[k];
-            if (std::isnan(s.value))
-                continue;
-            vMin = std::min(vMin, s.value);
-            vMax = std::max(vMax, s.value);
-            SeriesExtrema &ex = extrema[mi];
-            ex.hasValue = true;
-            if (s.value < ex.minVal)
-            {
-                ex.minVal = s.value;
-                ex.minIdx = k;
-            }
-            if (s.value > ex.maxVal)
-            {
-                ex.maxVal = s.value;
-                ex.maxIdx = k;
-            }
+            line[x] = std::numeric_limits<double>::quiet_NaN();
+            continue;
+        }
+        if (!linear)
+        {
+            long i = std::lround(pos);
+            line[x] = row[i < count ? i : i - count];
+            continue;
         }
+        long i0 = std::max(0L, (long)pos), i1 = i0 + 1;
+        if (i1 >= count)
+            i1 = warp.global ? 0 : count - 1;
+        double w = pos - (double)i0, a = row[i0], b = row[i1];
+        line[x] = std::isnan(a) || std::isnan(b) ? (w < 0.5 ? a : b) : a + (b - a) * w;
     }
-    if (maxCount < 2)
-        maxCount = 2;
-    if (!std::isfinite(vMin) || !std::isfinite(vMax) || fabs(vMax - vMin) < 1e-12)
+}
+
+// Display table of the message's grid, built on first use by whichever
+// message needs it first. Never null; check its error.
+static std::shared_ptr<const GridWarp> AcquireGridWarp(GribMessage &gm)
+{
+    if (std::shared_ptr<const GridWarp> warp = WarpOf(gm))
+        return warp;
+    codes_handle *h = EnsureMessageHandle(gm);
+    if (!h)
     {
-        vMin = -1.0;
-        vMax = 1.0;
+        auto failed = std::make_shared<GridWarp>();
+        failed->error = "cannot reopen the message";
+        return failed;
     }
-    double pad = (vMax - vMin) * 0.05;
-    vMin -= pad;
-    vMax += pad;
-    auto toScreen = [&](size_t idx, double value) -> ImVec2 {
-        float t = (float)idx / (float)(maxCount - 1);
-        float x = plotMin.x + t * (width - 1.0f);
-        float factor = (float)((value - vMin) / (vMax - vMin));
-        float y = plotMax.y - factor * (height - 1.0f);
-        return ImVec2(x, y);
-    };
+    if (gm.grid->hash == 0)
+    {
+        gm.grid = InternGrid(h); // not scanned from a file
+        if (std::shared_ptr<const GridWarp> warp = WarpOf(gm))
+            return warp;
+    }
+    ScopedPerfTimer timer(kPerfWarp, gm.index);
+    const GridGeometry &grid = *gm.grid;
+    auto warp = std::make_shared<GridWarp>();
+    if (grid.gridType == "reduced_gg" || grid.gridType == "reduced_ll")
+        BuildReducedRows(h, grid, *warp);
+    else if (grid.Ni <= 1 || grid.Nj <= 1 || grid.Ni * grid.Nj != grid.numberOfPoints)
+        warp->error = grid.gridType + " grids are not supported";
+    else if (grid.gridType == "regular_ll" && !grid.iNegative && !grid.jConsecutive)
+    {
+        warp->width = grid.Ni;
+        warp->height = grid.Nj;
+    }
+    else
+        BuildWarpTable(h, grid, *warp);
+    std::lock_guard<std::mutex> lock(g_GeometryMutex);
+    if (!gm.grid->warp) // another thread may have finished first
+        gm.grid->warp = std::move(warp);
+    return gm.grid->warp;
+}
+
+// Raster position (texels, pixel centres at +0.5) of a lat/lon on a warped grid.
+static bool WarpLatLonToPixel(const GridWarp &warp, double lat, double lon, double &x, double &y)
+{
+    double u = fmod(fmod(lon - warp.west, 360.0) + 360.0, 360.0) / warp.step;
+    if (!warp.global && u > (double)warp.width - 0.5)
+        u -= 360.0 / warp.step; // just west of the first column
+    double v = (warp.north - lat) / warp.step;
+    if (u < -0.5 || v < -0.5 || u > (double)warp.width - 0.5 || v > (double)warp.height - 0.5)
+        return false;
+    x = u + 0.5;
+    y = v + 0.5;
+    return true;
+}
+
+// Grid point under a raster position, -1 outside the grid.
+static long WarpPointAt(const GridWarp &warp, double x, double y)
+{
+    long c = (long)std::floor(x), r = (long)std::floor(y);
+    if (warp.global)
+        c = ((c % warp.width) + warp.width) % warp.width;
+    if (c < 0 || r < 0 || c >= warp.width || r >= warp.height)
+        return -1;
+    if (!warp.rowStart.empty())
+        return ReducedPointAt(warp, r, warp.west + (x - 0.5) * warp.step);
+    return warp.pointOfPixel[(size_t)r * (size_t)warp.width + (size_t)c];
+}
+
+// Resamples decoded values onto the warp raster; pixels outside the grid
+// become NaN. Reduced grids are resampled a line at a time, nearest or
+// linear (along the two rows around the line, then between them).
+static void WarpToRaster(const GridWarp &warp, const std::vector<double> &data, std::vector<double> &out)
+{
+    if (!warp.rowStart.empty())
+    {
+        if (data.size() < warp.rowStart.back())
+        {
+            out.assign((size_t)warp.width * (size_t)warp.height, std::numeric_limits<double>::quiet_NaN());
+            return; // not this grid's values
+        }
+        out.resize((size_t)warp.width * (size_t)warp.height);
+        bool linear = g_LinearReduced;
+        ParallelSlices((size_t)warp.height, [&](size_t first, size_t last)
+        {
+            std::vector<double> south(linear ? (size_t)warp.width : 0);
+            for (size_t y = first; y < last; y++)
+            {
+                double *line = out.data() + y * (size_t)warp.width;
+                double w = warp.lineWeight[y];
+                if (!linear)
+                {
+                    ReducedRowToLine(warp, data, warp.lineRows[2 * y + (w < 0.5 ? 0 : 1)], false, line);
+                    continue;
+                }
+                ReducedRowToLine(warp, data, warp.lineRows[2 * y], true, line);
+                ReducedRowToLine(warp, data, warp.lineRows[2 * y + 1], true, south.data());
+                for (long x = 0; x < warp.width; x++)
+                {
+                    double a = line[x], b = south[x];
+                    line[x] = std::isnan(a) || std::isnan(b) ? (w < 0.5 ? a : b) : a + (b - a) * w;
+                }
+            }
+        });
+        return;
+    }
+    out.resize(warp.pointOfPixel.size());
+    ParallelSlices(out.size(), [&](size_t first, size_t last)
+    {
+        for (size_t k = first; k < last; k++)
+        {
+            int32_t p = warp.pointOfPixel[k];
+            out[k] = p >= 0 && (size_t)p < data.size() ? data[p] : std::numeric_limits<double>::quiet_NaN();
+        }
+    });
+}
+
+static bool LatLonToGrid(const GribMessage &gm, double lat, double lon, double &fi, double &fj, int &i, int &j)
+{
+    const GridGeometry &grid = *gm.grid;
+    if (grid.Ni <= 1 || grid.Nj <= 1)
+        return false;
+    double latRange = fabs(grid.lat1 - grid.lat2);
+    if (latRange < 1e-9)
+        return false;
+    double lonRange = grid.lon2 - grid.lon1;
+    if (lonRange < 0)
+        lonRange += 360.0;
+    if (lonRange <= 0)
+        lonRange = 360.0;
+    bool desc = (grid.lat1 > grid.lat2);
+    fj = desc ? (grid.lat1 - lat) / latRange : (lat - grid.lat1) / latRange;
+    fj = std::clamp(fj, 0.0, 1.0);
+    double dlon = lon - grid.lon1;
+    while (dlon < 0.0)
+        dlon += 360.0;
+    while (dlon > lonRange && lonRange < 360.0)
+        dlon -= 360.0;
+    fi = lonRange > 1e-9 ? (dlon / lonRange) : 0.0;
+    fi = std::clamp(fi, 0.0, 1.0);
+    i = (int)std::round(fi * (double)(grid.Ni - 1));
+    j = (int)std::round(fj * (double)(grid.Nj - 1));
+    if (i < 0)
+        i = 0;
+    if (j < 0)
+        j = 0;
+    if (i >= grid.Ni)
+        i = (int)grid.Ni - 1;
+    if (j >= grid.Nj)
+        j = (int)grid.Nj - 1;
+    return true;
+}
+
+static bool LatLonToScreen(const GribMessage &gm, double lat, double lon, float contentX, float contentY, ImVec2 &outPos)
+{
+    std::shared_ptr<const GridWarp> warp = WarpOf(gm);
+    if (warp && warp->warped)
+    {
+        double x, y;
+        if (!WarpLatLonToPixel(*warp, lat, lon, x, y))
+            return false;
+        outPos = ImVec2(contentX + g_OffsetX + (float)x * g_Zoom, contentY + g_OffsetY + (float)y * g_Zoom);
+        return true;
+    }
+    double fi, fj;
+    int ii, jj;
+    if (!LatLonToGrid(gm, lat, lon, fi, fj, ii, jj))
+        return false;
+    float px = contentX + g_OffsetX + (float)fi * (float)(gm.grid->Ni - 1) * g_Zoom;
+    float py = contentY + g_OffsetY + (float)fj * (float)(gm.grid->Nj - 1) * g_Zoom;
+    outPos = ImVec2(px, py);
+    return true;
+}
+
+static bool SampleValueFromData(const GribMessage &gm, const std::vector<double> &data, double lat, double lon, double &outVal)
+{
+    std::shared_ptr<const GridWarp> warp = WarpOf(gm);
+    if (warp && warp->warped)
+    {
+        double x, y;
+        long p = WarpLatLonToPixel(*warp, lat, lon, x, y) ? WarpPointAt(*warp, x, y) : -1;
+        if (p < 0 || (size_t)p >= data.size())
+            return false;
+        outVal = data[p];
+        return true;
+    }
+    double fi, fj;
+    int ii, jj;
+    if (!LatLonToGrid(gm, lat, lon, fi, fj, ii, jj))
+        return false;
+    size_t idx = (size_t)jj * (size_t)gm.grid->Ni + (size_t)ii;
+    if (idx >= data.size())
+        return false;
+    outVal = data[idx];
+    return true;
+}
+
+// ----------------------------------------------------------
+// Marker stencils
+// An interpolated marker value is a weighted sum of up to four grid points.
+// Points and weights depend only on the grid and the marker position, so
+// they are worked out once per grid; each message then costs four
+// multiply-adds.
+// ----------------------------------------------------------
+struct StencilCorner
+{
+    int32_t point;
+    double lat, lon;
+    double weight; // bilinear
+};
+
+static double GreatCircleKm(double lat1, double lon1, double lat2, double lon2)
+{
+    const double rad = 3.14159265358979323846 / 180.0;
+    double a = sin((lat2 - lat1) * rad * 0.5), b = sin((lon2 - lon1) * rad * 0.5);
+    double h = a * a + cos(lat1 * rad) * cos(lat2 * rad) * b * b;
+    return 2.0 * 6371.229 * asin(std::min(1.0, sqrt(h)));
+}
+
+// Weights 1/d^2, normalised; a point right under the marker takes it all.
+static void InverseDistanceWeights(SampleStencil &st, const double *km)
+{
+    for (int k = 0; k < st.count; k++)
+    {
+        if (km[k] < 1e-6)
+        {
+            st.point[0] = st.point[k];
+            st.weight[0] = 1.0;
+            st.count = 1;
+            return;
+        }
+    }
+    double sum = 0.0;
+    for (int k = 0; k < st.count; k++)
+    {
+        st.weight[k] = 1.0 / (km[k] * km[k]);
+        sum += st.weight[k];
+    }
+    for (int k = 0; k < st.count; k++)
+        st.weight[k] /= sum;
+}
+
+// The four points of a regular lat/lon grid around lat/lon.
+static int RegularCorners(const GridGeometry &grid, double lat, double lon, StencilCorner *c)
+{
+    if (grid.Ni <= 1 || grid.Nj <= 1 || grid.lat1 == grid.lat2)
+        return 0;
+    double span = grid.lon2 - grid.lon1;
+    if (span <= 0.0)
+        span += 360.0;
+    double lonStep = span / (double)(grid.Ni - 1);
+    double latStep = (grid.lat2 - grid.lat1) / (double)(grid.Nj - 1);
+    bool global = span + lonStep >= 359.999;
+    double u = fmod(fmod(lon - grid.lon1, 360.0) + 360.0, 360.0);
+    if (!global && u > span + 0.5 * (360.0 - span))
+        u -= 360.0; // just west of the first column
+    double x = global ? u / lonStep : std::clamp(u / lonStep, 0.0, (double)(grid.Ni - 1));
+    double y = std::clamp((lat - grid.lat1) / latStep, 0.0, (double)(grid.Nj - 1));
+    long i0 = std::min((long)x, global ? grid.Ni - 1 : grid.Ni - 2);
+    long j0 = std::min((long)y, grid.Nj - 2);
+    long i1 = global ? (i0 + 1) % grid.Ni : i0 + 1;
+    double wx = x - (double)i0, wy = y - (double)j0;
+    int n = 0;
+    for (int k = 0; k < 4; k++)
+    {
+        long i = (k & 1) ? i1 : i0, j = j0 + (k >> 1);
+        double w = ((k & 1) ? wx : 1.0 - wx) * ((k >> 1) ? wy : 1.0 - wy);
+        c[n++] = {(int32_t)(j * grid.Ni + i), grid.lat1 + (double)j * latStep, grid.lon1 + (double)i * lonStep, w};
+    }
+    return n;
+}
+
+// The two points on each of the two rows of a reduced grid around lat/lon.
+static int ReducedCorners(const GridWarp &warp, double lat, double lon, StencilCorner *c)
+{
+    const std::vector<double> &rowLat = warp.rowLat;
+    size_t rows = rowLat.size();
+    if (rows < 2)
+        return 0;
+    bool southward = rowLat.front() > rowLat.back();
+    size_t lo = 0, hi = rows; // first row at or past lat, in storage order
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        if (southward ? rowLat[mid] <= lat : rowLat[mid] >= lat)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    size_t r1 = std::clamp<size_t>(lo, 1, rows - 1), r0 = r1 - 1;
+    double wy = std::clamp((lat - rowLat[r0]) / (rowLat[r1] - rowLat[r0]), 0.0, 1.0);
+    int n = 0;
+    for (size_t r : {r0, r1})
+    {
+        double pos;
+        long count;
+        if (!ReducedPosition(warp, (int32_t)r, lon, pos, count))
+            continue;
+        double lonStep = warp.global ? 360.0 / (double)count : warp.rowSpan / (double)std::max(1L, count - 1);
+        long i0 = std::clamp((long)std::floor(pos), 0L, count - 1);
+        long i1 = warp.global ? (i0 + 1) % count : std::min(i0 + 1, count - 1);
+        double wx = std::clamp(pos - (double)i0, 0.0, 1.0);
+        double w = r == r0 ? 1.0 - wy : wy;
+        c[n++] = {(int32_t)(warp.rowStart[r] + i0), rowLat[r], warp.rowWest + (double)i0 * lonStep, w * (1.0 - wx)};
+        c[n++] = {(int32_t)(warp.rowStart[r] + i1), rowLat[r], warp.rowWest + (double)i1 * lonStep, w * wx};
+    }
+    return n;
+}
+
+// Projected grids have no rows and columns in lat/lon; ecCodes finds the
+// four nearest points instead. The nearest object keeps its grid tables,
+// so it is reused for as long as markers are sampled on the same grid.
+static codes_nearest *g_Nearest = nullptr;
+static std::shared_ptr<GridGeometry> g_NearestGrid;
+
+static void ReleaseNearest()
+{
+    if (g_Nearest)
+        codes_grib_nearest_delete(g_Nearest);
+    g_Nearest = nullptr;
+    g_NearestGrid.reset();
+}
+
+static bool NearestPointsStencil(GribMessage &gm, double lat, double lon, SampleStencil &st)
+{
+    codes_handle *h = EnsureMessageHandle(gm);
+    if (!h)
+        return false;
+    if (g_NearestGrid != gm.grid)
+    {
+        ReleaseNearest();
+        int err = 0;
+        g_Nearest = codes_grib_nearest_new(h, &err);
+        g_NearestGrid = g_Nearest ? gm.grid : nullptr;
+        if (!g_Nearest)
+            return false;
+    }
+    double lats[4], lons[4], values[4], km[4];
+    int index[4];
+    size_t len = 4;
+    if (codes_grib_nearest_find(g_Nearest, h, lat, lon, CODES_NEAREST_SAME_GRID, lats, lons, values, km, index, &len) != 0)
+        return false;
+    st.count = 0;
+    for (size_t k = 0; k < len && k < 4; k++)
+    {
+        if (index[k] < 0)
+            continue;
+        st.point[st.count] = index[k];
+        km[st.count++] = km[k];
+    }
+    InverseDistanceWeights(st, km);
+    return st.count > 0;
+}
+
+// Bilinear and inverse distance use the four points around the marker on
+// regular and reduced grids; on projected grids both weight the four
+// nearest points by inverse distance.
+static bool BuildSampleStencil(GribMessage &gm, int interp, double lat, double lon, SampleStencil &st)
+{
+    st = SampleStencil();
+    std::shared_ptr<const GridWarp> warp = AcquireGridWarp(gm);
+    if (!warp->error.empty())
+        return false;
+    StencilCorner c[4];
+    int n = 0;
+    if (!warp->warped)
+        n = RegularCorners(*gm.grid, lat, lon, c);
+    else if (!warp->rowStart.empty())
+        n = ReducedCorners(*warp, lat, lon, c);
+    else
+        return NearestPointsStencil(gm, lat, lon, st);
+    if (n == 0)
+        return false;
+    st.count = n;
+    double km[4], sum = 0.0;
+    for (int k = 0; k < n; k++)
+    {
+        st.point[k] = c[k].point;
+        st.weight[k] = c[k].weight;
+        sum += c[k].weight;
+        km[k] = GreatCircleKm(lat, lon, c[k].lat, c[k].lon);
+    }
+    if (interp == kInterpInverseDistance)
+        InverseDistanceWeights(st, km);
+    else if (sum > 0.0)
+    {
+        for (int k = 0; k < n; k++)
+            st.weight[k] /= sum;
+    }
+    return true;
+}
+
+// Weighted sum over the stencil; missing points give their share to the others.
+static bool ApplySampleStencil(const SampleStencil &st, const std::vector<double> &data, double &outVal)
+{
+    double sum = 0.0, weights = 0.0;
+    for (int k = 0; k < st.count; k++)
+    {
+        if ((size_t)st.point[k] >= data.size())
+            return false;
+        double v = data[st.point[k]];
+        if (std::isnan(v))
+            continue;
+        sum = std::fma(st.weight[k], v, sum);
+        weights += st.weight[k];
+    }
+    if (weights <= 0.0)
+        return false;
+    outVal = sum / weights;
+    return true;
+}
+
+// The marker's stencil on the message's grid, built on first use.
+static const SampleStencil &MarkerStencil(Marker &m, GribMessage &gm)
+{
+    auto it = std::find_if(m.stencils.begin(), m.stencils.end(),
+                           [&](const auto &entry) { return entry.first == gm.grid; });
+    if (it == m.stencils.end())
+    {
+        SampleStencil st;
+        BuildSampleStencil(gm, m.interp, m.lat, m.lon, st);
+        m.stencils.emplace_back(gm.grid, st);
+        it = m.stencils.end() - 1;
+    }
+    return it->second;
+}
+
+// A marker's value on a message, in the marker's interpolation mode.
+static bool SampleMarker(Marker &m, GribMessage &gm, const std::vector<double> &data, double &outVal)
+{
+    if (m.interp == kInterpNearest)
+        return SampleValueFromData(gm, data, m.lat, m.lon, outVal);
+    const SampleStencil &st = MarkerStencil(m, gm);
+    return st.count > 0 && ApplySampleStencil(st, data, outVal);
+}
+
+static bool LoadMessageData(GribMessage &gm, std::vector<double> &outData)
+{
+    EnsureMessageHandle(gm);
+    if (!gm.message)
+        return false;
+    AcquireGridWarp(gm); // for SampleValueFromData
+    double minVal, maxVal;
+    GetMessageValuesAndRange(gm.message, outData, minVal, maxVal);
+    return !outData.empty();
+}
+
+static void ClearMarkerSeries()
+{
+    for (auto &m : g_Markers)
+    {
+        m.series.clear();
+        m.status.clear();
+        m.stencils.clear();
+    }
+    g_PlotClickedIndex = -1;
+}
+
+static void StartMarkerExtraction()
+{
+    if (g_Markers.empty() || g_GribMessages.empty())
+        return;
+    ClearMarkerSeries();
+    g_PlotClickedIndex = -1;
+    g_ExtractionStatus = "Extracting...";
+    int startRow = RowOfMessage(g_SelectedMessageIndex);
+    g_ExtractionNextIndex = (startRow >= 0) ? (size_t)startRow : 0;
+    g_ExtractionRunning = true;
+}
+
+static void StepMarkerExtraction()
+{
+    if (!g_ExtractionRunning)
+        return;
+    if (g_Markers.empty() || g_GribMessages.empty())
+    {
+        g_ExtractionRunning = false;
+        g_ExtractionStatus = "No markers or messages";
+        return;
+    }
+    if (g_ExtractionNextIndex >= g_ViewRows.size())
+    {
+        g_ExtractionRunning = false;
+        g_ExtractionStatus = "Extraction done";
+        return;
+    }
+    size_t row = g_ExtractionNextIndex++;
+    int idx = g_ViewRows[row];
+    ScopedTrace trace("extract", "message", idx);
+    GribMessage &gm = g_GribMessages[idx];
+    std::vector<double> data;
+    bool hasData = LoadMessageData(gm, data);
+    ScopedMemCharge decoded(kMemDecoded, VectorBytes(data));
+    for (auto &m : g_Markers)
+    {
+        MarkerSample samp;
+        samp.messageIndex = idx;
+        samp.value = std::numeric_limits<double>::quiet_NaN();
+        if (hasData)
+        {
+            double v = 0.0;
+            if (SampleMarker(m, gm, data, v))
+                samp.value = v;
+        }
+        m.series.push_back(samp);
+    }
+    std::vector<double>().swap(data);
+    ClearAllSelections();
+    gm.selected = true;
+    g_LastSelectionAnchor = idx;
+    RefreshSelectionState(true, idx);
+    g_ExtractionStatus = "Frame " + std::to_string(row + 1) + "/" + std::to_string(g_ViewRows.size());
+}
+
+// Writes a free-text field, quoted (quotes doubled) when it holds a
+// separator or a quote, so SplitStationLine reads it back as one field.
+static void FprintCsvText(FILE *f, const std::string &text)
+{
+    if (text.find_first_of(",;\t\"\r\n") == std::string::npos)
+    {
+        fprintf(f, "%s", text.c_str());
+        return;
+    }
+    fputc('"', f);
+    for (char c : text)
+    {
+        if (c == '"')
+            fputc('"', f);
+        fputc(c == '\r' || c == '\n' ? ' ' : c, f);
+    }
+    fputc('"', f);
+}
+
+static bool SaveMarkersCsv()
+{
+    ScopedTrace trace("csv write", "io");
+    if (g_Markers.empty() || g_GribMessages.empty())
+        return false;
+    FILE *f = fopen(g_MarkersCsvPath, "w");
+    if (!f)
+        return false;
+    fprintf(f, "markerID");
+    for (const auto &col : g_UiState.displayedKeys)
+        fprintf(f, ",%s", col.c_str());
+    fprintf(f, ",lat,lon,value\n");
+    for (size_t mi = 0; mi < g_Markers.size(); mi++)
+    {
+        const Marker &m = g_Markers[mi];
+        for (size_t row = 0; row < m.series.size(); row++)
+        {
+            const MarkerSample &s = m.series[row];
+            GribMessage *gm = (s.messageIndex >= 0 && s.messageIndex < (int)g_GribMessages.size())
+                                  ? &g_GribMessages[s.messageIndex]
+                                  : nullptr;
+            if (m.name.empty())
+                fprintf(f, "%zu", mi + 1);
+            else
+                FprintCsvText(f, m.name);
+            for (const auto &col : g_UiState.displayedKeys)
+            {
+                fprintf(f, ",");
+                if (gm)
+                {
+                    auto it = gm->keyValueMap.find(col);
+                    if (it != gm->keyValueMap.end())
+                        fprintf(f, "%s", it->second.c_str());
+                }
+            }
+            fprintf(f, ",%.6f,%.6f", m.lat, m.lon);
+            if (std::isnan(s.value))
+                fprintf(f, ",");
+            else
+                fprintf(f, ",%.10g", s.value);
+            fprintf(f, "\n");
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+// ----------------------------------------------------------
+// Marker index
+// Markers are bucketed on a lat/lon grid sized to their number, a few per
+// cell on average, so picking and drawing visit the cells under the mouse
+// or the canvas rather than every marker. Any change marks it dirty; the
+// rebuild on next use is a counting sort.
+// ----------------------------------------------------------
+struct MarkerIndex
+{
+    double cell = 1.0; // degrees
+    int cols = 0, rows = 0;
+    std::vector<uint32_t> start; // first entry of each cell in 'items', then the total
+    std::vector<uint32_t> items; // marker indices, cell by cell
+    bool dirty = true;
+};
+
+static MarkerIndex g_MarkerIndex;
+static const size_t kMarkerLabelLimit = 500;             // more on screen are drawn as dots
+static std::vector<std::pair<int, ImVec2>> g_VisibleMarkers; // scratch for the canvas
+
+static int MarkerIndexCol(double lon)
+{
+    double u = fmod(fmod(lon, 360.0) + 360.0, 360.0);
+    return std::min((int)(u / g_MarkerIndex.cell), g_MarkerIndex.cols - 1);
+}
+
+static int MarkerIndexRow(double lat)
+{
+    return std::clamp((int)((90.0 - lat) / g_MarkerIndex.cell), 0, g_MarkerIndex.rows - 1);
+}
+
+static void RebuildMarkerIndex()
+{
+    MarkerIndex &ix = g_MarkerIndex;
+    ix.dirty = false;
+    size_t n = g_Markers.size();
+    ix.cell = std::clamp(sqrt(360.0 * 180.0 * 4.0 / (double)std::max<size_t>(n, 1)), 0.1, 30.0);
+    ix.cols = (int)std::ceil(360.0 / ix.cell);
+    ix.rows = (int)std::ceil(180.0 / ix.cell);
+    ix.start.assign((size_t)ix.cols * (size_t)ix.rows + 1, 0);
+    ix.items.resize(n);
+    std::vector<uint32_t> cellOf(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        cellOf[i] = (uint32_t)(MarkerIndexRow(g_Markers[i].lat) * ix.cols + MarkerIndexCol(g_Markers[i].lon));
+        ix.start[cellOf[i] + 1]++;
+    }
+    for (size_t c = 1; c < ix.start.size(); c++)
+        ix.start[c] += ix.start[c - 1];
+    std::vector<uint32_t> fill(ix.start.begin(), ix.start.end() - 1);
+    for (size_t i = 0; i < n; i++)
+        ix.items[fill[cellOf[i]]++] = (uint32_t)i;
+}
+
+// Calls fn(markerIndex) for the markers in the cells overlapping a lat/lon
+// box, a superset of those inside it. The box may cross the date line
+// (east past 360, or east < west); a span of 360 covers every longitude.
+template <typename Fn>
+static void ForEachMarkerNear(double south, double north, double west, double east, Fn &&fn)
+{
+    if (g_Markers.empty())
+        return;
+    if (g_MarkerIndex.dirty)
+        RebuildMarkerIndex();
+    const MarkerIndex &ix = g_MarkerIndex;
+    int r0 = MarkerIndexRow(north), r1 = MarkerIndexRow(south);
+    double span = east - west;
+    if (span < 0.0)
+        span += 360.0;
+    int c0 = MarkerIndexCol(west), c1 = MarkerIndexCol(west + span);
+    int cols = span >= 360.0 - ix.cell ? ix.cols : (c1 - c0 + ix.cols) % ix.cols + 1;
+    for (int r = r0; r <= r1; r++)
+    {
+        for (int k = 0; k < cols; k++)
+        {
+            size_t cell = (size_t)r * (size_t)ix.cols + (size_t)((c0 + k) % ix.cols);
+            for (uint32_t e = ix.start[cell]; e < ix.start[cell + 1]; e++)
+                fn((int)ix.items[e]);
+        }
+    }
+}
+
+static void CreateMarkerAt(double lat, double lon)
+{
+    Marker m;
+    m.id = (int)g_Markers.size() + 1;
+    m.lat = lat;
+    m.lon = lon;
+    g_Markers.push_back(m);
+    g_MarkerIndex.dirty = true;
+}
+
+static void RenumberMarkers()
+{
+    for (size_t i = 0; i < g_Markers.size(); ++i)
+        g_Markers[i].id = (int)i + 1;
+}
+
+static void RemoveMarkerAt(size_t idx)
+{
+    if (idx >= g_Markers.size())
+        return;
+    g_Markers.erase(g_Markers.begin() + idx);
+    g_MarkerIndex.dirty = true;
+    RenumberMarkers();
+    ClearMarkerSeries();
+    g_ExtractionRunning = false;
+    g_ExtractionStatus = "Marker removed; cleared series";
+}
+
+static const size_t kPlotMaxSeries = 32;
+
+static void DrawMarkersPlot(const ImVec2 &size)
+{
+    if (g_Markers.empty())
+    {
+        ImGui::Text("No marker data");
+        return;
+    }
+    struct SeriesExtrema
+    {
+        double minVal = std::numeric_limits<double>::infinity();
+        double maxVal = -std::numeric_limits<double>::infinity();
+        size_t minIdx = 0;
+        size_t maxIdx = 0;
+        bool hasValue = false;
+    };
+    // Past a few dozen series the plot is unreadable and slow; it shows
+    // the first ones, the CSV export has them all.
+    size_t plotted = std::min(g_Markers.size(), kPlotMaxSeries);
+    std::vector<SeriesExtrema> extrema(plotted);
+    g_PlotClickRequest = -1;
+    float width = size.x;
+    float height = size.y;
+    ImDrawList *dl = ImGui::GetWindowDrawList();
+    ImVec2 origin = ImGui::GetCursorScreenPos();
+    ImVec2 plotMin = origin;
+    ImVec2 plotMax(origin.x + width, origin.y + height);
+    dl->AddRectFilled(plotMin, plotMax, IM_COL32(30, 30, 30, 255));
+    dl->AddRect(plotMin, plotMax, IM_COL32(80, 80, 80, 255));
+    size_t maxCount = 0;
+    double vMin = std::numeric_limits<double>::infinity();
+    double vMax = -std::numeric_limits<double>::infinity();
+    for (size_t mi = 0; mi < plotted; ++mi)
+    {
+        const auto &m = g_Markers[mi];
+        if (m.series.size() > maxCount)
+            maxCount = m.series.size();
+        for (size_t k = 0; k < m.series.size(); ++k)
+        {
+            const auto &s = m.series[k];
+            if (std::isnan(s.value))
+                continue;
+            vMin = std::min(vMin, s.value);
+            vMax = std::max(vMax, s.value);
+            SeriesExtrema &ex = extrema[mi];
+            ex.hasValue = true;
+            if (s.value < ex.minVal)
+            {
+                ex.minVal = s.value;
+                ex.minIdx = k;
+            }
+            if (s.value > ex.maxVal)
+            {
+                ex.maxVal = s.value;
+                ex.maxIdx = k;
+            }
+        }
+    }
+    if (maxCount < 2)
+        maxCount = 2;
+    if (!std::isfinite(vMin) || !std::isfinite(vMax) || fabs(vMax - vMin) < 1e-12)
+    {
+        vMin = -1.0;
+        vMax = 1.0;
+    }
+    double pad = (vMax - vMin) * 0.05;
+    vMin -= pad;
+    vMax += pad;
+    auto toScreen = [&](size_t idx, double value) -> ImVec2 {
+        float t = (float)idx / (float)(maxCount - 1);
+        float x = plotMin.x + t * (width - 1.0f);
+        float factor = (float)((value - vMin) / (vMax - vMin));
+        float y = plotMax.y - factor * (height - 1.0f);
+        return ImVec2(x, y);
+    };
     // Axes and ticks
     dl->AddLine(ImVec2(plotMin.x, plotMax.y), ImVec2(plotMax.x, plotMax.y), IM_COL32(200, 200, 200, 255));
     dl->AddLine(ImVec2(plotMin.x, plotMin.y), ImVec2(plotMin.x, plotMax.y), IM_COL32(200, 200, 200, 255));
@@ -691,675 +2404,4853 @@ static void DrawMarkersPlot(const ImVec2 &size)
         dl->AddLine(ImVec2(plotMin.x, y), ImVec2(plotMax.x, y), col, major ? 1.5f : 1.0f);
         dl->AddText(ImVec2(plotMin.x + 4, y - 10), IM_COL32(230, 230, 230, 255), (std::to_string((float)value)).c_str());
     };
-    drawTick(vMax, true);
-    drawTick(vMin, true);
-    double mid = 0.5 * (vMin + vMax);
-    drawTick(mid, false);
-    if (vMin < 0.0 && vMax > 0.0)
-        drawTick(0.0, true);
-    // Data lines
-    for (size_t mi = 0; mi < g_Markers.size(); mi++)
+    drawTick(vMax, true);
+    drawTick(vMin, true);
+    double mid = 0.5 * (vMin + vMax);
+    drawTick(mid, false);
+    if (vMin < 0.0 && vMax > 0.0)
+        drawTick(0.0, true);
+    // Data lines
+    for (size_t mi = 0; mi < plotted; mi++)
+    {
+        const Marker &m = g_Markers[mi];
+        ImU32 col = MarkerColor((int)mi);
+        ImVec2 prev;
+        bool hasPrev = false;
+        for (size_t k = 0; k < m.series.size(); k++)
+        {
+            const MarkerSample &s = m.series[k];
+            if (std::isnan(s.value))
+            {
+                hasPrev = false;
+                continue;
+            }
+            ImVec2 p = toScreen(k, s.value);
+            if (hasPrev)
+                dl->AddLine(prev, p, col, 2.0f);
+            prev = p;
+            hasPrev = true;
+        }
+    }
+    // Draw extrema annotations near the right edge using the series color.
+    float textLineHeight = ImGui::GetTextLineHeight();
+    for (size_t mi = 0; mi < plotted; mi++)
+    {
+        const SeriesExtrema &ex = extrema[mi];
+        if (!ex.hasValue)
+            continue;
+        ImU32 col = MarkerColor((int)mi);
+        ImVec4 colVec = ImGui::ColorConvertU32ToFloat4(col);
+        char maxBuf[32];
+        char minBuf[32];
+        snprintf(maxBuf, sizeof(maxBuf), "max %.2f", ex.maxVal);
+        snprintf(minBuf, sizeof(minBuf), "min %.2f", ex.minVal);
+        ImVec2 maxPos = toScreen(ex.maxIdx, ex.maxVal);
+        ImVec2 minPos = toScreen(ex.minIdx, ex.minVal);
+        ImVec2 maxTextPos(plotMax.x - ImGui::CalcTextSize(maxBuf).x - 6.0f,
+                          std::clamp(maxPos.y - 10.0f, plotMin.y + 2.0f, plotMax.y - textLineHeight - 2.0f));
+        ImVec2 minTextPos(plotMax.x - ImGui::CalcTextSize(minBuf).x - 6.0f,
+                          std::clamp(minPos.y + 4.0f, plotMin.y + 2.0f, plotMax.y - textLineHeight - 2.0f));
+        // Avoid overlap between min/max labels for the same series.
+        if (fabs(maxTextPos.y - minTextPos.y) < textLineHeight + 2.0f)
+            minTextPos.y = std::min(plotMax.y - textLineHeight - 2.0f, maxTextPos.y + textLineHeight + 2.0f);
+        dl->AddText(maxTextPos, ImGui::ColorConvertFloat4ToU32(colVec), maxBuf);
+        dl->AddText(minTextPos, ImGui::ColorConvertFloat4ToU32(colVec), minBuf);
+    }
+    if (plotted < g_Markers.size())
+    {
+        char note[64];
+        snprintf(note, sizeof(note), "first %zu of %zu markers", plotted, g_Markers.size());
+        dl->AddText(ImVec2(plotMin.x + 4, plotMax.y - textLineHeight - 2.0f), IM_COL32(200, 200, 200, 255), note);
+    }
+    if (g_PlotClickedIndex >= 0 && maxCount > 1)
+    {
+        float t = (float)g_PlotClickedIndex / (float)(maxCount - 1);
+        float x = plotMin.x + t * (width - 1.0f);
+        dl->AddLine(ImVec2(x, plotMin.y), ImVec2(x, plotMax.y), IM_COL32(120, 220, 120, 200), 2.0f);
+    }
+    ImGui::Dummy(ImVec2(width, height));
+    if (ImGui::IsItemHovered() && ImGui::IsMouseClicked(ImGuiMouseButton_Left))
+    {
+        ImVec2 mp = ImGui::GetMousePos();
+        float relX = (mp.x - plotMin.x) / (width - 1.0f);
+        relX = std::clamp(relX, 0.0f, 1.0f);
+        size_t idx = (size_t)std::round(relX * (float)(maxCount - 1));
+        g_PlotClickedIndex = (int)idx;
+        for (const auto &m : g_Markers)
+        {
+            if (idx < m.series.size())
+            {
+                g_PlotClickRequest = m.series[idx].messageIndex;
+                break;
+            }
+        }
+    }
+}
+
+// ----------------------------------------------------------
+// Parse string to double (C++11 approach). Return true if ok.
+// ----------------------------------------------------------
+static bool parseDouble(const std::string &s, double &outValue)
+{
+    char *endPtr = nullptr;
+    const char *cstr = s.c_str();
+    outValue = strtod(cstr, &endPtr);
+    if (endPtr == cstr)
+        return false;
+    while (endPtr && *endPtr)
+    {
+        if (!isspace((unsigned char)*endPtr))
+            return false;
+        endPtr++;
+    }
+    return true;
+}
+
+// ----------------------------------------------------------
+// Marker import
+// A station list is one marker per line: a name (optional), latitude and
+// longitude, separated by commas, semicolons or tabs. A header naming the
+// columns (id/name/station, lat/latitude, lon/lng/longitude) picks them out
+// of wider files; without one the columns are name,lat,lon or lat,lon.
+// ----------------------------------------------------------
+static void SplitStationLine(const char *line, std::vector<std::string> &fields)
+{
+    fields.clear();
+    std::string field;
+    bool quoted = false;
+    for (const char *p = line; *p && *p != '\n' && *p != '\r'; p++)
+    {
+        if (*p == '"' && quoted && p[1] == '"')
+            field += *p++; // "" inside quotes is a literal quote
+        else if (*p == '"')
+            quoted = !quoted;
+        else if (!quoted && (*p == ',' || *p == ';' || *p == '\t'))
+        {
+            fields.push_back(field);
+            field.clear();
+        }
+        else
+            field += *p;
+    }
+    fields.push_back(field);
+    for (std::string &f : fields)
+    {
+        size_t a = f.find_first_not_of(" \t"), b = f.find_last_not_of(" \t");
+        f = a == std::string::npos ? std::string() : f.substr(a, b - a + 1);
+    }
+}
+
+// Appends the markers listed in 'path'; returns how many were added.
+static size_t ImportMarkersCsv(const char *path, std::string &status)
+{
+    ScopedTrace trace("csv read", "io");
+    std::ifstream in(path);
+    if (!in)
+    {
+        status = "Cannot open " + std::string(path);
+        return 0;
+    }
+    // Series extracted for the old marker list no longer line up with it.
+    ClearMarkerSeries();
+    g_ExtractionRunning = false;
+    int nameCol = -1, latCol = -1, lonCol = -1;
+    size_t added = 0, skipped = 0, lines = 0;
+    std::vector<std::string> fields;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        SplitStationLine(line.c_str(), fields);
+        if (fields.size() < 2)
+            continue;
+        if (lines++ == 0)
+        {
+            for (size_t c = 0; c < fields.size(); c++)
+            {
+                std::string key = fields[c];
+                std::transform(key.begin(), key.end(), key.begin(), [](unsigned char ch) { return (char)tolower(ch); });
+                if (key == "lat" || key == "latitude")
+                    latCol = (int)c;
+                else if (key == "lon" || key == "lng" || key == "long" || key == "longitude")
+                    lonCol = (int)c;
+                else if (nameCol < 0 && (key == "id" || key == "name" || key == "station"))
+                    nameCol = (int)c;
+            }
+            if (latCol >= 0 && lonCol >= 0)
+                continue;
+            bool named = fields.size() >= 3;
+            nameCol = named ? 0 : -1;
+            latCol = named ? 1 : 0;
+            lonCol = latCol + 1;
+        }
+        double lat = 0.0, lon = 0.0;
+        if ((int)fields.size() <= std::max(latCol, lonCol) || !parseDouble(fields[latCol], lat) ||
+            !parseDouble(fields[lonCol], lon) || lat < -90.0 || lat > 90.0 || !std::isfinite(lon))
+        {
+            skipped++;
+            continue;
+        }
+        Marker m;
+        m.id = (int)g_Markers.size() + 1;
+        m.lat = lat;
+        m.lon = fmod(fmod(lon, 360.0) + 360.0, 360.0);
+        if (nameCol >= 0 && nameCol < (int)fields.size())
+            m.name = fields[nameCol];
+        g_Markers.push_back(std::move(m));
+        added++;
+    }
+    g_MarkerIndex.dirty = true;
+    status = "Imported " + std::to_string(added) + " marker(s)";
+    if (skipped > 0)
+        status += ", skipped " + std::to_string(skipped) + " line(s)";
+    return added;
+}
+
+static void ClearMarkers()
+{
+    g_Markers.clear();
+    g_MarkerIndex.dirty = true;
+    g_DraggingMarkerIndex = -1;
+    g_ExtractionRunning = false;
+    g_PlotClickedIndex = -1;
+}
+
+// ----------------------------------------------------------
+// Sort the view by one key (stable, so successive sorts combine).
+// Values are parsed once per message; numbers sort before text.
+// ----------------------------------------------------------
+static void SortView(const std::string &key, bool ascending)
+{
+    static const std::string kEmpty;
+    size_t n = g_GribMessages.size();
+    std::vector<const std::string *> text(n, &kEmpty);
+    std::vector<double> num(n, 0.0);
+    std::vector<bool> isNum(n, false);
+    for (size_t i = 0; i < n; i++)
+    {
+        auto it = g_GribMessages[i].keyValueMap.find(key);
+        if (it != g_GribMessages[i].keyValueMap.end())
+            text[i] = &it->second;
+        double v = 0.0;
+        if (parseDouble(*text[i], v))
+        {
+            num[i] = v;
+            isNum[i] = true;
+        }
+    }
+    std::vector<int> order = g_View.order;
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b)
+                     {
+                         if (isNum[a] != isNum[b])
+                             return (bool)isNum[a];
+                         if (isNum[a])
+                             return ascending ? (num[a] < num[b]) : (num[a] > num[b]);
+                         return ascending ? (*text[a] < *text[b]) : (*text[a] > *text[b]);
+                     });
+    if (order == g_View.order)
+        return;
+    PushViewUndo();
+    g_View.order.swap(order);
+    RebuildViewRows();
+}
+
+// ----------------------------------------------------------
+// Metadata query language used by the table filter, e.g.
+//   shortName in (u,v) && level <= 500 && step % 6 == 0
+// The expression is compiled to a small node list and evaluated column by
+// column over every loaded message. Equality and "in" tests between a key
+// and literals are answered from a per-key value index instead of a scan.
+// Identifiers name a key when at least one message carries it, otherwise
+// they are taken as text (so `shortName == t` needs no quotes).
+// ----------------------------------------------------------
+struct QueryColumn
+{
+    std::vector<const std::string *> text; // nullptr when the key is missing
+    std::vector<double> num;               // NaN when missing or not numeric
+    size_t presentCount = 0;
+    bool indexed = false;
+    std::unordered_map<std::string, std::vector<int>> byText;
+    std::unordered_map<double, std::vector<int>> byNumber;
+};
+
+static std::map<std::string, QueryColumn> g_QueryColumns;
+static size_t g_QueryColumnsMessageCount = 0;
+static unsigned g_MetadataGeneration = 0; // bumped when keyValueMaps grow
+static unsigned g_QueryColumnsGeneration = 0;
+
+static QueryColumn &GetQueryColumn(const std::string &key)
+{
+    if (g_QueryColumnsMessageCount != g_GribMessages.size() ||
+        g_QueryColumnsGeneration != g_MetadataGeneration)
+    {
+        g_QueryColumns.clear();
+        g_QueryColumnsMessageCount = g_GribMessages.size();
+        g_QueryColumnsGeneration = g_MetadataGeneration;
+    }
+    auto found = g_QueryColumns.find(key);
+    if (found != g_QueryColumns.end())
+    {
+        g_Perf.queryHits++;
+        return found->second;
+    }
+    g_Perf.queryMisses++;
+    QueryColumn &col = g_QueryColumns[key];
+    size_t n = g_GribMessages.size();
+    col.text.assign(n, nullptr);
+    col.num.assign(n, std::numeric_limits<double>::quiet_NaN());
+    for (size_t i = 0; i < n; i++)
+    {
+        const auto &kv = g_GribMessages[i].keyValueMap;
+        auto it = kv.find(key);
+        if (it == kv.end())
+            continue;
+        col.text[i] = &it->second;
+        col.presentCount++;
+        double v = 0.0;
+        if (parseDouble(it->second, v))
+            col.num[i] = v;
+    }
+    return col;
+}
+
+static void EnsureQueryIndex(QueryColumn &col)
+{
+    if (col.indexed)
+        return;
+    for (size_t i = 0; i < col.text.size(); i++)
+    {
+        if (!col.text[i])
+            continue;
+        col.byText[*col.text[i]].push_back((int)i);
+        if (!std::isnan(col.num[i]))
+            col.byNumber[col.num[i]].push_back((int)i);
+    }
+    col.indexed = true;
+}
+
+enum class QueryOp
+{
+    Or, And, Not,
+    Eq, Ne, Lt, Le, Gt, Ge, In, NotIn,
+    Add, Sub, Mul, Div, Mod, Neg,
+    Key, Literal
+};
+
+struct QueryNode
+{
+    QueryOp op;
+    std::vector<int> args;   // child node indices
+    std::string text;        // key name or literal text
+    double num = std::numeric_limits<double>::quiet_NaN(); // literal as number
+    QueryColumn *column = nullptr;
+};
+
+struct CompiledQuery
+{
+    std::vector<QueryNode> nodes;
+    int root = -1;
+};
+
+static bool IsBoolOp(QueryOp op)
+{
+    return op <= QueryOp::NotIn;
+}
+
+class QueryParser
+{
+public:
+    QueryParser(const std::string &src, CompiledQuery &out) : m_Src(src), m_Out(out) {}
+
+    bool Parse(std::string &error)
+    {
+        Tokenize();
+        if (m_Error.empty())
+        {
+            int root = ParseOr();
+            if (m_Error.empty() && m_Pos < m_Tokens.size())
+                Fail("unexpected '" + m_Tokens[m_Pos].text + "'");
+            if (m_Error.empty() && !IsBoolOp(m_Out.nodes[root].op))
+                Fail("expression does not compare anything");
+            m_Out.root = root;
+        }
+        error = m_Error;
+        return m_Error.empty();
+    }
+
+private:
+    enum class Tok
+    {
+        Ident, Number, String, Op
+    };
+    struct Token
+    {
+        Tok kind;
+        std::string text;
+        size_t at;
+    };
+
+    const std::string &m_Src;
+    CompiledQuery &m_Out;
+    std::vector<Token> m_Tokens;
+    size_t m_Pos = 0;
+    std::string m_Error;
+
+    void Fail(const std::string &msg)
+    {
+        if (!m_Error.empty())
+            return;
+        size_t at = (m_Pos < m_Tokens.size()) ? m_Tokens[m_Pos].at : m_Src.size();
+        m_Error = msg + " (col " + std::to_string(at + 1) + ")";
+    }
+
+    void Tokenize()
+    {
+        static const char *ops[] = {"&&", "||", "==", "!=", "<=", ">=", "<", ">", "=", "!",
+                                    "(", ")", ",", "+", "-", "*", "/", "%"};
+        size_t i = 0;
+        while (i < m_Src.size())
+        {
+            char c = m_Src[i];
+            if (isspace((unsigned char)c))
+            {
+                i++;
+                continue;
+            }
+            size_t start = i;
+            if (isalnum((unsigned char)c) || c == '_' ||
+                (c == '.' && i + 1 < m_Src.size() && isdigit((unsigned char)m_Src[i + 1])))
+            {
+                // A word is a number only if strtod takes all of it (or more,
+                // for an exponent such as 1e-5); 2t and 10u stay words.
+                while (i < m_Src.size() && (isalnum((unsigned char)m_Src[i]) || m_Src[i] == '_' || m_Src[i] == '.'))
+                    i++;
+                char *end = nullptr;
+                strtod(m_Src.c_str() + start, &end);
+                size_t numberEnd = (size_t)(end - m_Src.c_str());
+                if (!isalpha((unsigned char)c) && c != '_' && numberEnd >= i)
+                {
+                    i = numberEnd;
+                    m_Tokens.push_back({Tok::Number, m_Src.substr(start, i - start), start});
+                }
+                else
+                    m_Tokens.push_back({Tok::Ident, m_Src.substr(start, i - start), start});
+            }
+            else if (c == '\'' || c == '"')
+            {
+                size_t close = m_Src.find(c, i + 1);
+                if (close == std::string::npos)
+                {
+                    m_Error = "unterminated string (col " + std::to_string(start + 1) + ")";
+                    return;
+                }
+                m_Tokens.push_back({Tok::String, m_Src.substr(i + 1, close - i - 1), start});
+                i = close + 1;
+            }
+            else
+            {
+                const char *match = nullptr;
+                for (const char *op : ops)
+                {
+                    if (m_Src.compare(i, strlen(op), op) == 0)
+                    {
+                        match = op;
+                        break;
+                    }
+                }
+                if (!match)
+                {
+                    m_Error = std::string("unexpected character '") + c + "' (col " + std::to_string(start + 1) + ")";
+                    return;
+                }
+                m_Tokens.push_back({Tok::Op, match, start});
+                i += strlen(match);
+            }
+        }
+    }
+
+    bool Peek(const char *text, size_t ahead = 0) const
+    {
+        size_t p = m_Pos + ahead;
+        if (p >= m_Tokens.size())
+            return false;
+        const Token &t = m_Tokens[p];
+        return (t.kind == Tok::Op || t.kind == Tok::Ident) && t.text == text;
+    }
+
+    bool Accept(const char *text)
+    {
+        if (!Peek(text))
+            return false;
+        m_Pos++;
+        return true;
+    }
+
+    void Expect(const char *text)
+    {
+        if (!Accept(text))
+            Fail(std::string("expected '") + text + "'");
+    }
+
+    int Add(QueryOp op, std::vector<int> args)
+    {
+        QueryNode node;
+        node.op = op;
+        node.args = std::move(args);
+        m_Out.nodes.push_back(std::move(node));
+        return (int)m_Out.nodes.size() - 1;
+    }
+
+    int AddLiteral(const std::string &text)
+    {
+        int id = Add(QueryOp::Literal, {});
+        m_Out.nodes[id].text = text;
+        double v = 0.0;
+        if (parseDouble(text, v))
+            m_Out.nodes[id].num = v;
+        return id;
+    }
+
+    int RequireBool(int id)
+    {
+        if (m_Error.empty() && !IsBoolOp(m_Out.nodes[id].op))
+            Fail("expected a comparison");
+        return id;
+    }
+
+    int RequireValue(int id)
+    {
+        if (m_Error.empty() && IsBoolOp(m_Out.nodes[id].op))
+            Fail("expected a value");
+        return id;
+    }
+
+    int ParseOr()
+    {
+        int left = ParseAnd();
+        while (m_Error.empty() && (Accept("||") || Accept("or")))
+        {
+            int right = ParseAnd();
+            left = Add(QueryOp::Or, {RequireBool(left), RequireBool(right)});
+        }
+        return left;
+    }
+
+    int ParseAnd()
+    {
+        int left = ParseNot();
+        while (m_Error.empty() && (Accept("&&") || Accept("and")))
+        {
+            int right = ParseNot();
+            left = Add(QueryOp::And, {RequireBool(left), RequireBool(right)});
+        }
+        return left;
+    }
+
+    int ParseNot()
+    {
+        if (Accept("!") || Accept("not"))
+            return Add(QueryOp::Not, {RequireBool(ParseNot())});
+        return ParseComparison();
+    }
+
+    int ParseComparison()
+    {
+        int left = ParseAdditive();
+        if (!m_Error.empty())
+            return left;
+        static const std::pair<const char *, QueryOp> cmps[] = {
+            {"==", QueryOp::Eq}, {"=", QueryOp::Eq}, {"!=", QueryOp::Ne}, {"<=", QueryOp::Le},
+            {">=", QueryOp::Ge}, {"<", QueryOp::Lt}, {">", QueryOp::Gt}};
+        for (const auto &c : cmps)
+        {
+            if (Accept(c.first))
+            {
+                int right = ParseAdditive();
+                return Add(c.second, {RequireValue(left), RequireValue(right)});
+            }
+        }
+        bool negated = Peek("not") && Peek("in", 1);
+        if (negated)
+            m_Pos++;
+        if (Accept("in"))
+        {
+            std::vector<int> args = {RequireValue(left)};
+            Expect("(");
+            while (m_Error.empty())
+            {
+                bool neg = Accept("-");
+                if (m_Pos >= m_Tokens.size() || m_Tokens[m_Pos].kind == Tok::Op)
+                {
+                    Fail("expected a list value");
+                    break;
+                }
+                const Token &t = m_Tokens[m_Pos++];
+                args.push_back(AddLiteral(neg ? "-" + t.text : t.text));
+                if (!Accept(","))
+                    break;
+            }
+            Expect(")");
+            return Add(negated ? QueryOp::NotIn : QueryOp::In, std::move(args));
+        }
+        return left;
+    }
+
+    int ParseAdditive()
+    {
+        int left = ParseMultiplicative();
+        while (m_Error.empty())
+        {
+            QueryOp op;
+            if (Accept("+"))
+                op = QueryOp::Add;
+            else if (Accept("-"))
+                op = QueryOp::Sub;
+            else
+                break;
+            int right = ParseMultiplicative();
+            left = Add(op, {RequireValue(left), RequireValue(right)});
+        }
+        return left;
+    }
+
+    int ParseMultiplicative()
+    {
+        int left = ParseUnary();
+        while (m_Error.empty())
+        {
+            QueryOp op;
+            if (Accept("*"))
+                op = QueryOp::Mul;
+            else if (Accept("/"))
+                op = QueryOp::Div;
+            else if (Accept("%"))
+                op = QueryOp::Mod;
+            else
+                break;
+            int right = ParseUnary();
+            left = Add(op, {RequireValue(left), RequireValue(right)});
+        }
+        return left;
+    }
+
+    int ParseUnary()
+    {
+        if (Accept("-"))
+            return Add(QueryOp::Neg, {RequireValue(ParseUnary())});
+        return ParsePrimary();
+    }
+
+    int ParsePrimary()
+    {
+        if (m_Pos >= m_Tokens.size())
+        {
+            Fail("unexpected end of expression");
+            return AddLiteral("");
+        }
+        if (Accept("("))
+        {
+            int inner = ParseOr();
+            Expect(")");
+            return inner;
+        }
+        const Token &t = m_Tokens[m_Pos];
+        if (t.kind == Tok::Op)
+        {
+            Fail("unexpected '" + t.text + "'");
+            return AddLiteral("");
+        }
+        m_Pos++;
+        if (t.kind == Tok::Ident)
+        {
+            QueryColumn &col = GetQueryColumn(t.text);
+            if (col.presentCount > 0)
+            {
+                int id = Add(QueryOp::Key, {});
+                m_Out.nodes[id].text = t.text;
+                m_Out.nodes[id].column = &col;
+                return id;
+            }
+        }
+        return AddLiteral(t.text);
+    }
+};
+
+static bool CompileQuery(const std::string &src, CompiledQuery &out, std::string &error)
+{
+    out = CompiledQuery();
+    QueryParser parser(src, out);
+    return parser.Parse(error);
+}
+
+// A value operand evaluated over all rows: either a literal, a key column
+// or the numeric result of arithmetic.
+struct QueryValues
+{
+    const QueryNode *literal = nullptr;
+    const QueryColumn *column = nullptr;
+    std::vector<double> computed;
+
+    double Num(size_t i) const
+    {
+        if (literal)
+            return literal->num;
+        if (column)
+            return column->num[i];
+        return computed[i];
+    }
+    const std::string *Text(size_t i) const
+    {
+        if (literal)
+            return &literal->text;
+        if (column)
+            return column->text[i];
+        return nullptr;
+    }
+};
+
+static QueryValues EvalQueryValues(const CompiledQuery &q, int id, size_t n);
+
+static std::vector<uint8_t> EvalQueryMask(const CompiledQuery &q, int id, size_t n)
+{
+    const QueryNode &node = q.nodes[id];
+    std::vector<uint8_t> mask;
+    switch (node.op)
+    {
+    case QueryOp::Or:
+    case QueryOp::And:
+    {
+        mask = EvalQueryMask(q, node.args[0], n);
+        std::vector<uint8_t> rhs = EvalQueryMask(q, node.args[1], n);
+        bool isAnd = (node.op == QueryOp::And);
+        for (size_t i = 0; i < n; i++)
+            mask[i] = isAnd ? (mask[i] & rhs[i]) : (mask[i] | rhs[i]);
+        return mask;
+    }
+    case QueryOp::Not:
+        mask = EvalQueryMask(q, node.args[0], n);
+        for (size_t i = 0; i < n; i++)
+            mask[i] ^= 1;
+        return mask;
+    case QueryOp::In:
+    case QueryOp::NotIn:
+    case QueryOp::Eq:
+    case QueryOp::Ne:
+    {
+        const QueryNode &lhs = q.nodes[node.args[0]];
+        bool inList = (node.op == QueryOp::In || node.op == QueryOp::NotIn);
+        std::vector<int> literals(node.args.begin() + 1, node.args.end());
+        bool allLiteral = true;
+        for (int lit : literals)
+            allLiteral = allLiteral && q.nodes[lit].op == QueryOp::Literal;
+        // key == literal, key in (literals...): answer from the value index.
+        if (lhs.op == QueryOp::Key && allLiteral)
+        {
+            QueryColumn &col = *lhs.column;
+            EnsureQueryIndex(col);
+            mask.assign(n, 0);
+            for (int lit : literals)
+            {
+                const QueryNode &l = q.nodes[lit];
+                const std::vector<int> *hits = nullptr;
+                if (!std::isnan(l.num))
+                {
+                    auto it = col.byNumber.find(l.num);
+                    hits = (it != col.byNumber.end()) ? &it->second : nullptr;
+                }
+                else
+                {
+                    auto it = col.byText.find(l.text);
+                    hits = (it != col.byText.end()) ? &it->second : nullptr;
+                }
+                if (hits)
+                {
+                    for (int row : *hits)
+                        mask[row] = 1;
+                }
+            }
+            if (node.op == QueryOp::Ne || node.op == QueryOp::NotIn)
+            {
+                for (size_t i = 0; i < n; i++)
+                    mask[i] ^= 1;
+            }
+            return mask;
+        }
+        if (inList)
+        {
+            // Non-key left-hand side: fold the list into ORed equalities.
+            QueryValues left = EvalQueryValues(q, node.args[0], n);
+            mask.assign(n, 0);
+            for (int lit : literals)
+            {
+                const QueryNode &l = q.nodes[lit];
+                for (size_t i = 0; i < n; i++)
+                {
+                    double a = left.Num(i);
+                    const std::string *ta = left.Text(i);
+                    if ((!std::isnan(a) && !std::isnan(l.num) && a == l.num) || (ta && *ta == l.text))
+                        mask[i] = 1;
+                }
+            }
+            if (node.op == QueryOp::NotIn)
+            {
+                for (size_t i = 0; i < n; i++)
+                    mask[i] ^= 1;
+            }
+            return mask;
+        }
+        [[fallthrough]];
+    }
+    case QueryOp::Lt:
+    case QueryOp::Le:
+    case QueryOp::Gt:
+    case QueryOp::Ge:
+    {
+        QueryValues a = EvalQueryValues(q, node.args[0], n);
+        QueryValues b = EvalQueryValues(q, node.args[1], n);
+        mask.assign(n, 0);
+        for (size_t i = 0; i < n; i++)
+        {
+            double na = a.Num(i);
+            double nb = b.Num(i);
+            int cmp = 0;
+            if (!std::isnan(na) && !std::isnan(nb))
+                cmp = (na < nb) ? -1 : (na > nb ? 1 : 0);
+            else
+            {
+                const std::string *ta = a.Text(i);
+                const std::string *tb = b.Text(i);
+                if (!ta || !tb)
+                {
+                    // Missing values only satisfy "!=".
+                    mask[i] = (node.op == QueryOp::Ne);
+                    continue;
+                }
+                cmp = ta->compare(*tb);
+            }
+            bool r = false;
+            switch (node.op)
+            {
+            case QueryOp::Eq: r = (cmp == 0); break;
+            case QueryOp::Ne: r = (cmp != 0); break;
+            case QueryOp::Lt: r = (cmp < 0); break;
+            case QueryOp::Le: r = (cmp <= 0); break;
+            case QueryOp::Gt: r = (cmp > 0); break;
+            default: r = (cmp >= 0); break;
+            }
+            mask[i] = r ? 1 : 0;
+        }
+        return mask;
+    }
+    default:
+        break;
+    }
+    return std::vector<uint8_t>(n, 0);
+}
+
+static QueryValues EvalQueryValues(const CompiledQuery &q, int id, size_t n)
+{
+    const QueryNode &node = q.nodes[id];
+    QueryValues out;
+    if (node.op == QueryOp::Literal)
+    {
+        out.literal = &node;
+        return out;
+    }
+    if (node.op == QueryOp::Key)
+    {
+        out.column = node.column;
+        return out;
+    }
+    QueryValues a = EvalQueryValues(q, node.args[0], n);
+    out.computed.resize(n);
+    if (node.op == QueryOp::Neg)
+    {
+        for (size_t i = 0; i < n; i++)
+            out.computed[i] = -a.Num(i);
+        return out;
+    }
+    QueryValues b = EvalQueryValues(q, node.args[1], n);
+    for (size_t i = 0; i < n; i++)
+    {
+        double x = a.Num(i);
+        double y = b.Num(i);
+        double r;
+        switch (node.op)
+        {
+        case QueryOp::Add: r = x + y; break;
+        case QueryOp::Sub: r = x - y; break;
+        case QueryOp::Mul: r = x * y; break;
+        case QueryOp::Div: r = (y != 0.0) ? x / y : std::numeric_limits<double>::quiet_NaN(); break;
+        default: r = (y != 0.0) ? std::fmod(x, y) : std::numeric_limits<double>::quiet_NaN(); break;
+        }
+        out.computed[i] = r;
+    }
+    return out;
+}
+
+// Evaluate a query over every loaded message. Returns false (and leaves
+// outMask untouched) when the expression does not compile.
+static bool EvaluateQuery(const std::string &src, std::vector<uint8_t> &outMask, std::string &error)
+{
+    CompiledQuery q;
+    if (!CompileQuery(src, q, error))
+        return false;
+    outMask = EvalQueryMask(q, q.root, g_GribMessages.size());
+    return true;
+}
+
+// Re-evaluate the table filter against the loaded messages. An invalid
+// expression keeps the previous filter and reports the error instead.
+static void ApplyTableFilter()
+{
+    ScopedTrace trace("filter", "ui");
+    g_FilterError.clear();
+    std::string text = g_FilterText;
+    if (text.find_first_not_of(" \t") == std::string::npos)
+        g_FilterMask.clear();
+    else
+    {
+        std::vector<uint8_t> mask;
+        if (EvaluateQuery(text, mask, g_FilterError))
+            g_FilterMask.swap(mask);
+    }
+    RebuildViewRows();
+}
+
+// ----------------------------------------------------------
+// On-demand retrieval of all keys for “More Info”
+// (skips large arrays like "values", "bitmap")
+// ----------------------------------------------------------
+static void PopulateAllKeys(GribMessage &gm)
+{
+    if (!gm.message || gm.fullyPopulated)
+        return;
+    codes_keys_iterator *it =
+        codes_keys_iterator_new(gm.message, GRIB_KEYS_ITERATOR_ALL_KEYS, NULL);
+    while (codes_keys_iterator_next(it))
+    {
+        const char *keyName = codes_keys_iterator_get_name(it);
+        if (!keyName)
+            continue;
+        if (!strcmp(keyName, "values") || !strcmp(keyName, "bitmap"))
+            continue;
+        if (gm.keyValueMap.find(keyName) == gm.keyValueMap.end())
+        {
+            char buf[1024];
+            size_t bufLen = sizeof(buf);
+            if (codes_get_string(gm.message, keyName, buf, &bufLen) == 0)
+            {
+                gm.keyValueMap[keyName] = buf;
+                g_MetadataGeneration++;
+            }
+        }
+    }
+    codes_keys_iterator_delete(it);
+    gm.fullyPopulated = true;
+}
+
+// ----------------------------------------------------------
+// Unpack float data. Also compute min/max.
+// ----------------------------------------------------------
+static void GetMessageValuesAndRange(codes_handle *h,
+                                     std::vector<double> &outValues,
+                                     double &outMinVal,
+                                     double &outMaxVal)
+{
+    outMinVal = std::numeric_limits<double>::infinity();
+    outMaxVal = -std::numeric_limits<double>::infinity();
+    size_t nvals = 0;
+    if (codes_get_size(h, "values", &nvals) != 0 || nvals == 0)
+    {
+        outValues.clear();
+        outMinVal = 0;
+        outMaxVal = 0;
+        return;
+    }
+    outValues.resize(nvals);
+    {
+        ScopedPerfTimer timer(kPerfDecode);
+        codes_get_double_array(h, "values", outValues.data(), &nvals);
+    }
+    ScopedPerfTimer timer(kPerfMinMax);
+    for (size_t i = 0; i < nvals; i++)
+    {
+        double v = outValues[i];
+        if (fabs(v - 9999.0) < 1e-8)
+            v = std::numeric_limits<double>::quiet_NaN();
+        outValues[i] = v;
+        if (!std::isnan(v))
+        {
+            if (v < outMinVal)
+                outMinVal = v;
+            if (v > outMaxVal)
+                outMaxVal = v;
+        }
+    }
+    if (outMinVal == std::numeric_limits<double>::infinity())
+        outMinVal = 0;
+    if (outMaxVal == -std::numeric_limits<double>::infinity())
+        outMaxVal = 0;
+}
+
+// ----------------------------------------------------------
+// Checkpoint indexes of the compressed files that are loaded, by path.
+// For their messages fileOffset is an offset in the uncompressed data.
+// ----------------------------------------------------------
+static std::mutex g_CompressedMutex;
+static std::map<std::string, std::shared_ptr<CompressedGribIndex>> g_CompressedIndexes;
+
+static std::shared_ptr<CompressedGribIndex> FindCompressedIndex(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(g_CompressedMutex);
+    auto it = g_CompressedIndexes.find(path);
+    return it == g_CompressedIndexes.end() ? nullptr : it->second;
+}
+
+// ----------------------------------------------------------
+// Reopen a GRIB message from file (if needed).
+// ----------------------------------------------------------
+static codes_handle *ReopenGribMessage(GribMessage &gm)
+{
+    ScopedPerfTimer timer(kPerfReopen, gm.index);
+    if (std::shared_ptr<CompressedGribIndex> packed = FindCompressedIndex(gm.filePath))
+    {
+        std::vector<unsigned char> bytes(gm.messageSize);
+        std::string error;
+        if (bytes.empty() || !packed->ReadAt((uint64_t)gm.fileOffset, bytes.data(), bytes.size(), error))
+            return nullptr;
+        return codes_handle_new_from_message_copy(nullptr, bytes.data(), bytes.size());
+    }
+    FILE *f = fopen(gm.filePath.c_str(), "rb");
+    if (!f)
+        return nullptr;
+    if (fseek(f, gm.fileOffset, SEEK_SET) != 0)
+    {
+        fclose(f);
+        return nullptr;
+    }
+    int err = 0;
+    codes_handle *h = codes_handle_new_from_file(nullptr, f, PRODUCT_GRIB, &err);
+    fclose(f);
+    return h;
+}
+
+// Opens the message handle on demand, counting cache hits for the HUD.
+static codes_handle *EnsureMessageHandle(GribMessage &gm)
+{
+    if (gm.stale)
+        return nullptr; // its offset points into the file's new content
+    if (gm.message)
+        g_Perf.handleHits++;
+    else
+    {
+        g_Perf.handleMisses++;
+        gm.message = ReopenGribMessage(gm);
+    }
+    return gm.message;
+}
+
+// ----------------------------------------------------------
+// Map values to RGBA through a colormap; NaN becomes transparent.
+// ----------------------------------------------------------
+static void ColormapToRGBA(const std::vector<double> &data, int width, int height,
+                           double userMin, double userMax,
+                           const ColorEntry *colorMap, int mapSize,
+                           std::vector<unsigned char> &imageRGBA)
+{
+    double range = userMax - userMin;
+    imageRGBA.assign((size_t)width * (size_t)height * 4, 0);
+    for (int j = 0; j < height; j++)
+    {
+        for (int i = 0; i < width; i++)
+        {
+            int idx = j * width + i;
+            double val = data[idx];
+            int rgbaI = 4 * idx;
+            if (std::isnan(val))
+            {
+                imageRGBA[rgbaI + 0] = 0;
+                imageRGBA[rgbaI + 1] = 0;
+                imageRGBA[rgbaI + 2] = 0;
+                imageRGBA[rgbaI + 3] = 0;
+            }
+            else
+            {
+                double clamped = val;
+                if (clamped < userMin)
+                    clamped = userMin;
+                if (clamped > userMax)
+                    clamped = userMax;
+                double t = (range > 1e-14) ? (clamped - userMin) / range : 0.0;
+                if (t < 0.0)
+                    t = 0.0;
+                if (t > 1.0)
+                    t = 1.0;
+                int cIdx = (int)(t * (mapSize - 1));
+                if (cIdx < 0)
+                    cIdx = 0;
+                if (cIdx >= mapSize)
+                    cIdx = mapSize - 1;
+                const ColorEntry &c = colorMap[cIdx];
+                imageRGBA[rgbaI + 0] = c[0];
+                imageRGBA[rgbaI + 1] = c[1];
+                imageRGBA[rgbaI + 2] = c[2];
+                imageRGBA[rgbaI + 3] = 255;
+            }
+        }
+    }
+}
+
+// ----------------------------------------------------------
+// Decoded values laid out as the canvas shows them: the grid itself, or
+// its warp raster (see GridGeometry). False if the grid cannot be shown.
+// ----------------------------------------------------------
+static bool ValuesToDisplayRaster(GribMessage &gm, std::vector<double> &data, int &width, int &height)
+{
+    std::shared_ptr<const GridWarp> warp = AcquireGridWarp(gm);
+    if (!warp->error.empty())
+        return false;
+    width = (int)warp->width;
+    height = (int)warp->height;
+    if (warp->warped)
+    {
+        ScopedPerfTimer timer(kPerfWarp, gm.index);
+        std::vector<double> raster;
+        WarpToRaster(*warp, data, raster);
+        data.swap(raster);
+    }
+    return width > 0 && height > 0 && data.size() == (size_t)width * (size_t)height;
+}
+
+// ----------------------------------------------------------
+// Generate the display texture for the currently active message.
+// Before using the message handle, re-open it if needed.
+// ----------------------------------------------------------
+static void GenerateTextureForSelectedMessage()
+{
+    ScopedTrace trace("show message", "ui", g_SelectedMessageIndex);
+    ResetPerfStages();
+    DestroyTexture(g_TextureID);
+    if (g_SelectedMessageIndex < 0 || g_SelectedMessageIndex >= (int)g_GribMessages.size())
+        return;
+    GribMessage &gm = g_GribMessages[g_SelectedMessageIndex];
+    EnsureMessageHandle(gm);
+    if (!gm.message)
+        return;
+    std::vector<double> data;
+    double minVal, maxVal;
+    GetMessageValuesAndRange(gm.message, data, minVal, maxVal);
+    ScopedMemCharge decoded(kMemDecoded, VectorBytes(data));
+    gm.minVal = minVal;
+    gm.maxVal = maxVal;
+    int width = 0, height = 0;
+    if (data.empty() || !ValuesToDisplayRaster(gm, data, width, height))
+        return;
+    decoded.Set(VectorBytes(data));
+    if (g_AutoFit)
+    {
+        g_UserMinVal = (float)minVal;
+        g_UserMaxVal = (float)maxVal;
+    }
+    g_TexWidth = width;
+    g_TexHeight = height;
+    auto it = colormapMap.find(g_ChosenColormapName);
+    const ColorEntry *colorMap = (it != colormapMap.end()) ? it->second : greyColormap;
+    int mapSize = colormapSize;
+    std::vector<unsigned char> imageRGBA;
+    {
+        ScopedPerfTimer timer(kPerfColormap);
+        ColormapToRGBA(data, width, height, g_UserMinVal, g_UserMaxVal, colorMap, mapSize, imageRGBA);
+    }
+    ScopedMemCharge staging(kMemStaging, VectorBytes(imageRGBA));
+    g_TextureID = CreateTextureFromData(imageRGBA.data(), width, height);
+}
+
+// ----------------------------------------------------------
+// Selection helpers
+// ----------------------------------------------------------
+static void ClearAllSelections()
+{
+    for (auto &msg : g_GribMessages)
+        msg.selected = false;
+}
+
+// Select every row between two messages (message indices, in view order).
+static void SelectRangeInclusive(int anchorIndex, int targetIndex)
+{
+    int endRow = RowOfMessage(targetIndex);
+    if (endRow < 0)
+        return;
+    int startRow = RowOfMessage(anchorIndex);
+    if (startRow < 0)
+        startRow = endRow;
+    if (startRow > endRow)
+        std::swap(startRow, endRow);
+    ClearAllSelections();
+    for (int r = startRow; r <= endRow; ++r)
+        g_GribMessages[g_ViewRows[r]].selected = true;
+}
+
+static void RefreshSelectionState(bool requestScroll, int preferredIndex = -1)
+{
+    int activeIndex = -1;
+    if (preferredIndex >= 0 &&
+        preferredIndex < (int)g_GribMessages.size() &&
+        g_GribMessages[preferredIndex].selected)
+    {
+        activeIndex = preferredIndex;
+    }
+    else
+    {
+        for (int idx : g_ViewRows)
+        {
+            if (g_GribMessages[idx].selected)
+            {
+                activeIndex = idx;
+                break;
+            }
+        }
+    }
+    g_SelectedMessageIndex = activeIndex;
+    if (g_SelectedMessageIndex >= 0)
+    {
+        if (requestScroll)
+            g_ScrollPendingIndex = g_SelectedMessageIndex;
+        GenerateTextureForSelectedMessage();
+    }
+    else
+    {
+        DestroyTexture(g_TextureID);
+    }
+}
+
+// ----------------------------------------------------------
+// Hypercube index
+// Every message gets a coordinate along parameter, level type, level,
+// step, validity time and ensemble member. Cells are keyed by a mixed-radix
+// integer, so moving one step along any dimension is a hash lookup.
+// Step and validity usually move together (validity = run + step), so two
+// extra maps leave one of them out: moving along step keeps the run and
+// lets validity follow, and vice versa.
+// ----------------------------------------------------------
+enum HypercubeDim
+{
+    kDimParameter,
+    kDimLevelType,
+    kDimLevel,
+    kDimStep,
+    kDimValidity,
+    kDimMember,
+    kHypercubeDims
+};
+static const char *kHypercubeDimNames[kHypercubeDims] = {"shortName", "typeOfLevel", "level", "step", "validity", "number"};
+
+struct HypercubeIndex
+{
+    std::vector<std::string> values[kHypercubeDims]; // sorted distinct labels per dimension
+    uint64_t stride[kHypercubeDims] = {};
+    std::vector<uint32_t> coords;                    // message index * kHypercubeDims + dim
+    std::unordered_map<uint64_t, int> cells;         // cell key -> first message in that cell
+    std::unordered_map<uint64_t, int> cellsNoStep;   // same, ignoring the step coordinate
+    std::unordered_map<uint64_t, int> cellsNoValidity;
+    // Per map above: message index -> next message in the same cell, -1 at
+    // the end, so a lookup can pass over messages hidden in the table.
+    std::vector<int> nextInCell, nextNoStep, nextNoValidity;
+    size_t duplicates = 0;
+    bool valid = false;
+
+    // Key of the message's cell; ignoreDim's coordinate is left out.
+    uint64_t CellKey(int msgIndex, int ignoreDim = -1) const
+    {
+        uint64_t key = 0;
+        for (int d = 0; d < kHypercubeDims; d++)
+        {
+            if (d != ignoreDim)
+                key += (uint64_t)coords[(size_t)msgIndex * kHypercubeDims + d] * stride[d];
+        }
+        return key;
+    }
+    uint32_t Coord(int msgIndex, int dim) const
+    {
+        return coords[(size_t)msgIndex * kHypercubeDims + dim];
+    }
+};
+
+static HypercubeIndex g_Hypercube;
+static bool g_ShowHypercube = false;
+static int g_PivotRowDim = kDimLevel;
+static int g_PivotColDim = kDimStep;
+
+static std::string HypercubeLabel(const GribMessage &gm, int dim)
+{
+    auto get = [&](const char *key) -> std::string
+    {
+        auto it = gm.keyValueMap.find(key);
+        return (it != gm.keyValueMap.end()) ? it->second : std::string();
+    };
+    if (dim == kDimValidity)
+    {
+        std::string date = get("validityDate");
+        std::string time = get("validityTime");
+        if (date.empty())
+            return std::string();
+        // Zero-pad HHMM so that the labels sort chronologically as text.
+        if (time.size() < 4)
+            time.insert(0, 4 - time.size(), '0');
+        return date + " " + time;
+    }
+    return get(kHypercubeDimNames[dim]);
+}
+
+static void RebuildHypercube()
+{
+    HypercubeIndex hc;
+    size_t n = g_GribMessages.size();
+    hc.coords.resize(n * kHypercubeDims);
+    uint64_t cellCount = 1;
+    bool fits = true;
+    for (int d = kHypercubeDims - 1; d >= 0; d--)
+    {
+        std::vector<std::string> labels(n);
+        for (size_t i = 0; i < n; i++)
+            labels[i] = HypercubeLabel(g_GribMessages[i], d);
+        std::vector<std::string> &values = hc.values[d];
+        values = labels;
+        std::sort(values.begin(), values.end());
+        values.erase(std::unique(values.begin(), values.end()), values.end());
+        bool numeric = true;
+        std::unordered_map<std::string, double> asNumber;
+        for (const auto &v : values)
+        {
+            double x = 0.0;
+            if (!parseDouble(v, x))
+            {
+                numeric = false;
+                break;
+            }
+            asNumber[v] = x;
+        }
+        if (numeric)
+        {
+            std::sort(values.begin(), values.end(), [&](const std::string &a, const std::string &b)
+                      { return asNumber[a] < asNumber[b]; });
+        }
+        std::unordered_map<std::string, uint32_t> position;
+        for (size_t k = 0; k < values.size(); k++)
+            position[values[k]] = (uint32_t)k;
+        for (size_t i = 0; i < n; i++)
+            hc.coords[i * kHypercubeDims + d] = position[labels[i]];
+        hc.stride[d] = cellCount;
+        uint64_t size = std::max<uint64_t>(1, values.size());
+        if (cellCount > std::numeric_limits<uint64_t>::max() / size)
+            fits = false;
+        else
+            cellCount *= size;
+    }
+    if (fits)
+    {
+        hc.cells.reserve(n);
+        hc.nextInCell.assign(n, -1);
+        hc.nextNoStep.assign(n, -1);
+        hc.nextNoValidity.assign(n, -1);
+        // Walk backwards and push each message on the front of its cell's
+        // chain, so chains run in load order and the map holds the first.
+        auto link = [](std::unordered_map<uint64_t, int> &cells, std::vector<int> &next, uint64_t key, int msg)
+        {
+            auto ins = cells.emplace(key, msg);
+            if (ins.second)
+                return false;
+            next[msg] = ins.first->second;
+            ins.first->second = msg;
+            return true;
+        };
+        for (size_t i = n; i-- > 0;)
+        {
+            if (g_GribMessages[i].stale)
+                continue;
+            if (link(hc.cells, hc.nextInCell, hc.CellKey((int)i), (int)i))
+                hc.duplicates++;
+            link(hc.cellsNoStep, hc.nextNoStep, hc.CellKey((int)i, kDimStep), (int)i);
+            link(hc.cellsNoValidity, hc.nextNoValidity, hc.CellKey((int)i, kDimValidity), (int)i);
+        }
+        hc.valid = true;
+    }
+    g_Hypercube = std::move(hc);
+}
+
+// Which time coordinate to leave out when walking/pivoting dimA (and dimB).
+static int HypercubeIgnoredDim(int dimA, int dimB = -1)
+{
+    bool step = (dimA == kDimStep || dimB == kDimStep);
+    bool validity = (dimA == kDimValidity || dimB == kDimValidity);
+    if (step && !validity)
+        return kDimValidity;
+    if (validity && !step)
+        return kDimStep;
+    return -1;
+}
+
+// Message in a cell: the first one shown in the table, else the first one.
+static int HypercubeCellMessage(uint64_t key, int ignoredDim)
+{
+    const HypercubeIndex &hc = g_Hypercube;
+    const std::unordered_map<uint64_t, int> &cells = (ignoredDim == kDimStep)       ? hc.cellsNoStep
+                                                     : (ignoredDim == kDimValidity) ? hc.cellsNoValidity
+                                                                                    : hc.cells;
+    const std::vector<int> &next = (ignoredDim == kDimStep)       ? hc.nextNoStep
+                                   : (ignoredDim == kDimValidity) ? hc.nextNoValidity
+                                                                  : hc.nextInCell;
+    auto it = cells.find(key);
+    if (it == cells.end())
+        return -1;
+    for (int msg = it->second; msg >= 0; msg = next[msg])
+    {
+        if (RowOfMessage(msg) >= 0)
+            return msg;
+    }
+    return it->second;
+}
+
+static void SelectSingleMessage(int msgIndex)
+{
+    ClearAllSelections();
+    g_GribMessages[msgIndex].selected = true;
+    g_LastSelectionAnchor = msgIndex;
+    RefreshSelectionState(true, msgIndex);
+}
+
+// Move the active message one value along a dimension (dir = +1/-1),
+// skipping combinations that do not exist or are hidden in the table.
+static bool NavigateHypercube(int dim, int dir)
+{
+    const HypercubeIndex &hc = g_Hypercube;
+    int cur = g_SelectedMessageIndex;
+    if (!hc.valid || cur < 0 || cur >= (int)g_GribMessages.size())
+        return false;
+    int ignored = HypercubeIgnoredDim(dim);
+    long here = (long)hc.Coord(cur, dim);
+    uint64_t base = hc.CellKey(cur, ignored) - (uint64_t)here * hc.stride[dim];
+    for (long v = here + dir; v >= 0 && v < (long)hc.values[dim].size(); v += dir)
+    {
+        int target = HypercubeCellMessage(base + (uint64_t)v * hc.stride[dim], ignored);
+        if (target >= 0 && RowOfMessage(target) >= 0)
+        {
+            SelectSingleMessage(target);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Alt + arrows/PageUp/PageDown; add Shift for the second set of dimensions.
+static void HandleHypercubeShortcuts(const ImGuiIO &io)
+{
+    if (!io.KeyAlt || io.WantTextInput || !g_Hypercube.valid)
+        return;
+    struct Binding
+    {
+        ImGuiKey prev, next;
+        int dim, dimShift;
+    };
+    static const Binding bindings[] = {
+        {ImGuiKey_LeftArrow, ImGuiKey_RightArrow, kDimStep, kDimValidity},
+        {ImGuiKey_UpArrow, ImGuiKey_DownArrow, kDimLevel, kDimLevelType},
+        {ImGuiKey_PageUp, ImGuiKey_PageDown, kDimParameter, kDimMember}};
+    for (const Binding &b : bindings)
+    {
+        int dim = io.KeyShift ? b.dimShift : b.dim;
+        if (ImGui::IsKeyPressed(b.prev))
+            NavigateHypercube(dim, -1);
+        if (ImGui::IsKeyPressed(b.next))
+            NavigateHypercube(dim, +1);
+    }
+}
+
+// Pivot grid of two dimensions with the others fixed at the active message.
+static void DrawHypercubeWindow()
+{
+    if (!g_ShowHypercube)
+        return;
+    ImGui::SetNextWindowSize(ImVec2(560, 420), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin("Hypercube", &g_ShowHypercube))
+    {
+        ImGui::End();
+        return;
+    }
+    const HypercubeIndex &hc = g_Hypercube;
+    int cur = g_SelectedMessageIndex;
+    if (!hc.valid || cur < 0 || cur >= (int)g_GribMessages.size())
+    {
+        ImGui::TextUnformatted("Select a message to browse the hypercube.");
+        ImGui::End();
+        return;
+    }
+    static const char *shortcuts[kHypercubeDims] = {"Alt+PgUp/PgDn", "Alt+Shift+Up/Down", "Alt+Up/Down",
+                                                    "Alt+Left/Right", "Alt+Shift+Left/Right", "Alt+Shift+PgUp/PgDn"};
+    if (ImGui::BeginTable("HypercubeDims", 4, ImGuiTableFlags_SizingFixedFit | ImGuiTableFlags_RowBg))
+    {
+        for (int d = 0; d < kHypercubeDims; d++)
+        {
+            ImGui::PushID(d);
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("%s (%zu)", kHypercubeDimNames[d], hc.values[d].size());
+            ImGui::TableNextColumn();
+            if (ImGui::ArrowButton("##prev", ImGuiDir_Left))
+                NavigateHypercube(d, -1);
+            ImGui::SameLine();
+            if (ImGui::ArrowButton("##next", ImGuiDir_Right))
+                NavigateHypercube(d, +1);
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(hc.values[d][hc.Coord(cur, d)].c_str());
+            ImGui::TableNextColumn();
+            ImGui::TextDisabled("%s", shortcuts[d]);
+            ImGui::PopID();
+        }
+        ImGui::EndTable();
+    }
+    if (hc.duplicates > 0)
+        ImGui::TextDisabled("%zu message(s) share a cell with another message", hc.duplicates);
+    ImGui::Separator();
+    ImGui::SetNextItemWidth(140.0f);
+    ImGui::Combo("Rows", &g_PivotRowDim, kHypercubeDimNames, kHypercubeDims);
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(140.0f);
+    ImGui::Combo("Columns", &g_PivotColDim, kHypercubeDimNames, kHypercubeDims);
+    if (g_PivotRowDim == g_PivotColDim)
+    {
+        ImGui::TextUnformatted("Pick two different dimensions.");
+        ImGui::End();
+        return;
+    }
+    const int rowDim = g_PivotRowDim;
+    const int colDim = g_PivotColDim;
+    const int maxCols = 256;
+    int colCount = std::min((int)hc.values[colDim].size(), maxCols);
+    int ignored = HypercubeIgnoredDim(rowDim, colDim);
+    uint64_t base = hc.CellKey(cur, ignored) - (uint64_t)hc.Coord(cur, rowDim) * hc.stride[rowDim] -
+                    (uint64_t)hc.Coord(cur, colDim) * hc.stride[colDim];
+    if (ImGui::BeginTable("HypercubePivot", colCount + 1,
+                          ImGuiTableFlags_ScrollX | ImGuiTableFlags_ScrollY | ImGuiTableFlags_Borders |
+                              ImGuiTableFlags_SizingFixedFit))
+    {
+        ImGui::TableSetupScrollFreeze(1, 1);
+        ImGui::TableSetupColumn(kHypercubeDimNames[rowDim]);
+        for (int c = 0; c < colCount; c++)
+            ImGui::TableSetupColumn(hc.values[colDim][c].c_str());
+        ImGui::TableHeadersRow();
+        ImGuiListClipper clipper;
+        clipper.Begin((int)hc.values[rowDim].size());
+        while (clipper.Step())
+        {
+            for (int r = clipper.DisplayStart; r < clipper.DisplayEnd; r++)
+            {
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(hc.values[rowDim][r].c_str());
+                for (int c = 0; c < colCount; c++)
+                {
+                    ImGui::TableNextColumn();
+                    int msg = HypercubeCellMessage(base + (uint64_t)r * hc.stride[rowDim] + (uint64_t)c * hc.stride[colDim], ignored);
+                    if (msg < 0)
+                        continue;
+                    bool shown = RowOfMessage(msg) >= 0;
+                    ImGui::PushID(msg);
+                    ImGui::BeginDisabled(!shown);
+                    if (ImGui::Selectable(shown ? "#" : ".", msg == cur))
+                        SelectSingleMessage(msg);
+                    ImGui::EndDisabled();
+                    if (ImGui::IsItemHovered(ImGuiHoveredFlags_AllowWhenDisabled))
+                        ImGui::SetTooltip("message #%d%s", g_GribMessages[msg].index, shown ? "" : " (hidden)");
+                    ImGui::PopID();
+                }
+            }
+        }
+        ImGui::EndTable();
+    }
+    if ((int)hc.values[colDim].size() > colCount)
+        ImGui::TextDisabled("Showing the first %d of %zu columns", colCount, hc.values[colDim].size());
+    ImGui::End();
+}
+
+static void ClearAllMessages()
+{
+    DestroyTexture(g_TextureID);
+    for (auto &msg : g_GribMessages)
+    {
+        if (msg.message)
+        {
+            codes_handle_delete(msg.message);
+            msg.message = nullptr;
+        }
+    }
+    StopWatch();
+    g_GribMessages.clear();
+    ResetDuplicates();
+    ClearGridRegistry();
+    ReleaseNearest();
+    {
+        std::lock_guard<std::mutex> lock(g_CompressedMutex);
+        g_CompressedIndexes.clear();
+    }
+    g_MetadataGeneration++; // cached query columns point into the old messages
+    ResetViewState();
+    g_Hypercube = HypercubeIndex();
+    g_SelectedMessageIndex = -1;
+    g_LastSelectionAnchor = -1;
+    g_ScrollPendingIndex = -1;
+    g_SaveSelectionStatus.clear();
+    g_SaveSelectionSuccess = false;
+    ClearMarkerSeries();
+    ClearRegionSeries();
+    ClearProfile();
+    g_ExtractionRunning = false;
+    g_ExtractionStatus = "";
+    UpdateWindowTitle();
+}
+
+// ----------------------------------------------------------
+// Memory report. Figures are estimates from container capacities: each
+// map or hash entry is counted with kMemNodeOverhead for its links and
+// allocator header, and an open handle with its message plus
+// kMemHandleOverhead for the accessors ecCodes builds per handle (a rough
+// figure, it depends on the template). On Linux the process RSS is shown
+// as well; the difference is held by libraries and the allocator.
+// ----------------------------------------------------------
+static const uint64_t kMemNodeOverhead = 6 * sizeof(void *);
+static const uint64_t kMemHandleOverhead = 64u << 10;
+
+struct MemoryReport
+{
+    uint64_t bytes[kMemCategoryCount] = {};
+    uint64_t peak[kMemCategoryCount] = {};
+    size_t messages = 0;
+    size_t metadataKeys = 0;
+    size_t openHandles = 0;
+    size_t markerSamples = 0;
+    size_t grids = 0;              // distinct grids in the registry
+    size_t gridMessages = 0;       // messages sharing them
+    uint64_t gridUnsharedBytes = 0; // the same with one copy per message
+    uint64_t residentBytes = 0; // process RSS, 0 when unknown
+
+    uint64_t Tracked() const
+    {
+        uint64_t total = 0;
+        for (uint64_t b : bytes)
+            total += b;
+        return total;
+    }
+    // What the limit is compared against.
+    uint64_t Used() const { return residentBytes ? residentBytes : Tracked(); }
+    bool NearLimit() const
+    {
+        return g_MemLimitBytes > 0 && (double)Used() >= kMemWarnFraction * (double)g_MemLimitBytes;
+    }
+};
+static MemoryReport g_MemReport;
+
+static uint64_t ProcessResidentBytes()
+{
+#if defined(__linux__)
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (!f)
+        return 0;
+    unsigned long long size = 0, resident = 0;
+    int n = fscanf(f, "%llu %llu", &size, &resident);
+    fclose(f);
+    return n == 2 ? (uint64_t)resident * (uint64_t)sysconf(_SC_PAGESIZE) : 0;
+#else
+    return 0;
+#endif
+}
+
+static uint64_t MessageMetadataBytes(const GribMessage &gm, size_t &keys)
+{
+    uint64_t bytes = StringHeapBytes(gm.shortName) + StringHeapBytes(gm.parameterUnits) +
+                     StringHeapBytes(gm.parameterName) + StringHeapBytes(gm.filePath);
+    for (const auto &kv : gm.keyValueMap)
+        bytes += sizeof(kv) + kMemNodeOverhead + StringHeapBytes(kv.first) + StringHeapBytes(kv.second);
+    keys += gm.keyValueMap.size();
+    return bytes;
+}
+
+static uint64_t QueryColumnBytes(const QueryColumn &col)
+{
+    uint64_t bytes = VectorBytes(col.text) + VectorBytes(col.num);
+    for (const auto &kv : col.byText)
+        bytes += sizeof(kv) + kMemNodeOverhead + StringHeapBytes(kv.first) + VectorBytes(kv.second);
+    for (const auto &kv : col.byNumber)
+        bytes += sizeof(kv) + kMemNodeOverhead + VectorBytes(kv.second);
+    bytes += (col.byText.bucket_count() + col.byNumber.bucket_count()) * sizeof(void *);
+    return bytes;
+}
+
+static uint64_t HypercubeBytes(const HypercubeIndex &hc)
+{
+    uint64_t bytes = VectorBytes(hc.coords) + VectorBytes(hc.nextInCell) + VectorBytes(hc.nextNoStep) +
+                     VectorBytes(hc.nextNoValidity);
+    for (const auto &labels : hc.values)
+    {
+        bytes += VectorBytes(labels);
+        for (const std::string &s : labels)
+            bytes += StringHeapBytes(s);
+    }
+    for (const auto *cells : {&hc.cells, &hc.cellsNoStep, &hc.cellsNoValidity})
+        bytes += cells->size() * (sizeof(std::pair<const uint64_t, int>) + kMemNodeOverhead) +
+                 cells->bucket_count() * sizeof(void *);
+    return bytes;
+}
+
+static MemoryReport ComputeMemoryReport()
+{
+    MemoryReport r;
+    r.messages = g_GribMessages.size();
+    // Keys only change on load, clear and "More Info", so the walk over
+    // every keyValueMap is cached and extended as messages are appended.
+    static size_t cachedCount = 0;
+    static unsigned cachedGeneration = 0;
+    static uint64_t cachedBytes = 0;
+    static size_t cachedKeys = 0;
+    if (cachedGeneration != g_MetadataGeneration || cachedCount > g_GribMessages.size())
+    {
+        cachedCount = 0;
+        cachedBytes = 0;
+        cachedKeys = 0;
+        cachedGeneration = g_MetadataGeneration;
+    }
+    for (; cachedCount < g_GribMessages.size(); cachedCount++)
+        cachedBytes += MessageMetadataBytes(g_GribMessages[cachedCount], cachedKeys);
+    r.bytes[kMemMetadata] = VectorBytes(g_GribMessages) + cachedBytes;
+    r.metadataKeys = cachedKeys;
+
+    for (const GribMessage &gm : g_GribMessages)
+    {
+        if (!gm.message)
+            continue;
+        r.openHandles++;
+        size_t size = gm.messageSize;
+        if (size == 0)
+            codes_get_message_size(gm.message, &size);
+        r.bytes[kMemHandles] += size + kMemHandleOverhead;
+    }
+
+    r.bytes[kMemDecoded] = g_MemLive[kMemDecoded].load();
+    r.bytes[kMemStaging] = g_MemLive[kMemStaging].load();
+    r.bytes[kMemTextures] = g_TextureID ? (uint64_t)g_TexWidth * (uint64_t)g_TexHeight * 4 : 0;
+
+    r.bytes[kMemMarkers] = VectorBytes(g_Markers) + VectorBytes(g_MarkerIndex.start) + VectorBytes(g_MarkerIndex.items);
+    for (const Marker &m : g_Markers)
+    {
+        r.bytes[kMemMarkers] += VectorBytes(m.series) + VectorBytes(m.stencils) + StringHeapBytes(m.status) +
+                                StringHeapBytes(m.name);
+        r.markerSamples += m.series.size();
+    }
+    r.bytes[kMemMarkers] += VectorBytes(g_Regions);
+    for (const Region &region : g_Regions)
+    {
+        r.bytes[kMemMarkers] += VectorBytes(region.vertices) + VectorBytes(region.series) + VectorBytes(region.masks);
+        for (const auto &entry : region.masks)
+            r.bytes[kMemMarkers] += VectorBytes(entry.second->runs) + VectorBytes(entry.second->pointWeights);
+        r.markerSamples += region.series.size();
+    }
+    r.bytes[kMemMarkers] += VectorBytes(g_Profile.messages) + VectorBytes(g_Profile.values);
+
+    uint64_t &idx = r.bytes[kMemIndexes];
+    idx = VectorBytes(g_View.order) + VectorBytes(g_View.visible) + VectorBytes(g_ViewRows) +
+          VectorBytes(g_RowOfMessage) + VectorBytes(g_FilterMask) + VectorBytes(g_ViewUndo);
+    for (const ViewState &v : g_ViewUndo)
+        idx += VectorBytes(v.order) + VectorBytes(v.visible);
+    for (const auto &kv : g_QueryColumns)
+        idx += sizeof(kv) + kMemNodeOverhead + StringHeapBytes(kv.first) + QueryColumnBytes(kv.second);
+    idx += HypercubeBytes(g_Hypercube);
+    idx += (g_FirstWithContent.size() + g_FirstWithIdentity.size()) *
+               (sizeof(std::pair<const uint64_t, int>) + kMemNodeOverhead) +
+           (g_FirstWithContent.bucket_count() + g_FirstWithIdentity.bucket_count()) * sizeof(void *);
+    {
+        std::lock_guard<std::mutex> lock(g_CompressedMutex);
+        for (const auto &kv : g_CompressedIndexes)
+            idx += sizeof(kv) + kMemNodeOverhead + kv.second->MemoryBytes();
+    }
+
+    uint64_t gridBytes = 0;
+    GridRegistryBytes(r.grids, r.gridMessages, gridBytes, r.gridUnsharedBytes);
+    r.bytes[kMemGrids] = gridBytes + r.grids * kMemNodeOverhead;
+
+    for (int c = 0; c < kMemCategoryCount; c++)
+    {
+        NoteMemPeak((MemCategory)c, r.bytes[c]);
+        r.peak[c] = g_MemPeak[c].load();
+    }
+    r.residentBytes = ProcessResidentBytes();
+    return r;
+}
+
+static std::string FormatMemorySize(uint64_t bytes)
+{
+    char buf[32];
+    if (bytes >= (1ull << 30))
+        snprintf(buf, sizeof(buf), "%.2f GB", (double)bytes / (double)(1ull << 30));
+    else if (bytes >= (1ull << 20))
+        snprintf(buf, sizeof(buf), "%.1f MB", (double)bytes / (double)(1ull << 20));
+    else
+        snprintf(buf, sizeof(buf), "%.1f KB", (double)bytes / 1024.0);
+    return buf;
+}
+
+static std::string MemoryCategoryDetail(const MemoryReport &r, int c)
+{
+    char buf[96] = "";
+    if (c == kMemMetadata)
+        snprintf(buf, sizeof(buf), "%zu messages, %zu keys", r.messages, r.metadataKeys);
+    else if (c == kMemHandles)
+        snprintf(buf, sizeof(buf), "%zu open", r.openHandles);
+    else if (c == kMemMarkers)
+        snprintf(buf, sizeof(buf), "%zu markers, %zu regions, %zu samples", g_Markers.size(), g_Regions.size(),
+                 r.markerSamples);
+    else if (c == kMemGrids)
+        snprintf(buf, sizeof(buf), "%zu grids for %zu messages (%s unshared)", r.grids, r.gridMessages,
+                 FormatMemorySize(r.gridUnsharedBytes).c_str());
+    return buf;
+}
+
+// Plain-text table, for --mem-report and the panel's "Copy report".
+static std::string FormatMemoryReport(const MemoryReport &r)
+{
+    std::string out;
+    char line[256];
+    snprintf(line, sizeof(line), "%-20s %12s %12s  %s\n", "subsystem", "current", "peak", "detail");
+    out += line;
+    for (int c = 0; c < kMemCategoryCount; c++)
+    {
+        snprintf(line, sizeof(line), "%-20s %12s %12s  %s\n", kMemCategoryNames[c],
+                 FormatMemorySize(r.bytes[c]).c_str(), FormatMemorySize(r.peak[c]).c_str(),
+                 MemoryCategoryDetail(r, c).c_str());
+        out += line;
+        while (out.size() > 1 && out[out.size() - 2] == ' ')
+            out.erase(out.size() - 2, 1);
+    }
+    snprintf(line, sizeof(line), "%-20s %12s\n", "tracked total", FormatMemorySize(r.Tracked()).c_str());
+    out += line;
+    if (r.residentBytes)
+    {
+        snprintf(line, sizeof(line), "%-20s %12s\n", "process RSS", FormatMemorySize(r.residentBytes).c_str());
+        out += line;
+    }
+    if (g_MemLimitBytes)
+    {
+        snprintf(line, sizeof(line), "%-20s %12s  %.0f%% used%s\n", "limit", FormatMemorySize(g_MemLimitBytes).c_str(),
+                 100.0 * (double)r.Used() / (double)g_MemLimitBytes, r.NearLimit() ? " - WARNING" : "");
+        out += line;
+    }
+    return out;
+}
+
+// Recomputes the report about once a second; cheap enough to call every frame.
+static void UpdateMemoryReport()
+{
+    static std::chrono::steady_clock::time_point last;
+    auto now = std::chrono::steady_clock::now();
+    if (now - last < std::chrono::seconds(1))
+        return;
+    last = now;
+    g_MemReport = ComputeMemoryReport();
+}
+
+// Closes every open message handle except the active message's; they are
+// reopened from the file when needed again.
+static size_t ReleaseMessageHandles()
+{
+    size_t released = 0;
+    for (size_t i = 0; i < g_GribMessages.size(); i++)
+    {
+        GribMessage &gm = g_GribMessages[i];
+        if (!gm.message || (int)i == g_SelectedMessageIndex)
+            continue;
+        codes_handle_delete(gm.message);
+        gm.message = nullptr;
+        released++;
+    }
+    return released;
+}
+
+static void DrawMemoryWindow()
+{
+    if (!g_ShowMemory)
+        return;
+    ImGui::SetNextWindowSize(ImVec2(520, 330), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin("Memory", &g_ShowMemory))
+    {
+        ImGui::End();
+        return;
+    }
+    const MemoryReport &r = g_MemReport;
+    if (ImGui::BeginTable("MemoryTable", 4, ImGuiTableFlags_SizingFixedFit | ImGuiTableFlags_RowBg))
+    {
+        ImGui::TableSetupColumn("Subsystem");
+        ImGui::TableSetupColumn("Current");
+        ImGui::TableSetupColumn("Peak");
+        ImGui::TableSetupColumn("Detail", ImGuiTableColumnFlags_WidthStretch);
+        ImGui::TableHeadersRow();
+        for (int c = 0; c < kMemCategoryCount; c++)
+        {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(kMemCategoryNames[c]);
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(FormatMemorySize(r.bytes[c]).c_str());
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(FormatMemorySize(r.peak[c]).c_str());
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(MemoryCategoryDetail(r, c).c_str());
+        }
+        ImGui::EndTable();
+    }
+    ImGui::Text("Tracked total: %s", FormatMemorySize(r.Tracked()).c_str());
+    if (r.residentBytes)
+    {
+        uint64_t untracked = r.residentBytes > r.Tracked() ? r.residentBytes - r.Tracked() : 0;
+        ImGui::Text("Process RSS: %s (%s in libraries/allocator)", FormatMemorySize(r.residentBytes).c_str(),
+                    FormatMemorySize(untracked).c_str());
+    }
+    ImGui::Separator();
+    float limitGb = (float)((double)g_MemLimitBytes / (double)(1ull << 30));
+    ImGui::SetNextItemWidth(120.0f);
+    if (ImGui::InputFloat("Warn limit (GB, 0 = off)", &limitGb, 0.0f, 0.0f, "%.1f"))
+        g_MemLimitBytes = limitGb > 0.0f ? (uint64_t)((double)limitGb * (double)(1ull << 30)) : 0;
+    if (r.NearLimit())
+        ImGui::TextColored(ImVec4(1.0f, 0.35f, 0.3f, 1.0f), "Using %s of the %s limit",
+                           FormatMemorySize(r.Used()).c_str(), FormatMemorySize(g_MemLimitBytes).c_str());
+    if (ImGui::Button("Release handles"))
+    {
+        ReleaseMessageHandles();
+        g_MemReport = ComputeMemoryReport();
+    }
+    if (ImGui::IsItemHovered())
+        ImGui::SetTooltip("Close the message handles kept open by browsing and extraction");
+    ImGui::SameLine();
+    if (ImGui::Button("Copy report"))
+        ImGui::SetClipboardText(FormatMemoryReport(r).c_str());
+    ImGui::End();
+}
+
+// ----------------------------------------------------------
+// View editing: delete, undo, reset, save/restore
+// ----------------------------------------------------------
+static void SelectFirstRow()
+{
+    ClearAllSelections();
+    g_LastSelectionAnchor = -1;
+    if (!g_ViewRows.empty())
+    {
+        g_GribMessages[g_ViewRows[0]].selected = true;
+        g_LastSelectionAnchor = g_ViewRows[0];
+    }
+    RefreshSelectionState(true, g_LastSelectionAnchor);
+}
+
+// Hide the selected rows. The messages stay loaded (only their decoded
+// handles are released) so the removal can be undone.
+static void RemoveSelectedFromView()
+{
+    bool any = false;
+    for (int idx : g_ViewRows)
+    {
+        if (g_GribMessages[idx].selected)
+        {
+            any = true;
+            break;
+        }
+    }
+    if (!any)
+        return;
+    PushViewUndo();
+    for (int idx : g_ViewRows)
+    {
+        GribMessage &gm = g_GribMessages[idx];
+        if (!gm.selected)
+            continue;
+        g_View.visible[idx] = false;
+        gm.selected = false;
+        if (gm.message)
+        {
+            codes_handle_delete(gm.message);
+            gm.message = nullptr;
+        }
+    }
+    RebuildViewRows();
+    SelectFirstRow();
+}
+
+// Shows or hides the later copies of messages loaded more than once.
+static void SetCollapseDuplicates(bool collapse)
+{
+    g_CollapseDuplicates = collapse;
+    RebuildViewRows();
+    for (size_t i = 0; i < g_GribMessages.size(); i++)
+    {
+        if (g_GribMessages[i].selected && RowOfMessage((int)i) < 0)
+            g_GribMessages[i].selected = false;
+    }
+    RefreshSelectionState(true, g_SelectedMessageIndex);
+    if (g_SelectedMessageIndex < 0)
+        SelectFirstRow();
+}
+
+static bool UndoView()
+{
+    if (g_ViewUndo.empty())
+        return false;
+    g_View = std::move(g_ViewUndo.back());
+    g_ViewUndo.pop_back();
+    // Messages loaded after the snapshot was taken are kept at the end.
+    SyncViewWithMessages();
+    for (size_t i = 0; i < g_GribMessages.size(); i++)
+    {
+        if (g_GribMessages[i].selected && RowOfMessage((int)i) < 0)
+            g_GribMessages[i].selected = false;
+    }
+    RefreshSelectionState(true, g_SelectedMessageIndex);
+    if (g_SelectedMessageIndex < 0)
+        SelectFirstRow();
+    return true;
+}
+
+// Show every message in load order.
+static void ResetView()
+{
+    PushViewUndo();
+    g_View.order.resize(g_GribMessages.size());
+    for (size_t i = 0; i < g_View.order.size(); i++)
+        g_View.order[i] = (int)i;
+    g_View.visible.assign(g_GribMessages.size(), true);
+    RebuildViewRows();
+    RefreshSelectionState(true, g_SelectedMessageIndex);
+}
+
+// View files list every message as "visible<TAB>offset<TAB>path" in display
+// order, so a view can be restored against the same set of files later.
+static bool SaveViewToFile(const std::string &path)
+{
+    FILE *f = fopen(path.c_str(), "w");
+    if (!f)
+        return false;
+    fprintf(f, "# gribview view 1\n");
+    for (int idx : g_View.order)
+    {
+        const GribMessage &gm = g_GribMessages[idx];
+        fprintf(f, "%d\t%ld\t%s\n", g_View.visible[idx] ? 1 : 0, gm.fileOffset, gm.filePath.c_str());
+    }
+    fclose(f);
+    return true;
+}
+
+static bool LoadViewFromFile(const std::string &path)
+{
+    std::ifstream in(path);
+    if (!in)
+        return false;
+    std::map<std::pair<std::string, long>, int> byLocation;
+    for (size_t i = 0; i < g_GribMessages.size(); i++)
+        byLocation[{g_GribMessages[i].filePath, g_GribMessages[i].fileOffset}] = (int)i;
+    ViewState next;
+    next.visible.assign(g_GribMessages.size(), true);
+    std::vector<bool> placed(g_GribMessages.size(), false);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+        size_t t1 = line.find('\t');
+        size_t t2 = (t1 == std::string::npos) ? t1 : line.find('\t', t1 + 1);
+        if (t2 == std::string::npos)
+            continue;
+        long offset = strtol(line.c_str() + t1 + 1, nullptr, 10);
+        auto it = byLocation.find({line.substr(t2 + 1), offset});
+        if (it == byLocation.end() || placed[it->second])
+            continue;
+        placed[it->second] = true;
+        next.order.push_back(it->second);
+        next.visible[it->second] = (line[0] != '0');
+    }
+    if (next.order.empty())
+        return false;
+    // Messages the view file does not know about stay visible at the end.
+    for (size_t i = 0; i < placed.size(); i++)
+    {
+        if (!placed[i])
+            next.order.push_back((int)i);
+    }
+    PushViewUndo();
+    g_View = std::move(next);
+    RebuildViewRows();
+    SelectFirstRow();
+    return true;
+}
+
+static void LoadFilesAndSelect(const std::vector<std::string> &paths)
+{
+    if (paths.empty())
+        return;
+    size_t previousCount = g_GribMessages.size();
+    for (const auto &p : paths)
+    {
+        LoadGribFileAppend(p);
+    }
+    SyncViewWithMessages();
+    RebuildHypercube();
+    if (g_GribMessages.size() > previousCount)
+    {
+        ClearAllSelections();
+        size_t selectIndex = previousCount;
+        g_GribMessages[selectIndex].selected = true;
+        g_SelectedMessageIndex = (int)selectIndex;
+        g_LastSelectionAnchor = (int)selectIndex;
+        GenerateTextureForSelectedMessage();
+    }
+}
+
+static void PromptFileDialogIfNeeded()
+{
+    if (!g_RequestFileDialog)
+        return;
+    g_RequestFileDialog = false;
+    const char *patterns[] = {"*.grib", "*.grb", "*.grib2", "*.grb2", "*.gz", "*.zst", "*"};
+    const char *choice = tinyfd_openFileDialog("Open GRIB files",
+                                               "",
+                                               7,
+                                               patterns,
+                                               "GRIB files",
+                                               1);
+    if (!choice)
+        return;
+    std::vector<std::string> files;
+    std::string combined(choice);
+    size_t start = 0;
+    while (start < combined.size())
+    {
+        size_t sep = combined.find('|', start);
+        std::string token = combined.substr(start, (sep == std::string::npos) ? std::string::npos : sep - start);
+        if (!token.empty())
+            files.push_back(token);
+        if (sep == std::string::npos)
+            break;
+        start = sep + 1;
+    }
+    LoadFilesAndSelect(files);
+}
+
+// ----------------------------------------------------------
+// Save current displayed image to PNG
+// ----------------------------------------------------------
+static void SaveCurrentImagePNG(const std::string &filename)
+{
+    if (g_SelectedMessageIndex < 0 || g_SelectedMessageIndex >= (int)g_GribMessages.size())
+        return;
+    GribMessage &gm = g_GribMessages[g_SelectedMessageIndex];
+    if (!gm.message)
+        return;
+    std::vector<double> data;
+    double minVal, maxVal;
+    GetMessageValuesAndRange(gm.message, data, minVal, maxVal);
+    ScopedMemCharge decoded(kMemDecoded, VectorBytes(data));
+    int width = 0, height = 0;
+    if (data.empty() || !ValuesToDisplayRaster(gm, data, width, height))
+        return;
+    decoded.Set(VectorBytes(data));
+    auto it = colormapMap.find(g_ChosenColormapName);
+    const ColorEntry *colorMap = (it != colormapMap.end()) ? it->second : greyColormap;
+    int mapSize = colormapSize;
+    std::vector<unsigned char> imageRGBA;
+    ColormapToRGBA(data, width, height, g_UserMinVal, g_UserMaxVal, colorMap, mapSize, imageRGBA);
+    ScopedMemCharge staging(kMemStaging, VectorBytes(imageRGBA));
+    stbi_write_png(filename.c_str(), width, height, 4, imageRGBA.data(), width * 4);
+}
+
+// ----------------------------------------------------------
+// Raw byte-range copy between files. Messages are exported as the exact
+// bytes recorded at scan time (offset + length), so nothing is decoded.
+// On Linux copy_file_range/sendfile keep the data inside the kernel;
+// elsewhere (or if both fail) large buffered reads are used.
+// ----------------------------------------------------------
+static const size_t kCopyBufferSize = 8u << 20;
+
+static bool SeekFile(FILE *f, long long offset)
+{
+#if defined(_WIN32)
+    return _fseeki64(f, offset, SEEK_SET) == 0;
+#else
+    return fseeko(f, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+static bool CopyByteRange(FILE *in, FILE *out, long long offset, size_t size, std::vector<char> &buffer)
+{
+#if defined(__linux__)
+    if (fflush(out) != 0)
+        return false;
+    int inFd = fileno(in);
+    int outFd = fileno(out);
+    loff_t inOff = (loff_t)offset;
+    size_t left = size;
+#if defined(SYS_copy_file_range)
+    while (left > 0)
+    {
+        ssize_t n = syscall(SYS_copy_file_range, inFd, &inOff, outFd, nullptr, left, 0u);
+        if (n <= 0)
+            break;
+        left -= (size_t)n;
+    }
+#endif
+    while (left > 0)
+    {
+        off_t sendOff = (off_t)inOff;
+        ssize_t n = sendfile(outFd, inFd, &sendOff, left);
+        if (n <= 0)
+            break;
+        inOff = (loff_t)sendOff;
+        left -= (size_t)n;
+    }
+    if (left == 0)
+        return true;
+    // The kernel moved the descriptor; resume buffered output at its end.
+    if (fseeko(out, 0, SEEK_END) != 0)
+        return false;
+    offset = (long long)inOff;
+    size = left;
+#endif
+    if (!SeekFile(in, offset))
+        return false;
+    if (buffer.size() < kCopyBufferSize)
+        buffer.resize(kCopyBufferSize);
+    while (size > 0)
+    {
+        size_t chunk = std::min(size, buffer.size());
+        if (fread(buffer.data(), 1, chunk, in) != chunk)
+            return false;
+        if (fwrite(buffer.data(), 1, chunk, out) != chunk)
+            return false;
+        size -= chunk;
+    }
+    return true;
+}
+
+// The same for a range of the uncompressed data of a compressed source.
+static bool CopyCompressedRange(CompressedGribIndex &packed, FILE *out, long long offset, size_t size,
+                                std::vector<char> &buffer)
+{
+    if (buffer.size() < kCopyBufferSize)
+        buffer.resize(kCopyBufferSize);
+    std::string error;
+    while (size > 0)
+    {
+        size_t chunk = std::min(size, buffer.size());
+        if (!packed.ReadAt((uint64_t)offset, buffer.data(), chunk, error))
+            return false;
+        if (fwrite(buffer.data(), 1, chunk, out) != chunk)
+            return false;
+        offset += (long long)chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+// Fallback for messages whose length is unknown: decode the handle and
+// write the bytes ecCodes hands back.
+static bool WriteMessageFromHandle(GribMessage &gm, FILE *out)
+{
+    EnsureMessageHandle(gm);
+    if (!gm.message)
+        return false;
+    const void *buffer = nullptr;
+    size_t size = 0;
+    int err = codes_get_message(gm.message, &buffer, &size);
+    if (err || !buffer || size == 0)
+        return false;
+    return fwrite(buffer, 1, size, out) == size;
+}
+
+// ----------------------------------------------------------
+// Save multiple GRIB messages to one file. Runs of messages that are
+// adjacent in the same source file are copied as one range.
+// ----------------------------------------------------------
+static bool SaveMessagesToGrib(const std::vector<GribMessage *> &messages,
+                               const std::string &outPath,
+                               size_t &savedCount,
+                               uint64_t &savedBytes)
+{
+    ScopedTrace trace("export", "io");
+    savedCount = 0;
+    savedBytes = 0;
+    if (messages.empty())
+        return false;
+    FILE *out = fopen(outPath.c_str(), "wb");
+    if (!out)
+        return false;
+    std::vector<char> buffer;
+    FILE *in = nullptr;
+    std::string inPath;
+    bool ok = true;
+    size_t i = 0;
+    while (ok && i < messages.size())
+    {
+        GribMessage *gm = messages[i];
+        if (gm->messageSize == 0)
+        {
+            ok = WriteMessageFromHandle(*gm, out);
+            i++;
+            continue;
+        }
+        long long start = gm->fileOffset;
+        long long end = start + (long long)gm->messageSize;
+        size_t j = i + 1;
+        while (j < messages.size() && messages[j]->messageSize > 0 &&
+               messages[j]->filePath == gm->filePath && messages[j]->fileOffset == end)
+        {
+            end += (long long)messages[j]->messageSize;
+            j++;
+        }
+        if (std::shared_ptr<CompressedGribIndex> packed = FindCompressedIndex(gm->filePath))
+            ok = CopyCompressedRange(*packed, out, start, (size_t)(end - start), buffer);
+        else
+        {
+            if (!in || inPath != gm->filePath)
+            {
+                if (in)
+                    fclose(in);
+                inPath = gm->filePath;
+                in = fopen(inPath.c_str(), "rb");
+            }
+            ok = in && CopyByteRange(in, out, start, (size_t)(end - start), buffer);
+        }
+        savedBytes += (uint64_t)(end - start);
+        i = j;
+    }
+    if (in)
+        fclose(in);
+    if (fclose(out) != 0)
+        ok = false;
+    if (!ok)
+    {
+        remove(outPath.c_str());
+        savedBytes = 0;
+        return false;
+    }
+    savedCount = messages.size();
+    return true;
+}
+
+// ----------------------------------------------------------
+// Save a single GRIB message to file
+// ----------------------------------------------------------
+static bool SaveSingleMessageGrib(GribMessage &gm, const std::string &outPath)
+{
+    size_t saved = 0;
+    uint64_t bytes = 0;
+    return SaveMessagesToGrib({&gm}, outPath, saved, bytes);
+}
+
+// ----------------------------------------------------------
+// Split export: an output pattern such as "out/[shortName]_[level].grib"
+// (same [key] syntax as grib_copy) sends every message to the file named
+// by its own keys. Sources are read once, sequentially and in file order;
+// the bytes are handed to a few writer threads, each owning a fixed subset
+// of the outputs, with a bounded number of open handles and of bytes in
+// flight. Within an output file messages keep their source order.
+// ----------------------------------------------------------
+static const size_t kSplitMaxOpenFiles = 64;
+static const size_t kSplitMaxBytesInFlight = 64u << 20;
+static const size_t kSplitReadBlock = 16u << 20;
+
+static bool IsOutputPattern(const std::string &path)
+{
+    size_t open = path.find('[');
+    return open != std::string::npos && path.find(']', open) != std::string::npos;
+}
+
+// Keys shown in the table come from the index; any other key (date,
+// paramId...) is read from the message itself. A key the message does not
+// define is an error rather than a silent "missing".
+static bool ExpandOutputPattern(const std::string &pattern, GribMessage &gm, std::string &out, std::string &error)
+{
+    out.clear();
+    codes_handle *opened = nullptr;
+    size_t pos = 0;
+    while (pos < pattern.size())
+    {
+        size_t open = pattern.find('[', pos);
+        size_t close = (open == std::string::npos) ? open : pattern.find(']', open);
+        if (close == std::string::npos)
+        {
+            out += pattern.substr(pos);
+            break;
+        }
+        out += pattern.substr(pos, open - pos);
+        std::string key = pattern.substr(open + 1, close - open - 1);
+        auto it = gm.keyValueMap.find(key);
+        std::string value;
+        if (it != gm.keyValueMap.end())
+            value = it->second.empty() ? "missing" : it->second;
+        else
+        {
+            codes_handle *h = gm.message;
+            if (!h && !gm.stale)
+                h = opened ? opened : (opened = ReopenGribMessage(gm));
+            char buf[256];
+            size_t len = sizeof(buf);
+            if (!h || codes_get_string(h, key.c_str(), buf, &len) != 0)
+            {
+                error = h ? "key [" + key + "] is not defined for message " + std::to_string(gm.index)
+                          : "cannot read message " + std::to_string(gm.index) + " from " + gm.filePath;
+                if (opened)
+                    codes_handle_delete(opened);
+                return false;
+            }
+            value = buf[0] ? buf : "missing";
+        }
+        for (char &c : value)
+        {
+            if (c == '/' || c == '\\' || c == ':' || isspace((unsigned char)c))
+                c = '_';
+        }
+        out += value;
+        pos = close + 1;
+    }
+    if (opened)
+        codes_handle_delete(opened);
+    return true;
+}
+
+struct SplitResult
+{
+    size_t messages = 0;
+    size_t files = 0;
+    uint64_t bytes = 0;
+    double seconds = 0.0;
+    std::string error;
+};
+
+class SplitWriterPool
+{
+public:
+    SplitWriterPool(const std::vector<std::string> &outputs, size_t threadCount)
+        : m_Outputs(outputs), m_Workers(std::max<size_t>(1, threadCount))
+    {
+        m_HandlesPerWorker = std::max<size_t>(1, kSplitMaxOpenFiles / m_Workers.size());
+        for (size_t w = 0; w < m_Workers.size(); w++)
+            m_Workers[w].thread = std::thread([this, w]() { Run(m_Workers[w]); });
+    }
+
+    ~SplitWriterPool() { Finish(); }
+
+    // Queue bytes for an output; blocks while too much data is in flight.
+    void Write(int output, std::vector<char> bytes)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_FlowMutex);
+            m_FlowCv.wait(lock, [&]() { return m_InFlight < kSplitMaxBytesInFlight || m_InFlight == 0; });
+            m_InFlight += bytes.size();
+            m_InFlightCharge.Set(m_InFlight);
+        }
+        Worker &w = m_Workers[(size_t)output % m_Workers.size()];
+        {
+            std::lock_guard<std::mutex> lock(w.mutex);
+            w.queue.push_back({output, std::move(bytes)});
+        }
+        w.cv.notify_one();
+    }
+
+    void Finish()
+    {
+        for (Worker &w : m_Workers)
+        {
+            {
+                std::lock_guard<std::mutex> lock(w.mutex);
+                w.closing = true;
+            }
+            w.cv.notify_one();
+        }
+        for (Worker &w : m_Workers)
+        {
+            if (w.thread.joinable())
+                w.thread.join();
+        }
+    }
+
+    bool Failed() const { return m_Failed.load(); }
+
+    // Delete every output file opened so far, after a failed export.
+    void RemoveCreated()
+    {
+        Finish();
+        for (Worker &w : m_Workers)
+        {
+            for (size_t output = 0; output < w.created.size(); output++)
+            {
+                if (w.created[output])
+                    remove(m_Outputs[output].c_str());
+            }
+        }
+    }
+
+private:
+    struct Chunk
+    {
+        int output;
+        std::vector<char> bytes;
+    };
+    struct Worker
+    {
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::vector<Chunk> queue;
+        bool closing = false;
+        std::map<int, FILE *> open;          // output -> handle
+        std::vector<int> lru;                // least recently used first
+        std::vector<bool> created;           // output already truncated
+    };
+
+    const std::vector<std::string> &m_Outputs;
+    std::vector<Worker> m_Workers;
+    size_t m_HandlesPerWorker = 1;
+    std::mutex m_FlowMutex;
+    std::condition_variable m_FlowCv;
+    size_t m_InFlight = 0;
+    ScopedMemCharge m_InFlightCharge{kMemStaging}; // follows m_InFlight
+    std::atomic<bool> m_Failed{false};
+
+    FILE *Handle(Worker &w, int output)
+    {
+        auto it = w.open.find(output);
+        if (it != w.open.end())
+        {
+            w.lru.erase(std::find(w.lru.begin(), w.lru.end(), output));
+            w.lru.push_back(output);
+            return it->second;
+        }
+        if (w.open.size() >= m_HandlesPerWorker)
+        {
+            int victim = w.lru.front();
+            w.lru.erase(w.lru.begin());
+            if (fclose(w.open[victim]) != 0)
+                m_Failed = true;
+            w.open.erase(victim);
+        }
+        if (w.created.size() < m_Outputs.size())
+            w.created.resize(m_Outputs.size(), false);
+        const std::string &path = m_Outputs[output];
+        if (!w.created[output])
+        {
+            std::error_code ec;
+            std::filesystem::path parent = std::filesystem::path(path).parent_path();
+            if (!parent.empty())
+                std::filesystem::create_directories(parent, ec);
+        }
+        FILE *f = fopen(path.c_str(), w.created[output] ? "ab" : "wb");
+        if (!f)
+            return nullptr;
+        w.created[output] = true;
+        w.open[output] = f;
+        w.lru.push_back(output);
+        return f;
+    }
+
+    void Run(Worker &w)
+    {
+        std::vector<Chunk> batch;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(w.mutex);
+                w.cv.wait(lock, [&]() { return w.closing || !w.queue.empty(); });
+                if (w.queue.empty() && w.closing)
+                    break;
+                batch.swap(w.queue);
+            }
+            ScopedTrace trace("split write", "worker", (long long)batch.size(), "chunks");
+            size_t done = 0;
+            for (Chunk &c : batch)
+            {
+                FILE *f = m_Failed ? nullptr : Handle(w, c.output);
+                if (!f || fwrite(c.bytes.data(), 1, c.bytes.size(), f) != c.bytes.size())
+                    m_Failed = true;
+                done += c.bytes.size();
+            }
+            batch.clear();
+            {
+                std::lock_guard<std::mutex> lock(m_FlowMutex);
+                m_InFlight -= done;
+                m_InFlightCharge.Set(m_InFlight);
+            }
+            m_FlowCv.notify_all();
+        }
+        for (auto &kv : w.open)
+        {
+            if (fclose(kv.second) != 0)
+                m_Failed = true;
+        }
+        w.open.clear();
+    }
+};
+
+static bool SplitMessagesToPattern(const std::vector<GribMessage *> &messages,
+                                   const std::string &pattern,
+                                   SplitResult &result)
+{
+    result = SplitResult();
+    ScopedTrace trace("split export", "io");
+    auto t0 = std::chrono::steady_clock::now();
+    if (messages.empty())
+    {
+        result.error = "Nothing to save";
+        return false;
+    }
+    // Resolve every message to an output file before writing anything.
+    std::vector<std::string> outputs;
+    std::map<std::string, int> outputIds;
+    std::vector<int> outputOf(messages.size());
+    std::string path;
+    for (size_t i = 0; i < messages.size(); i++)
+    {
+        if (!ExpandOutputPattern(pattern, *messages[i], path, result.error))
+            return false;
+        auto ins = outputIds.emplace(path, (int)outputs.size());
+        if (ins.second)
+            outputs.push_back(path);
+        outputOf[i] = ins.first->second;
+    }
+    // One sequential pass: by source file, then by offset.
+    std::vector<size_t> order(messages.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+                     {
+                         if (messages[a]->filePath != messages[b]->filePath)
+                             return messages[a]->filePath < messages[b]->filePath;
+                         return messages[a]->fileOffset < messages[b]->fileOffset;
+                     });
+    size_t threads = std::min<size_t>(4, std::max(1u, std::thread::hardware_concurrency()));
+    threads = std::min(threads, outputs.size());
+    SplitWriterPool pool(outputs, threads);
+    FILE *in = nullptr;
+    std::string inPath;
+    std::vector<char> block;
+    ScopedMemCharge blockCharge(kMemStaging);
+    size_t k = 0;
+    while (k < order.size() && result.error.empty() && !pool.Failed())
+    {
+        GribMessage &gm = *messages[order[k]];
+        if (gm.messageSize == 0)
+        {
+            // Length unknown: take the bytes from the decoded handle.
+            EnsureMessageHandle(gm);
+            const void *buf = nullptr;
+            size_t size = 0;
+            if (!gm.message || codes_get_message(gm.message, &buf, &size) != 0 || !buf)
+            {
+                result.error = "Cannot read message from " + gm.filePath;
+                break;
+            }
+            pool.Write(outputOf[order[k]], std::vector<char>((const char *)buf, (const char *)buf + size));
+            result.bytes += size;
+            k++;
+            continue;
+        }
+        std::shared_ptr<CompressedGribIndex> packed = FindCompressedIndex(gm.filePath);
+        if (!packed && (!in || inPath != gm.filePath))
+        {
+            if (in)
+                fclose(in);
+            inPath = gm.filePath;
+            in = fopen(inPath.c_str(), "rb");
+            if (!in)
+            {
+                result.error = "Cannot open " + inPath;
+                break;
+            }
+        }
+        // Read a block of adjacent messages at once, then slice it.
+        long long start = gm.fileOffset;
+        long long end = start + (long long)gm.messageSize;
+        size_t last = k + 1;
+        while (last < order.size())
+        {
+            const GribMessage &next = *messages[order[last]];
+            if (next.messageSize == 0 || next.filePath != gm.filePath || next.fileOffset != end ||
+                (size_t)(end - start) + next.messageSize > kSplitReadBlock)
+                break;
+            end += (long long)next.messageSize;
+            last++;
+        }
+        block.resize((size_t)(end - start));
+        blockCharge.Set(VectorBytes(block));
+        if (packed)
+        {
+            std::string error;
+            if (!packed->ReadAt((uint64_t)start, block.data(), block.size(), error))
+            {
+                result.error = error;
+                break;
+            }
+        }
+        else if (!SeekFile(in, start) || fread(block.data(), 1, block.size(), in) != block.size())
+        {
+            result.error = "Short read in " + inPath;
+            break;
+        }
+        for (size_t m = k; m < last; m++)
+        {
+            const GribMessage &part = *messages[order[m]];
+            const char *p = block.data() + (part.fileOffset - start);
+            pool.Write(outputOf[order[m]], std::vector<char>(p, p + part.messageSize));
+        }
+        result.bytes += block.size();
+        k = last;
+    }
+    if (in)
+        fclose(in);
+    pool.Finish();
+    if (result.error.empty() && pool.Failed())
+        result.error = "Failed to write one of the output files";
+    if (!result.error.empty())
+        pool.RemoveCreated();
+    result.messages = result.error.empty() ? messages.size() : 0;
+    result.files = result.error.empty() ? outputs.size() : 0;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    return result.error.empty();
+}
+
+// ----------------------------------------------------------
+// Re-encoded export: each message is decoded, transformed (crop to a
+// lat/lon box, decimate by a stride, repack) and encoded again from a clone
+// of its handle. Messages are processed in parallel, in batches, and written
+// in their original order.
+// ----------------------------------------------------------
+static const char *kRepackTypes[] = {"keep", "grid_simple", "grid_ccsds", "grid_jpeg", "grid_second_order"};
+
+struct ExportTransform
+{
+    bool crop = false;
+    double north = 90.0, south = -90.0, west = -180.0, east = 180.0;
+    int stride = 1;
+    int packing = 0;        // index into kRepackTypes, 0 keeps the source packing
+    int bitsPerValue = 0;   // 0 keeps the source precision
+    double tolerance = 0.0; // max abs error after repacking, 0 = unchecked
+
+    bool Reshapes() const { return crop || stride > 1; }
+    bool Active() const { return Reshapes() || packing > 0 || bitsPerValue > 0; }
+};
+
+static ExportTransform g_ExportTransform;
+
+struct TransformResult
+{
+    size_t messages = 0;
+    uint64_t bytesIn = 0;
+    uint64_t bytesOut = 0;
+    double maxError = 0.0;
+    double seconds = 0.0;
+    std::string error;
+};
+
+// Source grid rows/columns kept by a crop: 'count' points starting at
+// 'first', every 'stride' points, wrapping around a global longitude axis.
+struct CropAxis
+{
+    long first = 0;
+    long count = 0;
+    long stride = 1;
+    long Size() const { return count > 0 ? (count - 1) / stride + 1 : 0; }
+    long Source(long k, long n) const { return (first + k * stride) % n; }
+};
+
+static bool ComputeLatAxis(double lat1, double lat2, long nj, const ExportTransform &t, CropAxis &axis)
+{
+    axis = CropAxis();
+    axis.stride = std::max(1, t.stride);
+    double step = nj > 1 ? (lat2 - lat1) / (double)(nj - 1) : 0.0;
+    long first = -1, last = -1;
+    for (long j = 0; j < nj; j++)
+    {
+        double lat = lat1 + step * (double)j;
+        if (t.crop && (lat > t.north + 1e-9 || lat < t.south - 1e-9))
+            continue;
+        if (first < 0)
+            first = j;
+        last = j;
+    }
+    if (first < 0)
+        return false;
+    axis.first = first;
+    axis.count = last - first + 1;
+    return true;
+}
+
+static bool ComputeLonAxis(double lon1, double lon2, long ni, const ExportTransform &t, CropAxis &axis)
+{
+    axis = CropAxis();
+    axis.stride = std::max(1, t.stride);
+    double span = lon2 - lon1;
+    if (span < 0.0)
+        span += 360.0;
+    double step = ni > 1 ? span / (double)(ni - 1) : 0.0;
+    bool global = ni > 1 && fabs(step * (double)ni - 360.0) < step * 0.5;
+    if (!t.crop)
+    {
+        axis.count = ni;
+        return ni > 0;
+    }
+    double width = t.east - t.west;
+    if (width >= 360.0)
+        width = 360.0;
+    else
+        width = fmod(width + 720.0, 360.0);
+    auto inside = [&](long i)
+    {
+        double d = fmod(lon1 + step * (double)i - t.west + 720.0, 360.0);
+        return d <= width + 1e-9 || d >= 360.0 - 1e-9;
+    };
+    // Start at a kept point whose predecessor is not kept, so that a box
+    // straddling the end of a global grid comes out in one piece.
+    long start = -1;
+    for (long i = 0; i < ni && start < 0; i++)
+    {
+        long prev = (i == 0) ? (global ? ni - 1 : -1) : i - 1;
+        if (inside(i) && (prev < 0 || !inside(prev)))
+            start = i;
+    }
+    if (start < 0)
+    {
+        if (!inside(0))
+            return false;
+        start = 0; // every point is inside
+    }
+    long count = 0;
+    while (count < ni && inside((start + count) % ni) && (global || start + count < ni))
+        count++;
+    axis.first = start;
+    axis.count = count;
+    return true;
+}
+
+// Reads a message from its own file handle so that workers never share an
+// ecCodes handle with the UI thread.
+static codes_handle *OpenMessageCopy(const GribMessage &gm)
+{
+    GribMessage tmp;
+    tmp.filePath = gm.filePath;
+    tmp.fileOffset = gm.fileOffset;
+    tmp.messageSize = gm.messageSize;
+    return ReopenGribMessage(tmp);
+}
+
+// Sets the cropped/decimated geometry on 'dst' and gathers the kept values.
+static bool ApplyCropToHandle(const codes_handle *src, codes_handle *dst, const ExportTransform &t,
+                              const std::vector<double> &values, std::vector<double> &outValues,
+                              std::string &error)
+{
+    char gridType[64] = {0};
+    size_t len = sizeof(gridType);
+    codes_get_string(src, "gridType", gridType, &len);
+    long ni = 0, nj = 0, iNeg = 0, jCons = 0;
+    codes_get_long(src, "Ni", &ni);
+    codes_get_long(src, "Nj", &nj);
+    codes_get_long(src, "iScansNegatively", &iNeg);
+    codes_get_long(src, "jPointsAreConsecutive", &jCons);
+    if (strcmp(gridType, "regular_ll") != 0 || iNeg != 0 || jCons != 0 || ni <= 0 || nj <= 0 ||
+        values.size() != (size_t)ni * (size_t)nj)
+    {
+        error = "crop/decimate needs a regular lat/lon grid";
+        return false;
+    }
+    double lat1 = 0, lat2 = 0, lon1 = 0, lon2 = 0;
+    codes_get_double(src, "latitudeOfFirstGridPointInDegrees", &lat1);
+    codes_get_double(src, "latitudeOfLastGridPointInDegrees", &lat2);
+    codes_get_double(src, "longitudeOfFirstGridPointInDegrees", &lon1);
+    codes_get_double(src, "longitudeOfLastGridPointInDegrees", &lon2);
+    CropAxis rows, cols;
+    if (!ComputeLatAxis(lat1, lat2, nj, t, rows) || !ComputeLonAxis(lon1, lon2, ni, t, cols))
+    {
+        error = "crop box is outside the grid";
+        return false;
+    }
+    long outNi = cols.Size(), outNj = rows.Size();
+    outValues.resize((size_t)outNi * (size_t)outNj);
+    for (long r = 0; r < outNj; r++)
+    {
+        const double *srcRow = values.data() + (size_t)rows.Source(r, nj) * (size_t)ni;
+        double *dstRow = outValues.data() + (size_t)r * (size_t)outNi;
+        for (long c = 0; c < outNi; c++)
+            dstRow[c] = srcRow[cols.Source(c, ni)];
+    }
+    double latStep = nj > 1 ? (lat2 - lat1) / (double)(nj - 1) : 0.0;
+    double lonSpan = lon2 - lon1;
+    if (lonSpan < 0.0)
+        lonSpan += 360.0;
+    double lonStep = ni > 1 ? lonSpan / (double)(ni - 1) : 0.0;
+    double newLat1 = lat1 + latStep * (double)rows.first;
+    double newLat2 = newLat1 + latStep * (double)(rows.stride * (outNj - 1));
+    double newLon1 = fmod(lon1 + lonStep * (double)cols.first + 360.0, 360.0);
+    double newLon2 = fmod(newLon1 + lonStep * (double)(cols.stride * (outNi - 1)), 360.0);
+    if (lon1 < 0.0)
+    {
+        // Keep the source's -180..180 convention.
+        if (newLon1 > 180.0)
+            newLon1 -= 360.0;
+        if (newLon2 > 180.0)
+            newLon2 -= 360.0;
+    }
+    int err = 0;
+    err |= codes_set_long(dst, "Ni", outNi);
+    err |= codes_set_long(dst, "Nj", outNj);
+    err |= codes_set_double(dst, "latitudeOfFirstGridPointInDegrees", newLat1);
+    err |= codes_set_double(dst, "longitudeOfFirstGridPointInDegrees", newLon1);
+    err |= codes_set_double(dst, "latitudeOfLastGridPointInDegrees", newLat2);
+    err |= codes_set_double(dst, "longitudeOfLastGridPointInDegrees", newLon2);
+    err |= codes_set_double(dst, "iDirectionIncrementInDegrees", lonStep * (double)cols.stride);
+    err |= codes_set_double(dst, "jDirectionIncrementInDegrees", fabs(latStep) * (double)rows.stride);
+    if (err != 0)
+    {
+        error = "cannot set the cropped grid";
+        return false;
+    }
+    return true;
+}
+
+// Largest absolute difference between what was written and what decodes
+// back, ignoring points that are missing in both.
+static double MaxEncodingError(const void *encoded, size_t size, const std::vector<double> &expected,
+                               double missingValue)
+{
+    codes_handle *h = codes_handle_new_from_message(nullptr, encoded, size);
+    if (!h)
+        return std::numeric_limits<double>::infinity();
+    size_t n = 0;
+    std::vector<double> decoded;
+    if (codes_get_size(h, "values", &n) == 0 && n == expected.size())
+    {
+        decoded.resize(n);
+        if (codes_get_double_array(h, "values", decoded.data(), &n) != 0)
+            decoded.clear();
+    }
+    codes_handle_delete(h);
+    ScopedMemCharge charge(kMemDecoded, VectorBytes(decoded));
+    if (decoded.size() != expected.size())
+        return std::numeric_limits<double>::infinity();
+    double maxErr = 0.0;
+    for (size_t i = 0; i < decoded.size(); i++)
+    {
+        bool missA = expected[i] == missingValue, missB = decoded[i] == missingValue;
+        if (missA && missB)
+            continue;
+        if (missA != missB)
+            return std::numeric_limits<double>::infinity();
+        maxErr = std::max(maxErr, fabs(decoded[i] - expected[i]));
+    }
+    return maxErr;
+}
+
+static bool EncodeTransformedMessage(const GribMessage &gm, const ExportTransform &t,
+                                     std::vector<char> &out, size_t &inSize, double &maxError,
+                                     std::string &error)
+{
+    ScopedTrace trace("re-encode", "worker", gm.index);
+    maxError = 0.0;
+    codes_handle *src = OpenMessageCopy(gm);
+    if (!src)
+    {
+        error = "cannot read message " + std::to_string(gm.index);
+        return false;
+    }
+    codes_handle *dst = nullptr;
+    ScopedMemCharge decoded(kMemDecoded);
+    bool ok = false;
+    do
+    {
+        const void *buf = nullptr;
+        codes_get_message(src, &buf, &inSize);
+        size_t nvals = 0;
+        std::vector<double> values;
+        if (codes_get_size(src, "values", &nvals) == 0 && nvals > 0)
+        {
+            values.resize(nvals);
+            if (codes_get_double_array(src, "values", values.data(), &nvals) != 0)
+                values.clear();
+        }
+        decoded.Set(VectorBytes(values));
+        if (values.empty())
+        {
+            error = "message " + std::to_string(gm.index) + ": cannot decode values";
+            break;
+        }
+        double missingValue = 9999.0;
+        codes_get_double(src, "missingValue", &missingValue);
+        dst = codes_handle_clone(src);
+        if (!dst)
+        {
+            error = "cannot clone message " + std::to_string(gm.index);
+            break;
+        }
+        std::vector<double> outValues;
+        if (t.Reshapes())
+        {
+            if (!ApplyCropToHandle(src, dst, t, values, outValues, error))
+            {
+                error = "message " + std::to_string(gm.index) + ": " + error;
+                break;
+            }
+        }
+        else
+            outValues.swap(values);
+        decoded.Set(VectorBytes(values) + VectorBytes(outValues));
+        int err = 0;
+        if (t.packing > 0)
+        {
+            size_t plen = strlen(kRepackTypes[t.packing]);
+            err |= codes_set_string(dst, "packingType", kRepackTypes[t.packing], &plen);
+        }
+        if (t.bitsPerValue > 0)
+            err |= codes_set_long(dst, "bitsPerValue", t.bitsPerValue);
+        err |= codes_set_double_array(dst, "values", outValues.data(), outValues.size());
+        const void *encoded = nullptr;
+        size_t encodedSize = 0;
+        if (err != 0 || codes_get_message(dst, &encoded, &encodedSize) != 0 || !encoded)
+        {
+            error = "message " + std::to_string(gm.index) + ": re-encoding failed";
+            break;
+        }
+        if (t.tolerance > 0.0)
+        {
+            maxError = MaxEncodingError(encoded, encodedSize, outValues, missingValue);
+            if (!(maxError <= t.tolerance))
+            {
+                char msg[160];
+                snprintf(msg, sizeof(msg), "message %d: max error %g exceeds tolerance %g",
+                         gm.index, maxError, t.tolerance);
+                error = msg;
+                break;
+            }
+        }
+        out.assign((const char *)encoded, (const char *)encoded + encodedSize);
+        ok = true;
+    } while (false);
+    if (dst)
+        codes_handle_delete(dst);
+    codes_handle_delete(src);
+    return ok;
+}
+
+static bool SaveTransformedMessages(const std::vector<GribMessage *> &messages,
+                                    const std::string &outPath,
+                                    const ExportTransform &t,
+                                    TransformResult &result)
+{
+    result = TransformResult();
+    auto t0 = std::chrono::steady_clock::now();
+    FILE *out = fopen(outPath.c_str(), "wb");
+    if (!out)
+    {
+        result.error = "cannot create " + outPath;
+        return false;
+    }
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t batch = threads * 4;
+    std::vector<std::vector<char>> encoded(batch);
+    std::vector<size_t> inSizes(batch);
+    std::vector<double> maxErrors(batch);
+    std::vector<std::string> errors(batch);
+    for (size_t base = 0; base < messages.size() && result.error.empty(); base += batch)
+    {
+        size_t n = std::min(batch, messages.size() - base);
+        std::atomic<size_t> next{0};
+        std::atomic<bool> failed{false};
+        auto work = [&]()
+        {
+            for (size_t k = next++; k < n && !failed; k = next++)
+            {
+                errors[k].clear();
+                if (!EncodeTransformedMessage(*messages[base + k], t, encoded[k], inSizes[k], maxErrors[k], errors[k]))
+                    failed = true;
+            }
+        };
+        std::vector<std::thread> pool;
+        for (size_t w = 1; w < std::min(threads, n); w++)
+            pool.emplace_back(work);
+        work();
+        for (std::thread &th : pool)
+            th.join();
+        uint64_t batchBytes = 0;
+        for (size_t k = 0; k < n; k++)
+            batchBytes += encoded[k].capacity();
+        ScopedMemCharge staging(kMemStaging, batchBytes);
+        for (size_t k = 0; k < n; k++)
+        {
+            if (!errors[k].empty())
+            {
+                result.error = errors[k];
+                break;
+            }
+            if (fwrite(encoded[k].data(), 1, encoded[k].size(), out) != encoded[k].size())
+            {
+                result.error = "write failed for " + outPath;
+                break;
+            }
+            result.messages++;
+            result.bytesIn += inSizes[k];
+            result.bytesOut += encoded[k].size();
+            result.maxError = std::max(result.maxError, maxErrors[k]);
+        }
+    }
+    if (fclose(out) != 0 && result.error.empty())
+        result.error = "write failed for " + outPath;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    if (!result.error.empty())
+    {
+        remove(outPath.c_str());
+        result.messages = 0;
+        result.bytesIn = 0;
+        result.bytesOut = 0;
+        return false;
+    }
+    return true;
+}
+
+// Lat/lon box under a rectangle of canvas pixels (x0..x1, y0..y1 from the
+// canvas origin) for message gm, limited to the grid widened by 'margin'
+// pixels. east - west is the longitude span and may pass 360.
+static bool CanvasLatLonBox(const GribMessage &gm, float x0, float y0, float x1, float y1, float margin,
+                            ExportTransform &t)
+{
+    const GridGeometry &grid = *gm.grid;
+    if (g_Zoom <= 0.0f)
+        return false;
+    double pad = (double)(margin / g_Zoom);
+    auto texelX = [&](float x, double size) { return std::clamp((double)((x - g_OffsetX) / g_Zoom), -pad, size + pad); };
+    auto texelY = [&](float y, double size) { return std::clamp((double)((y - g_OffsetY) / g_Zoom), -pad, size + pad); };
+    std::shared_ptr<const GridWarp> warp = WarpOf(gm);
+    if (warp && warp->warped)
+    {
+        double u0 = texelX(x0, (double)warp->width), u1 = texelX(x1, (double)warp->width);
+        double v0 = texelY(y0, (double)warp->height), v1 = texelY(y1, (double)warp->height);
+        if (u1 <= u0 || v1 <= v0)
+            return false;
+        t.north = warp->north - (v0 - 0.5) * warp->step;
+        t.south = warp->north - (v1 - 0.5) * warp->step;
+        t.west = warp->west + (u0 - 0.5) * warp->step;
+        t.east = warp->west + (u1 - 0.5) * warp->step;
+        return true;
+    }
+    if (grid.Ni <= 1 || grid.Nj <= 1)
+        return false;
+    double i0 = texelX(x0, (double)(grid.Ni - 1)), i1 = texelX(x1, (double)(grid.Ni - 1));
+    double j0 = texelY(y0, (double)(grid.Nj - 1)), j1 = texelY(y1, (double)(grid.Nj - 1));
+    if (i1 <= i0 || j1 <= j0)
+        return false;
+    double lonSpan = grid.lon2 - grid.lon1;
+    if (lonSpan < 0.0)
+        lonSpan += 360.0;
+    double lonStep = lonSpan / (double)(grid.Ni - 1);
+    double latStep = (grid.lat2 - grid.lat1) / (double)(grid.Nj - 1);
+    double latA = grid.lat1 + latStep * j0, latB = grid.lat1 + latStep * j1;
+    t.north = std::max(latA, latB);
+    t.south = std::min(latA, latB);
+    t.west = grid.lon1 + lonStep * i0;
+    t.east = grid.lon1 + lonStep * i1;
+    return true;
+}
+
+// Lat/lon box currently visible on the canvas, for the "Use viewport" button.
+static bool ViewportLatLonBox(ExportTransform &t)
+{
+    if (g_SelectedMessageIndex < 0 || g_SelectedMessageIndex >= (int)g_GribMessages.size() || g_CanvasSize.x <= 0.0f)
+        return false;
+    return CanvasLatLonBox(g_GribMessages[g_SelectedMessageIndex], 0.0f, 0.0f, g_CanvasSize.x, g_CanvasSize.y, 0.0f, t);
+}
+
+// ----------------------------------------------------------
+// Regions
+// Boxes and polygons (straight edges in lat/lon, as drawn on the canvas)
+// whose area statistics are extracted for every message in the view. The
+// grid points inside a region are found once per grid and kept as runs of
+// consecutive points, each with its cos(lat) area weight; a message then
+// costs one pass over those runs. Messages are decoded in parallel, a
+// batch per frame. A point on the outline counts as inside, for the row
+// scans and the per-point test alike.
+// ----------------------------------------------------------
+static const double kRegionEdgeTolerance = 1e-9; // degrees
+static int g_RegionMode = 0; // 1: dragging a box, 2: clicking polygon vertices
+static std::vector<std::pair<double, double>> g_RegionDraft;
+static float g_RegionDraftX = 0.0f; // screen x of the box's first corner
+static double g_RegionPercentile = 90.0;
+static bool g_RegionsRunning = false;
+static size_t g_RegionsNextRow = 0;
+static std::string g_RegionsStatus;
+
+static void ClearRegionSeries()
+{
+    for (Region &r : g_Regions)
+    {
+        r.series.clear();
+        r.masks.clear();
+        r.current.messageIndex = -1;
+    }
+    g_RegionsRunning = false;
+}
+
+// Longitudes made continuous along the outline, so a region across the
+// date line is one piece.
+static void AddRegion(bool box, std::vector<std::pair<double, double>> vertices)
+{
+    for (size_t k = 1; k < vertices.size(); k++)
+    {
+        double &lon = vertices[k].second;
+        lon = vertices[k - 1].second + remainder(lon - vertices[k - 1].second, 360.0);
+    }
+    Region r;
+    r.id = g_Regions.empty() ? 1 : g_Regions.back().id + 1;
+    r.box = box;
+    r.vertices = std::move(vertices);
+    g_Regions.push_back(std::move(r));
+}
+
+// Box from two corners; 'west' is the corner that was on the left.
+static void AddBoxRegion(double lat0, double west, double lat1, double east)
+{
+    if (east <= west)
+        east += 360.0;
+    double south = std::min(lat0, lat1), north = std::max(lat0, lat1);
+    AddRegion(true, {{north, west}, {north, east}, {south, east}, {south, west}});
+}
+
+// Where the parallel at 'lat' meets the region: sorted, disjoint pairs of
+// unwrapped longitudes, both ends included. The even-odd rule (half-open in
+// latitude) gives the inside; vertices and edges lying on the parallel are
+// added to it, so the north edge of a box is kept like the south one.
+static void RegionCrossings(const Region &r, double lat, std::vector<double> &xs)
+{
+    xs.clear();
+    size_t n = r.vertices.size();
+    for (size_t k = 0; k < n; k++)
+    {
+        const auto &a = r.vertices[k], &b = r.vertices[(k + 1) % n];
+        if ((a.first <= lat) != (b.first <= lat))
+            xs.push_back(a.second + (lat - a.first) / (b.first - a.first) * (b.second - a.second));
+    }
+    std::sort(xs.begin(), xs.end());
+    std::vector<std::pair<double, double>> spans;
+    for (size_t p = 0; p + 1 < xs.size(); p += 2)
+        spans.push_back({xs[p], xs[p + 1]});
+    size_t crossings = spans.size();
+    for (size_t k = 0; k < n; k++)
+    {
+        const auto &a = r.vertices[k], &b = r.vertices[(k + 1) % n];
+        if (std::abs(a.first - lat) > kRegionEdgeTolerance)
+            continue;
+        if (std::abs(b.first - lat) <= kRegionEdgeTolerance)
+            spans.push_back(std::minmax(a.second, b.second));
+        else
+            spans.push_back({a.second, a.second});
+    }
+    if (spans.size() == crossings)
+        return;
+    std::sort(spans.begin(), spans.end());
+    xs.clear();
+    for (const auto &span : spans)
+    {
+        if (!xs.empty() && span.first <= xs.back() + kRegionEdgeTolerance)
+            xs.back() = std::max(xs.back(), span.second);
+        else
+        {
+            xs.push_back(span.first);
+            xs.push_back(span.second);
+        }
+    }
+}
+
+// True if (lat, lon) lies on the edge a-b.
+static bool OnRegionEdge(const std::pair<double, double> &a, const std::pair<double, double> &b, double lat,
+                         double lon)
+{
+    const double eps = kRegionEdgeTolerance;
+    if (lat < std::min(a.first, b.first) - eps || lat > std::max(a.first, b.first) + eps)
+        return false;
+    if (std::abs(b.first - a.first) <= eps)
+        return lon >= std::min(a.second, b.second) - eps && lon <= std::max(a.second, b.second) + eps;
+    return std::abs(lon - (a.second + (lat - a.first) / (b.first - a.first) * (b.second - a.second))) <= eps;
+}
+
+// Appends the runs of one grid row (count points from lon0 every dlon)
+// that fall inside the crossings.
+static void AppendRowRuns(RegionMask &mask, const std::vector<double> &xs, uint32_t first, long count, double lon0,
+                          double dlon, bool global, float weight)
+{
+    auto emit = [&](long k0, long k1)
+    {
+        if (k0 > k1)
+            return;
+        mask.runs.push_back({first + (uint32_t)k0, (uint32_t)(k1 - k0 + 1), weight});
+        mask.points += (size_t)(k1 - k0 + 1);
+    };
+    for (size_t p = 0; p + 1 < xs.size(); p += 2)
+    {
+        if (global)
+        {
+            long k0 = (long)std::ceil((xs[p] - lon0) / dlon - 1e-9), k1 = (long)std::floor((xs[p + 1] - lon0) / dlon + 1e-9);
+            if (k1 < k0)
+                continue; // between two points
+            if (k1 - k0 + 1 >= count)
+            {
+                emit(0, count - 1);
+                continue;
+            }
+            k0 = ((k0 % count) + count) % count;
+            k1 = ((k1 % count) + count) % count;
+            if (k1 >= k0)
+                emit(k0, k1);
+            else
+            {
+                emit(k0, count - 1);
+                emit(0, k1);
+            }
+            continue;
+        }
+        for (double shift : {-360.0, 0.0, 360.0})
+        {
+            long k0 = (long)std::ceil((xs[p] + shift - lon0) / dlon - 1e-9);
+            long k1 = (long)std::floor((xs[p + 1] + shift - lon0) / dlon + 1e-9);
+            emit(std::max(k0, 0L), std::min(k1, count - 1));
+        }
+    }
+}
+
+// Grids without lat/lon rows: every point is tested, with the edges
+// bucketed by latitude band so each test looks at a few of them.
+static void BuildPointMask(codes_handle *h, const Region &r, RegionMask &mask)
+{
+    size_t n = 0;
+    if (codes_get_size(h, "values", &n) != 0 || n == 0)
+        return;
+    std::vector<double> lats(n), lons(n);
+    size_t nLat = n, nLon = n;
+    if (codes_get_double_array(h, "latitudes", lats.data(), &nLat) != 0 ||
+        codes_get_double_array(h, "longitudes", lons.data(), &nLon) != 0 || nLat != n || nLon != n)
+        return;
+    double south = 90.0, north = -90.0, west = 1e9, east = -1e9;
+    for (const auto &v : r.vertices)
+    {
+        south = std::min(south, v.first);
+        north = std::max(north, v.first);
+        west = std::min(west, v.second);
+        east = std::max(east, v.second);
+    }
+    const int bands = 64;
+    double bandHeight = std::max(1e-9, (north - south) / bands);
+    std::vector<std::vector<size_t>> edges(bands);
+    size_t nv = r.vertices.size();
+    for (size_t k = 0; k < nv; k++)
+    {
+        double a = r.vertices[k].first, b = r.vertices[(k + 1) % nv].first;
+        int b0 = std::clamp((int)((std::min(a, b) - south) / bandHeight), 0, bands - 1);
+        int b1 = std::clamp((int)((std::max(a, b) - south) / bandHeight), 0, bands - 1);
+        for (int band = b0; band <= b1; band++)
+            edges[band].push_back(k);
+    }
+    double centre = 0.5 * (west + east);
+    std::vector<unsigned char> inside(n, 0);
+    ParallelSlices(n, [&](size_t firstPoint, size_t lastPoint)
+    {
+        for (size_t p = firstPoint; p < lastPoint; p++)
+        {
+            double lat = lats[p];
+            if (lat < south - kRegionEdgeTolerance || lat > north + kRegionEdgeTolerance)
+                continue;
+            double lon = centre + remainder(lons[p] - centre, 360.0);
+            bool in = false, onEdge = false;
+            for (size_t k : edges[std::clamp((int)((lat - south) / bandHeight), 0, bands - 1)])
+            {
+                const auto &a = r.vertices[k], &b = r.vertices[(k + 1) % nv];
+                if ((a.first <= lat) != (b.first <= lat) &&
+                    lon < a.second + (lat - a.first) / (b.first - a.first) * (b.second - a.second))
+                    in = !in;
+                onEdge = onEdge || OnRegionEdge(a, b, lat, lon);
+            }
+            inside[p] = in || onEdge;
+        }
+    });
+    const double rad = 3.14159265358979323846 / 180.0;
+    for (size_t p = 0; p < n; p++)
+    {
+        if (!inside[p])
+            continue;
+        if (p > 0 && inside[p - 1])
+            mask.runs.back().count++;
+        else
+            mask.runs.push_back({(uint32_t)p, 1, 0.0f});
+        mask.pointWeights.push_back((float)cos(lats[p] * rad));
+        mask.points++;
+    }
+}
+
+static std::shared_ptr<const RegionMask> BuildRegionMask(GribMessage &gm, const Region &r)
+{
+    auto mask = std::make_shared<RegionMask>();
+    std::shared_ptr<const GridWarp> warp = AcquireGridWarp(gm);
+    if (!warp->error.empty() || r.vertices.size() < 3)
+        return mask;
+    const double rad = 3.14159265358979323846 / 180.0;
+    std::vector<double> xs;
+    const GridGeometry &grid = *gm.grid;
+    if (!warp->warped)
+    {
+        if (grid.Ni <= 1 || grid.Nj <= 1)
+            return mask;
+        double span = grid.lon2 - grid.lon1;
+        if (span <= 0.0)
+            span += 360.0;
+        double lonStep = span / (double)(grid.Ni - 1);
+        double latStep = (grid.lat2 - grid.lat1) / (double)(grid.Nj - 1);
+        bool global = span + lonStep >= 359.999;
+        for (long j = 0; j < grid.Nj; j++)
+        {
+            double lat = grid.lat1 + (double)j * latStep;
+            RegionCrossings(r, lat, xs);
+            AppendRowRuns(*mask, xs, (uint32_t)(j * grid.Ni), grid.Ni, grid.lon1, lonStep, global, (float)cos(lat * rad));
+        }
+    }
+    else if (!warp->rowStart.empty())
+    {
+        for (size_t row = 0; row + 1 < warp->rowStart.size(); row++)
+        {
+            long count = (long)(warp->rowStart[row + 1] - warp->rowStart[row]);
+            if (count <= 0)
+                continue;
+            double lat = warp->rowLat[row];
+            double dlon = warp->global ? 360.0 / (double)count : warp->rowSpan / (double)std::max(1L, count - 1);
+            RegionCrossings(r, lat, xs);
+            AppendRowRuns(*mask, xs, warp->rowStart[row], count, warp->rowWest, dlon, warp->global, (float)cos(lat * rad));
+        }
+    }
+    else if (codes_handle *h = EnsureMessageHandle(gm))
+        BuildPointMask(h, r, *mask);
+    return mask;
+}
+
+static std::shared_ptr<const RegionMask> RegionMaskFor(Region &r, GribMessage &gm)
+{
+    for (const auto &entry : r.masks)
+    {
+        if (entry.first == gm.grid)
+            return entry.second;
+    }
+    r.masks.emplace_back(gm.grid, BuildRegionMask(gm, r));
+    return r.masks.back().second;
+}
+
+// Area-weighted mean and percentile, plain min and max, over the valid
+// points of the mask. 'scratch' is reused between calls.
+static void RegionStats(const RegionMask &mask, const std::vector<double> &data, double percentile, RegionSample &out,
+                        std::vector<std::pair<double, float>> &scratch)
+{
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    out.mean = out.min = out.max = out.percentile = nan;
+    out.points = 0;
+    scratch.clear();
+    double sum = 0.0, weights = 0.0, lo = std::numeric_limits<double>::infinity(), hi = -lo;
+    size_t k = 0;
+    for (const RegionRun &run : mask.runs)
+    {
+        for (uint32_t p = run.first; p < run.first + run.count; p++, k++)
+        {
+            if (p >= data.size())
+                return;
+            double v = data[p];
+            if (std::isnan(v))
+                continue;
+            float w = mask.pointWeights.empty() ? run.weight : mask.pointWeights[k];
+            sum += (double)w * v;
+            weights += w;
+            lo = std::min(lo, v);
+            hi = std::max(hi, v);
+            scratch.emplace_back(v, w);
+        }
+    }
+    if (scratch.empty() || weights <= 0.0)
+        return;
+    out.points = (uint32_t)scratch.size();
+    out.mean = sum / weights;
+    out.min = lo;
+    out.max = hi;
+    std::sort(scratch.begin(), scratch.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+    double target = std::clamp(percentile, 0.0, 100.0) / 100.0 * weights, cumulative = 0.0;
+    out.percentile = scratch.back().first;
+    for (const auto &[v, w] : scratch)
+    {
+        cumulative += w;
+        if (cumulative >= target)
+        {
+            out.percentile = v;
+            break;
+        }
+    }
+}
+
+static void StartRegionExtraction()
+{
+    if (g_Regions.empty() || g_ViewRows.empty())
+        return;
+    ClearRegionSeries();
+    g_RegionsNextRow = 0;
+    g_RegionsRunning = true;
+    g_RegionsStatus = "Extracting...";
+}
+
+// One batch of messages per frame: masks are looked up (or built) here,
+// since building may need the message's handle; workers then decode their
+// own copies and reduce them.
+static void StepRegionExtraction()
+{
+    if (!g_RegionsRunning)
+        return;
+    if (g_Regions.empty() || g_RegionsNextRow >= g_ViewRows.size())
+    {
+        g_RegionsRunning = false;
+        g_RegionsStatus = g_Regions.empty() ? "No regions" : "Extraction done";
+        return;
+    }
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t n = std::min(threads * 2, g_ViewRows.size() - g_RegionsNextRow);
+    size_t regions = g_Regions.size();
+    std::vector<int> batch(g_ViewRows.begin() + (long)g_RegionsNextRow, g_ViewRows.begin() + (long)(g_RegionsNextRow + n));
+    std::vector<std::shared_ptr<const RegionMask>> masks(n * regions);
+    for (size_t k = 0; k < n; k++)
+    {
+        for (size_t r = 0; r < regions; r++)
+            masks[k * regions + r] = RegionMaskFor(g_Regions[r], g_GribMessages[batch[k]]);
+    }
+    std::vector<RegionSample> samples(n * regions);
+    double percentile = g_RegionPercentile;
+    std::atomic<size_t> next{0};
+    auto work = [&]()
+    {
+        std::vector<double> data;
+        std::vector<std::pair<double, float>> scratch;
+        for (size_t k = next++; k < n; k = next++)
+        {
+            const GribMessage &gm = g_GribMessages[batch[k]];
+            ScopedTrace trace("region stats", "worker", gm.index);
+            data.clear();
+            if (codes_handle *h = OpenMessageCopy(gm))
+            {
+                double mn, mx;
+                GetMessageValuesAndRange(h, data, mn, mx);
+                codes_handle_delete(h);
+            }
+            ScopedMemCharge decoded(kMemDecoded, VectorBytes(data));
+            for (size_t r = 0; r < regions; r++)
+            {
+                RegionSample &s = samples[k * regions + r];
+                RegionStats(*masks[k * regions + r], data, percentile, s, scratch);
+                s.messageIndex = batch[k];
+            }
+        }
+    };
+    std::vector<std::thread> pool;
+    for (size_t w = 1; w < std::min(threads, n); w++)
+        pool.emplace_back(work);
+    work();
+    for (std::thread &th : pool)
+        th.join();
+    for (size_t k = 0; k < n; k++)
+    {
+        for (size_t r = 0; r < regions; r++)
+            g_Regions[r].series.push_back(samples[k * regions + r]);
+    }
+    g_RegionsNextRow += n;
+    g_RegionsStatus = "Frame " + std::to_string(g_RegionsNextRow) + "/" + std::to_string(g_ViewRows.size());
+}
+
+// Screen positions of an outline on the shown raster. The first vertex is
+// placed the way the grid places it and the rest follow at the raster's
+// constant scale, so an outline across the raster's seam stays in one piece.
+static bool RegionOutlineToScreen(const GribMessage &gm, const std::vector<std::pair<double, double>> &vertices,
+                                  float contentX, float contentY, std::vector<ImVec2> &out)
+{
+    out.clear();
+    if (vertices.empty())
+        return false;
+    std::shared_ptr<const GridWarp> warp = WarpOf(gm);
+    const GridGeometry &grid = *gm.grid;
+    double x0, perLon, perLat, latOrigin;
+    if (warp && warp->warped)
+    {
+        x0 = fmod(fmod(vertices[0].second - warp->west, 360.0) + 360.0, 360.0) / warp->step + 0.5;
+        perLon = 1.0 / warp->step;
+        perLat = -1.0 / warp->step;
+        latOrigin = warp->north + 0.5 * warp->step;
+    }
+    else
+    {
+        double fi, fj;
+        int ii, jj;
+        if (!LatLonToGrid(gm, vertices[0].first, vertices[0].second, fi, fj, ii, jj))
+            return false;
+        double lonRange = grid.lon2 - grid.lon1;
+        if (lonRange <= 0.0)
+            lonRange += 360.0;
+        double pixels = (double)(grid.Ni - 1), rows = (double)(grid.Nj - 1);
+        x0 = fi * pixels;
+        perLon = pixels / lonRange;
+        perLat = (grid.lat1 > grid.lat2 ? -rows : rows) / fabs(grid.lat1 - grid.lat2);
+        latOrigin = grid.lat1;
+    }
+    double lon = vertices[0].second;
+    for (const auto &[vlat, vlon] : vertices)
+    {
+        lon += remainder(vlon - lon, 360.0);
+        double x = x0 + (lon - vertices[0].second) * perLon, y = (vlat - latOrigin) * perLat;
+        out.emplace_back(contentX + g_OffsetX + (float)x * g_Zoom, contentY + g_OffsetY + (float)y * g_Zoom);
+    }
+    return true;
+}
+
+static void RemoveRegionAt(size_t idx)
+{
+    if (idx >= g_Regions.size())
+        return;
+    g_Regions.erase(g_Regions.begin() + (long)idx);
+    g_RegionsRunning = false;
+}
+
+static bool SaveRegionsCsv()
+{
+    ScopedTrace trace("csv write", "io");
+    if (g_Regions.empty() || g_GribMessages.empty())
+        return false;
+    FILE *f = fopen(g_RegionsCsvPath, "w");
+    if (!f)
+        return false;
+    fprintf(f, "regionID");
+    for (const auto &col : g_UiState.displayedKeys)
+        fprintf(f, ",%s", col.c_str());
+    fprintf(f, ",mean,min,max,p%g,points\n", g_RegionPercentile);
+    auto number = [&](double v)
+    {
+        if (std::isnan(v))
+            fprintf(f, ",");
+        else
+            fprintf(f, ",%.10g", v);
+    };
+    for (const Region &r : g_Regions)
+    {
+        for (const RegionSample &s : r.series)
+        {
+            GribMessage *gm = (s.messageIndex >= 0 && s.messageIndex < (int)g_GribMessages.size())
+                                  ? &g_GribMessages[s.messageIndex]
+                                  : nullptr;
+            fprintf(f, "R%d", r.id);
+            for (const auto &col : g_UiState.displayedKeys)
+            {
+                fprintf(f, ",");
+                if (gm)
+                {
+                    auto it = gm->keyValueMap.find(col);
+                    if (it != gm->keyValueMap.end())
+                        fprintf(f, "%s", it->second.c_str());
+                }
+            }
+            number(s.mean);
+            number(s.min);
+            number(s.max);
+            number(s.percentile);
+            fprintf(f, ",%u\n", s.points);
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+// ----------------------------------------------------------
+// Vertical profiles
+// A marker's values across the levels of one parameter. The hypercube
+// coordinates pick the messages: the active message fixes parameter, level
+// type, member and run (dataDate/dataTime, which the hypercube does not
+// separate), and the levels are walked at its validity time, or at every
+// validity time for the time x level matrix. Only rows shown in the table
+// are used. Cells are decoded in parallel, a batch per frame, like the
+// region statistics.
+// ----------------------------------------------------------
+static bool g_ShowProfile = false;
+static int g_ProfileMarker = 0;
+static int g_ProfileTime = 0; // row shown in the plot
+static std::string g_ProfileStatus;
+
+static void ClearProfile()
+{
+    g_Profile = ProfileMatrix();
+    g_ProfileTime = 0;
+}
+
+// Levels that grow downwards (pressure, model levels) are drawn top-down.
+static bool ProfileLevelsDescend(const std::string &levelType)
+{
+    return levelType.rfind("isobaric", 0) == 0 || levelType == "hybrid";
+}
+
+static void StartProfileExtraction(bool allTimes)
+{
+    const HypercubeIndex &hc = g_Hypercube;
+    int cur = g_SelectedMessageIndex;
+    if (!hc.valid || cur < 0 || cur >= (int)g_GribMessages.size())
+    {
+        g_ProfileStatus = "Select a message first";
+        return;
+    }
+    if (g_ProfileMarker < 0 || g_ProfileMarker >= (int)g_Markers.size())
+    {
+        g_ProfileStatus = "Add a marker first";
+        return;
+    }
+    ClearProfile();
+    ProfileMatrix &p = g_Profile;
+    p.probe = g_Markers[g_ProfileMarker];
+    p.probe.series.clear();
+    p.probe.stencils.clear();
+    p.parameter = hc.values[kDimParameter][hc.Coord(cur, kDimParameter)];
+    p.levelType = hc.values[kDimLevelType][hc.Coord(cur, kDimLevelType)];
+
+    // Each (time, level) cell takes the first matching row of the view, or
+    // the selected message in its own cell. A hidden duplicate therefore
+    // leaves its level to a visible one instead of taking the level out.
+    const GribMessage &sel = g_GribMessages[cur];
+    uint32_t curTime = hc.Coord(cur, kDimValidity);
+    size_t timeCount = hc.values[kDimValidity].size(), levelCount = hc.values[kDimLevel].size();
+    size_t indexed = hc.coords.size() / kHypercubeDims;
+    std::vector<int> cellMsg(timeCount * levelCount, -1);
+    for (int msg : g_ViewRows)
+    {
+        if (msg < 0 || (size_t)msg >= indexed)
+            continue;
+        const GribMessage &gm = g_GribMessages[msg];
+        uint32_t t = hc.Coord(msg, kDimValidity);
+        if ((!allTimes && t != curTime) || gm.dataDate != sel.dataDate || gm.dataTime != sel.dataTime ||
+            hc.Coord(msg, kDimParameter) != hc.Coord(cur, kDimParameter) ||
+            hc.Coord(msg, kDimLevelType) != hc.Coord(cur, kDimLevelType) ||
+            hc.Coord(msg, kDimMember) != hc.Coord(cur, kDimMember))
+            continue;
+        int &slot = cellMsg[(size_t)t * levelCount + hc.Coord(msg, kDimLevel)];
+        if (slot < 0 || msg == cur)
+            slot = msg;
+    }
+    std::vector<int> cells;
+    std::vector<char> levelUsed(levelCount, 0);
+    for (uint32_t t = 0; t < (uint32_t)timeCount; t++)
+    {
+        const int *row = cellMsg.data() + (size_t)t * levelCount;
+        bool any = false;
+        for (size_t l = 0; l < levelCount; l++)
+        {
+            if (row[l] < 0)
+                continue;
+            levelUsed[l] = 1;
+            any = true;
+        }
+        if (!any)
+            continue;
+        if (t == curTime)
+            g_ProfileTime = (int)p.times.size();
+        p.times.push_back(hc.values[kDimValidity][t]);
+        cells.insert(cells.end(), row, row + levelCount);
+    }
+    // Only the levels this parameter has; numeric labels are already in order.
+    std::vector<size_t> keep;
+    for (size_t l = 0; l < levelCount; l++)
+    {
+        if (!levelUsed[l])
+            continue;
+        keep.push_back(l);
+        double v = std::numeric_limits<double>::quiet_NaN();
+        parseDouble(hc.values[kDimLevel][l], v);
+        p.levels.push_back(hc.values[kDimLevel][l]);
+        p.levelValues.push_back(v);
+    }
+    for (size_t t = 0; t < p.times.size(); t++)
+    {
+        for (size_t l : keep)
+            p.messages.push_back(cells[t * levelCount + l]);
+    }
+    p.values.assign(p.messages.size(), std::numeric_limits<double>::quiet_NaN());
+    if (p.levels.empty())
+    {
+        g_ProfileStatus = "No levels for this parameter";
+        return;
+    }
+    p.running = true;
+    g_ProfileStatus = "Extracting...";
+}
+
+static void StepProfileExtraction()
+{
+    ProfileMatrix &p = g_Profile;
+    if (!p.running)
+        return;
+    while (p.next < p.messages.size() && p.messages[p.next] < 0)
+        p.next++;
+    if (p.next >= p.messages.size())
+    {
+        p.running = false;
+        g_ProfileStatus = std::to_string(p.times.size()) + " x " + std::to_string(p.levels.size()) + " extracted";
+        return;
+    }
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<size_t> batch;
+    for (; p.next < p.messages.size() && batch.size() < threads * 2; p.next++)
+    {
+        int msg = p.messages[p.next];
+        if (msg < 0)
+            continue;
+        // Warps and stencils are built here, so the workers only read them.
+        GribMessage &gm = g_GribMessages[msg];
+        AcquireGridWarp(gm);
+        if (p.probe.interp != kInterpNearest)
+            MarkerStencil(p.probe, gm);
+        batch.push_back(p.next);
+    }
+    std::atomic<size_t> next{0};
+    auto work = [&]()
     {
-        const Marker &m = g_Markers[mi];
-        ImU32 col = MarkerColor((int)mi);
-        ImVec2 prev;
-        bool hasPrev = false;
-        for (size_t k = 0; k < m.series.size(); k++)
+        std::vector<double> data;
+        for (size_t k = next++; k < batch.size(); k = next++)
         {
-            const MarkerSample &s = m.series[k];
-            if (std::isnan(s.value))
+            GribMessage &gm = g_GribMessages[p.messages[batch[k]]];
+            ScopedTrace trace("profile", "worker", gm.index);
+            data.clear();
+            if (codes_handle *h = OpenMessageCopy(gm))
             {
-                hasPrev = false;
-                continue;
+                double mn, mx;
+                GetMessageValuesAndRange(h, data, mn, mx);
+                codes_handle_delete(h);
             }
-            ImVec2 p = toScreen(k, s.value);
-            if (hasPrev)
-                dl->AddLine(prev, p, col, 2.0f);
-            prev = p;
-            hasPrev = true;
+            ScopedMemCharge decoded(kMemDecoded, VectorBytes(data));
+            double v = 0.0;
+            if (!data.empty() && SampleMarker(p.probe, gm, data, v))
+                p.values[batch[k]] = v;
         }
+    };
+    std::vector<std::thread> pool;
+    for (size_t w = 1; w < std::min(threads, batch.size()); w++)
+        pool.emplace_back(work);
+    work();
+    for (std::thread &th : pool)
+        th.join();
+    g_ProfileStatus = "Cell " + std::to_string(p.next) + "/" + std::to_string(p.messages.size());
+}
+
+static void FprintCsvValue(FILE *f, double v)
+{
+    if (std::isnan(v))
+        fprintf(f, ",");
+    else
+        fprintf(f, ",%.10g", v);
+}
+
+// One line per level of the plotted time.
+static bool SaveProfileCsv()
+{
+    ScopedTrace trace("csv write", "io");
+    const ProfileMatrix &p = g_Profile;
+    if (p.times.empty() || g_ProfileTime < 0 || g_ProfileTime >= (int)p.times.size())
+        return false;
+    FILE *f = fopen(g_ProfileCsvPath, "w");
+    if (!f)
+        return false;
+    fprintf(f, "markerID,lat,lon,shortName,typeOfLevel,validity,level,value\n");
+    std::string id = p.probe.name.empty() ? "M" + std::to_string(p.probe.id) : p.probe.name;
+    for (size_t l = 0; l < p.levels.size(); l++)
+    {
+        FprintCsvText(f, id);
+        fprintf(f, ",%.6f,%.6f,%s,%s,%s,%s", p.probe.lat, p.probe.lon, p.parameter.c_str(),
+                p.levelType.c_str(), p.times[g_ProfileTime].c_str(), p.levels[l].c_str());
+        FprintCsvValue(f, p.values[(size_t)g_ProfileTime * p.levels.size() + l]);
+        fprintf(f, "\n");
     }
-    // Draw extrema annotations near the right edge using the series color.
-    float textLineHeight = ImGui::GetTextLineHeight();
+    fclose(f);
+    return true;
+}
+
+// Time x level matrix: one line per validity time, one column per level.
+static bool SaveProfileMatrixCsv()
+{
+    ScopedTrace trace("csv write", "io");
+    const ProfileMatrix &p = g_Profile;
+    if (p.times.empty())
+        return false;
+    FILE *f = fopen(g_ProfileCsvPath, "w");
+    if (!f)
+        return false;
+    fprintf(f, "validity");
+    for (const std::string &level : p.levels)
+        fprintf(f, ",%s", level.c_str());
+    fprintf(f, "\n");
+    for (size_t t = 0; t < p.times.size(); t++)
+    {
+        fprintf(f, "%s", p.times[t].c_str());
+        for (size_t l = 0; l < p.levels.size(); l++)
+            FprintCsvValue(f, p.values[t * p.levels.size() + l]);
+        fprintf(f, "\n");
+    }
+    fclose(f);
+    return true;
+}
+
+// Value across, level down (or up); pressure levels on a log axis.
+static void DrawProfilePlot(const ImVec2 &size)
+{
+    const ProfileMatrix &p = g_Profile;
+    ImDrawList *dl = ImGui::GetWindowDrawList();
+    ImVec2 plotMin = ImGui::GetCursorScreenPos();
+    ImVec2 plotMax(plotMin.x + size.x, plotMin.y + size.y);
+    ImGui::InvisibleButton("ProfilePlot", size);
+    bool hovered = ImGui::IsItemHovered();
+    bool clicked = ImGui::IsItemClicked(ImGuiMouseButton_Left);
+    dl->AddRectFilled(plotMin, plotMax, IM_COL32(30, 30, 30, 255));
+    dl->AddRect(plotMin, plotMax, IM_COL32(80, 80, 80, 255));
+    size_t levels = p.levels.size();
+    if (levels == 0 || g_ProfileTime < 0 || g_ProfileTime >= (int)p.times.size())
+        return;
+    const double *row = p.values.data() + (size_t)g_ProfileTime * levels;
+    bool logAxis = p.levelType.rfind("isobaric", 0) == 0;
+    bool numeric = true;
+    for (double v : p.levelValues)
+        numeric = numeric && std::isfinite(v) && (!logAxis || v > 0.0);
+    auto levelCoord = [&](size_t l) { return numeric ? (logAxis ? log(p.levelValues[l]) : p.levelValues[l]) : (double)l; };
+    double lMin = levelCoord(0), lMax = levelCoord(levels - 1);
+    if (lMax - lMin < 1e-12)
+    {
+        lMin -= 1.0;
+        lMax += 1.0;
+    }
+    double vMin = std::numeric_limits<double>::infinity(), vMax = -vMin;
+    for (size_t l = 0; l < levels; l++)
+    {
+        if (std::isnan(row[l]))
+            continue;
+        vMin = std::min(vMin, row[l]);
+        vMax = std::max(vMax, row[l]);
+    }
+    if (!std::isfinite(vMin) || vMax - vMin < 1e-12)
+    {
+        vMin = std::isfinite(vMin) ? vMin - 1.0 : -1.0;
+        vMax = vMin + 2.0;
+    }
+    double pad = (vMax - vMin) * 0.05;
+    vMin -= pad;
+    vMax += pad;
+    const float left = 56.0f, margin = 10.0f; // room for the level labels
+    bool topDown = ProfileLevelsDescend(p.levelType) == (lMax > lMin);
+    auto toScreen = [&](size_t l, double value)
+    {
+        float t = (float)((levelCoord(l) - lMin) / (lMax - lMin));
+        float y = topDown ? plotMin.y + margin + t * (size.y - 2.0f * margin)
+                          : plotMax.y - margin - t * (size.y - 2.0f * margin);
+        float x = plotMin.x + left + (float)((value - vMin) / (vMax - vMin)) * (size.x - left - margin);
+        return ImVec2(x, y);
+    };
+    ImU32 grid = IM_COL32(120, 120, 120, 120), text = IM_COL32(230, 230, 230, 255);
+    float lastLabelY = -1e9f;
+    for (size_t l = 0; l < levels; l++)
+    {
+        float y = toScreen(l, vMin).y;
+        dl->AddLine(ImVec2(plotMin.x + left, y), ImVec2(plotMax.x, y), grid);
+        if (fabs(y - lastLabelY) >= ImGui::GetTextLineHeight())
+        {
+            dl->AddText(ImVec2(plotMin.x + 4, y - 7), text, p.levels[l].c_str());
+            lastLabelY = y;
+        }
+    }
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.4g", vMin + pad);
+    dl->AddText(ImVec2(plotMin.x + left, plotMax.y - 16), text, buf);
+    snprintf(buf, sizeof(buf), "%.4g", vMax - pad);
+    dl->AddText(ImVec2(plotMax.x - ImGui::CalcTextSize(buf).x - 4, plotMax.y - 16), text, buf);
+    ImU32 col = IM_COL32(255, 210, 60, 255);
     for (size_t mi = 0; mi < g_Markers.size(); mi++)
     {
-        const SeriesExtrema &ex = extrema[mi];
-        if (!ex.hasValue)
+        if (g_Markers[mi].id == p.probe.id)
+            col = MarkerColor((int)mi);
+    }
+    ImVec2 prev;
+    bool hasPrev = false;
+    int nearest = -1;
+    float nearestDy = 1e9f;
+    ImVec2 mouse = ImGui::GetIO().MousePos;
+    for (size_t l = 0; l < levels; l++)
+    {
+        if (std::isnan(row[l]))
+        {
+            hasPrev = false;
             continue;
-        ImU32 col = MarkerColor((int)mi);
-        ImVec4 colVec = ImGui::ColorConvertU32ToFloat4(col);
-        char maxBuf[32];
-        char minBuf[32];
-        snprintf(maxBuf, sizeof(maxBuf), "max %.2f", ex.maxVal);
-        snprintf(minBuf, sizeof(minBuf), "min %.2f", ex.minVal);
-        ImVec2 maxPos = toScreen(ex.maxIdx, ex.maxVal);
-        ImVec2 minPos = toScreen(ex.minIdx, ex.minVal);
-        ImVec2 maxTextPos(plotMax.x - ImGui::CalcTextSize(maxBuf).x - 6.0f,
-                          std::clamp(maxPos.y - 10.0f, plotMin.y + 2.0f, plotMax.y - textLineHeight - 2.0f));
-        ImVec2 minTextPos(plotMax.x - ImGui::CalcTextSize(minBuf).x - 6.0f,
-                          std::clamp(minPos.y + 4.0f, plotMin.y + 2.0f, plotMax.y - textLineHeight - 2.0f));
-        // Avoid overlap between min/max labels for the same series.
-        if (fabs(maxTextPos.y - minTextPos.y) < textLineHeight + 2.0f)
-            minTextPos.y = std::min(plotMax.y - textLineHeight - 2.0f, maxTextPos.y + textLineHeight + 2.0f);
-        dl->AddText(maxTextPos, ImGui::ColorConvertFloat4ToU32(colVec), maxBuf);
-        dl->AddText(minTextPos, ImGui::ColorConvertFloat4ToU32(colVec), minBuf);
+        }
+        ImVec2 q = toScreen(l, row[l]);
+        if (hasPrev)
+            dl->AddLine(prev, q, col, 2.0f);
+        dl->AddCircleFilled(q, 3.0f, col, 8);
+        prev = q;
+        hasPrev = true;
+        if (fabs(q.y - mouse.y) < nearestDy)
+        {
+            nearestDy = fabs(q.y - mouse.y);
+            nearest = (int)l;
+        }
     }
-    if (g_PlotClickedIndex >= 0 && maxCount > 1)
+    if (!hovered || nearest < 0)
+        return;
+    ImVec2 q = toScreen((size_t)nearest, row[nearest]);
+    dl->AddCircle(q, 6.0f, IM_COL32(255, 255, 255, 255), 12, 1.5f);
+    ImGui::SetTooltip("level %s: %.4g", p.levels[nearest].c_str(), row[nearest]);
+    int msg = p.messages[(size_t)g_ProfileTime * levels + (size_t)nearest];
+    if (clicked && RowOfMessage(msg) >= 0)
+        SelectSingleMessage(msg);
+}
+
+static void DrawProfileWindow()
+{
+    if (!g_ShowProfile)
+        return;
+    ImGui::SetNextWindowSize(ImVec2(420, 520), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin("Vertical Profile", &g_ShowProfile))
     {
-        float t = (float)g_PlotClickedIndex / (float)(maxCount - 1);
-        float x = plotMin.x + t * (width - 1.0f);
-        dl->AddLine(ImVec2(x, plotMin.y), ImVec2(x, plotMax.y), IM_COL32(120, 220, 120, 200), 2.0f);
+        ImGui::End();
+        return;
     }
-    ImGui::Dummy(ImVec2(width, height));
-    if (ImGui::IsItemHovered() && ImGui::IsMouseClicked(ImGuiMouseButton_Left))
+    if (g_Markers.empty())
     {
-        ImVec2 mp = ImGui::GetMousePos();
-        float relX = (mp.x - plotMin.x) / (width - 1.0f);
-        relX = std::clamp(relX, 0.0f, 1.0f);
-        size_t idx = (size_t)std::round(relX * (float)(maxCount - 1));
-        if (!g_GribMessages.empty())
+        ImGui::TextUnformatted("Add a marker to extract a profile at it.");
+        ImGui::End();
+        return;
+    }
+    g_ProfileMarker = std::clamp(g_ProfileMarker, 0, (int)g_Markers.size() - 1);
+    auto markerLabel = [](const Marker &m)
+    { return m.name.empty() ? "M" + std::to_string(m.id) : m.name; };
+    ImGui::SetNextItemWidth(200.0f);
+    if (ImGui::BeginCombo("Marker", markerLabel(g_Markers[g_ProfileMarker]).c_str()))
+    {
+        ImGuiListClipper clipper;
+        clipper.Begin((int)g_Markers.size());
+        while (clipper.Step())
         {
-            g_PlotClickedIndex = (int)idx;
-            g_PlotClickRequest = (int)std::min(idx, g_GribMessages.size() - 1);
+            for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++)
+            {
+                ImGui::PushID(i);
+                if (ImGui::Selectable(markerLabel(g_Markers[i]).c_str(), i == g_ProfileMarker))
+                    g_ProfileMarker = i;
+                ImGui::PopID();
+            }
+        }
+        ImGui::EndCombo();
+    }
+    if (ImGui::Button("Profile"))
+        StartProfileExtraction(false);
+    if (ImGui::IsItemHovered())
+        ImGui::SetTooltip("All levels of the selected message's parameter, at its validity time");
+    ImGui::SameLine();
+    if (ImGui::Button("Time x level"))
+        StartProfileExtraction(true);
+    if (ImGui::IsItemHovered())
+        ImGui::SetTooltip("The same at every validity time in the view");
+    ImGui::SameLine();
+    ImGui::TextUnformatted(g_ProfileStatus.c_str());
+    const ProfileMatrix &p = g_Profile;
+    if (!p.times.empty())
+    {
+        ImGui::Text("%s (%s) at %s", p.parameter.c_str(), p.levelType.c_str(), markerLabel(p.probe).c_str());
+        if (p.times.size() > 1)
+        {
+            ImGui::SetNextItemWidth(-1.0f);
+            ImGui::SliderInt("##profiletime", &g_ProfileTime, 0, (int)p.times.size() - 1,
+                             p.times[std::clamp(g_ProfileTime, 0, (int)p.times.size() - 1)].c_str());
+        }
+        else
+            ImGui::Text("validity %s", p.times[0].c_str());
+        ImVec2 avail = ImGui::GetContentRegionAvail();
+        DrawProfilePlot(ImVec2(avail.x, std::max(120.0f, avail.y - ImGui::GetFrameHeightWithSpacing())));
+        ImGui::PushItemWidth(-260.0f);
+        ImGui::InputText("CSV##profilecsv", g_ProfileCsvPath, IM_ARRAYSIZE(g_ProfileCsvPath));
+        ImGui::PopItemWidth();
+        ImGui::SameLine();
+        if (ImGui::Button("Browse##profilecsv"))
+        {
+            const char *patterns[] = {"*.csv"};
+            const char *choice = tinyfd_saveFileDialog("Save profile CSV", g_ProfileCsvPath, 1, patterns, "CSV files");
+            if (choice)
+                SetPathBuffer(g_ProfileCsvPath, IM_ARRAYSIZE(g_ProfileCsvPath), choice);
         }
+        ImGui::SameLine();
+        if (ImGui::Button("Save profile"))
+            g_ProfileStatus = SaveProfileCsv() ? "CSV saved" : "Failed to save CSV";
+        ImGui::SameLine();
+        if (ImGui::Button("Save matrix"))
+            g_ProfileStatus = SaveProfileMatrixCsv() ? "CSV saved" : "Failed to save CSV";
     }
+    ImGui::End();
 }
 
 // ----------------------------------------------------------
-// Parse string to double (C++11 approach). Return true if ok.
+// Mouse picking lat/lon
 // ----------------------------------------------------------
-static bool parseDouble(const std::string &s, double &outValue)
+static double GetLatLonFromMouse(float mx, float my,
+                                 float contentX, float contentY,
+                                 float &outLat, float &outLon)
 {
-    char *endPtr = nullptr;
-    const char *cstr = s.c_str();
-    outValue = strtod(cstr, &endPtr);
-    if (endPtr == cstr)
-        return false;
-    while (endPtr && *endPtr)
+    if (g_SelectedMessageIndex < 0 || g_SelectedMessageIndex >= (int)g_GribMessages.size())
+        return std::numeric_limits<double>::quiet_NaN();
+    const GribMessage &gm = g_GribMessages[g_SelectedMessageIndex];
+    const GridGeometry &grid = *gm.grid;
+    if (!gm.message)
+        return std::numeric_limits<double>::quiet_NaN();
+    float rx = mx - contentX - g_OffsetX;
+    float ry = my - contentY - g_OffsetY;
+    float di = rx / g_Zoom;
+    float dj = ry / g_Zoom;
+    std::shared_ptr<const GridWarp> warp = WarpOf(gm);
+    if (warp && warp->warped)
     {
-        if (!isspace((unsigned char)*endPtr))
-            return false;
-        endPtr++;
+        if (di < 0.f || dj < 0.f || di >= (float)warp->width || dj >= (float)warp->height)
+            return std::numeric_limits<double>::quiet_NaN();
+        long p = WarpPointAt(*warp, di, dj);
+        if (p < 0)
+            return std::numeric_limits<double>::quiet_NaN();
+        outLat = (float)(warp->north - ((double)dj - 0.5) * warp->step);
+        outLon = (float)fmod(fmod(warp->west + ((double)di - 0.5) * warp->step, 360.0) + 360.0, 360.0);
+        std::vector<double> data;
+        double minv, maxv;
+        GetMessageValuesAndRange(gm.message, data, minv, maxv);
+        return (size_t)p < data.size() ? data[p] : std::numeric_limits<double>::quiet_NaN();
     }
-    return true;
+    if (grid.Ni <= 1 || grid.Nj <= 1)
+        return std::numeric_limits<double>::quiet_NaN();
+    if (di < 0.f || dj < 0.f || di > (float)(grid.Ni - 1) || dj > (float)(grid.Nj - 1))
+        return std::numeric_limits<double>::quiet_NaN();
+    bool desc = (grid.lat1 > grid.lat2);
+    double latRange = fabs(grid.lat1 - grid.lat2);
+    double lonRange = grid.lon2 - grid.lon1;
+    if (lonRange < 0)
+        lonRange += 360.0;
+    double fi = di / (grid.Ni - 1);
+    double fj = dj / (grid.Nj - 1);
+    if (!desc)
+        outLat = grid.lat1 + fj * latRange;
+    else
+        outLat = grid.lat1 - fj * latRange;
+    outLon = grid.lon1 + fi * lonRange;
+    if (outLon < 0)
+        outLon += 360.0;
+    outLon = fmod(outLon, 360.0);
+    std::vector<double> data;
+    double minv, maxv;
+    GetMessageValuesAndRange(gm.message, data, minv, maxv);
+    int idx = ((int)dj) * grid.Ni + (int)di;
+    if (idx < 0 || idx >= (int)data.size())
+        return std::numeric_limits<double>::quiet_NaN();
+    return data[idx];
 }
 
-// ----------------------------------------------------------
-// Compare function for sorting.
-// Tries numeric compare; falls back to string compare.
-// ----------------------------------------------------------
-static bool compareGribMessages(const GribMessage &a,
-                                const GribMessage &b,
-                                const std::string &key,
-                                bool ascending)
+// Reads the keys shown in the table into 'gm'. Safe to call from any
+// thread; the caller sets index (and the "index" key) and the location.
+static void ReadMessageKeys(codes_handle *h, GribMessage &gm)
 {
-    auto ita = a.keyValueMap.find(key);
-    auto itb = b.keyValueMap.find(key);
-    std::string sa = (ita != a.keyValueMap.end()) ? ita->second : "";
-    std::string sb = (itb != b.keyValueMap.end()) ? itb->second : "";
-    double da, db;
-    bool fa = parseDouble(sa, da);
-    bool fb = parseDouble(sb, db);
-    if (fa && fb)
-        return ascending ? (da < db) : (da > db);
-    return ascending ? (sa < sb) : (sa > sb);
+    // Retrieve essential fields:
+    codes_get_long(h, "level", &gm.level);
+    codes_get_long(h, "dataTime", &gm.dataTime);
+    codes_get_long(h, "dataDate", &gm.dataDate);
+    gm.grid = InternGrid(h);
+    char snBuf[64];
+    size_t snLen = sizeof(snBuf);
+    if (codes_get_string(h, "shortName", snBuf, &snLen) == 0)
+        gm.shortName = snBuf;
+    char puBuf[128];
+    size_t puLen = sizeof(puBuf);
+    if (codes_get_string(h, "parameterUnits", puBuf, &puLen) == 0)
+        gm.parameterUnits = puBuf;
+    char pnBuf[256];
+    size_t pnLen = sizeof(pnBuf);
+    if (codes_get_string(h, "parameterName", pnBuf, &pnLen) == 0)
+        gm.parameterName = pnBuf;
+    gm.minVal = 0.0;
+    gm.maxVal = 0.0;
+    gm.keyValueMap["level"] = std::to_string(gm.level);
+    gm.keyValueMap["shortName"] = gm.shortName;
+    gm.keyValueMap["dataTime"] = std::to_string(gm.dataTime);
+    gm.keyValueMap["dataDate"] = std::to_string(gm.dataDate);
+    gm.keyValueMap["Ni"] = std::to_string(gm.grid->Ni);
+    gm.keyValueMap["Nj"] = std::to_string(gm.grid->Nj);
+    char tlBuf[64];
+    size_t tlLen = sizeof(tlBuf);
+    if (codes_get_string(h, "typeOfLevel", tlBuf, &tlLen) == 0)
+        gm.keyValueMap["typeOfLevel"] = tlBuf;
+    // MARS keys, where the message defines them; they tell apart experiments
+    // and streams for MessageIdentityHash.
+    for (const char *key : {"class", "stream", "expver"})
+    {
+        char buf[64];
+        size_t len = sizeof(buf);
+        if (codes_get_string(h, key, buf, &len) == 0)
+            gm.keyValueMap[key] = buf;
+    }
+    std::vector<std::string> keys = {"paramId", "number", "step", "startStep", "endStep", "stepRange", "validityDate", "validityTime"};
+
+    for (const auto& key : keys) {
+        long tmpVal;
+        if (codes_get_long(h, key.c_str(), &tmpVal) == 0) {
+            gm.keyValueMap[key] = std::to_string(tmpVal);
+        }
+    }
 }
 
-// ----------------------------------------------------------
-// On-demand retrieval of all keys for “More Info”
-// (skips large arrays like "values", "bitmap")
-// ----------------------------------------------------------
-static void PopulateAllKeys(GribMessage &gm)
+// Stream callback for ecCodes: reads from a CompressedDecoder.
+static long ReadDecodedBytes(void *data, void *buffer, long len)
 {
-    if (!gm.message || gm.fullyPopulated)
-        return;
-    codes_keys_iterator *it =
-        codes_keys_iterator_new(gm.message, GRIB_KEYS_ITERATOR_ALL_KEYS, NULL);
-    while (codes_keys_iterator_next(it))
+    return (long)((CompressedDecoder *)data)->Read(buffer, (size_t)len);
+}
+
+// Indexes a gzip or zstd file in one decompression pass and keeps the
+// checkpoints passed on the way for ReopenGribMessage. Offsets are in the
+// uncompressed data. A rescan (watch mode) decompresses from the start
+// again but only adds the messages from 'startOffset' on.
+static long long IndexCompressedGribFile(const std::string &path, GribCompression kind, long long startOffset)
+{
+    auto scanStart = std::chrono::steady_clock::now();
+    size_t scanFirst = g_GribMessages.size();
+    ScopedTrace trace("scan compressed file", "io");
+    auto index = std::make_shared<CompressedGribIndex>();
+    index->path = path;
+    index->kind = kind;
+    CompressedDecoder decoder;
+    std::string error;
+    if (!decoder.Start(path, kind, CompressedCheckpoint(), error, &index->points))
     {
-        const char *keyName = codes_keys_iterator_get_name(it);
-        if (!keyName)
-            continue;
-        if (!strcmp(keyName, "values") || !strcmp(keyName, "bitmap"))
-            continue;
-        if (gm.keyValueMap.find(keyName) == gm.keyValueMap.end())
+        fprintf(stderr, "gribview: %s\n", error.c_str());
+        return startOffset;
+    }
+    long long endOffset = startOffset;
+    double hashSeconds = 0.0;
+    for (;;)
+    {
+        size_t size = 0;
+        int err = 0;
+        void *msg = wmo_read_any_from_stream_malloc(&decoder, ReadDecodedBytes, &size, &err);
+        if (!msg)
+            break;
+        long long offset = (long long)decoder.Position() - (long long)size;
+        endOffset = std::max(endOffset, offset + (long long)size);
+        codes_handle *h = nullptr;
+        if (offset >= startOffset && size >= 4 && memcmp(msg, "GRIB", 4) == 0)
+            h = codes_handle_new_from_message(nullptr, msg, size);
+        if (h)
         {
-            char buf[1024];
-            size_t bufLen = sizeof(buf);
-            if (codes_get_string(gm.message, keyName, buf, &bufLen) == 0)
-                gm.keyValueMap[keyName] = buf;
+            GribMessage gm;
+            gm.index = g_GribMessages.size() + 1;
+            gm.filePath = path;
+            gm.fileOffset = (long)offset;
+            gm.messageSize = size;
+            ReadMessageKeys(h, gm);
+            auto hashStart = std::chrono::steady_clock::now();
+            if (g_ContentHashing)
+                gm.contentHash = ContentHash(msg, size);
+            hashSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - hashStart).count();
+            gm.keyValueMap["index"] = std::to_string(gm.index);
+            g_GribMessages.push_back(gm);
+            codes_handle_delete(h);
         }
+        free(msg);
     }
-    codes_keys_iterator_delete(it);
-    gm.fullyPopulated = true;
+    if (!decoder.Error().empty())
+        fprintf(stderr, "gribview: %s: %s\n", path.c_str(), decoder.Error().c_str());
+    index->uncompressedBytes = decoder.Position();
+    std::error_code ec;
+    index->compressedBytes = (uint64_t)std::filesystem::file_size(path, ec);
+    decoder.Close();
+    {
+        std::lock_guard<std::mutex> lock(g_CompressedMutex);
+        g_CompressedIndexes[path] = index;
+    }
+    g_Perf.scanMessages = g_GribMessages.size() - scanFirst;
+    g_Perf.scanBytes = (uint64_t)(endOffset - startOffset);
+    g_Perf.scanSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - scanStart).count();
+    g_Perf.scanHashSeconds = hashSeconds;
+    return endOffset;
 }
 
 // ----------------------------------------------------------
-// Unpack float data. Also compute min/max.
+// Load a GRIB file and append its messages (do not clear previous ones).
+// Instead of keeping the handle, we record the file path and the file offset,
+// read minimal keys, then delete the handle.
+// IndexGribFileFrom starts at a given offset and returns the offset just
+// past the last complete message, so a file that is still being written
+// can be picked up again there; a partial message at the end is left for
+// the next call.
 // ----------------------------------------------------------
-static void GetMessageValuesAndRange(codes_handle *h,
-                                     std::vector<double> &outValues,
-                                     double &outMinVal,
-                                     double &outMaxVal)
+static long long IndexGribFileFrom(const std::string &path, long long startOffset)
 {
-    outMinVal = std::numeric_limits<double>::infinity();
-    outMaxVal = -std::numeric_limits<double>::infinity();
-    size_t nvals = 0;
-    if (codes_get_size(h, "values", &nvals) != 0 || nvals == 0)
+    GribCompression kind = DetectGribCompression(path);
+    if (kind != GribCompression::None)
+        return IndexCompressedGribFile(path, kind, startOffset);
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f)
+        return startOffset;
+    if (startOffset > 0 && !SeekFile(f, startOffset))
     {
-        outValues.clear();
-        outMinVal = 0;
-        outMaxVal = 0;
-        return;
+        fclose(f);
+        return startOffset;
     }
-    outValues.resize(nvals);
-    codes_get_double_array(h, "values", outValues.data(), &nvals);
-    for (size_t i = 0; i < nvals; i++)
+    auto scanStart = std::chrono::steady_clock::now();
+    size_t scanFirst = g_GribMessages.size();
+    ScopedTrace trace("scan file", "io");
+    codes_handle *h = nullptr;
+    int err = 0;
+    const int headers_only = 0;
+    long long endOffset = startOffset;
+    double hashSeconds = 0.0;
+    while ((h = grib_new_from_file(nullptr, f,  headers_only, &err)) != nullptr)
     {
-        double v = outValues[i];
-        if (fabs(v - 9999.0) < 1e-8)
-            v = std::numeric_limits<double>::quiet_NaN();
-        outValues[i] = v;
-        if (!std::isnan(v))
-        {
-            if (v < outMinVal)
-                outMinVal = v;
-            if (v > outMaxVal)
-                outMaxVal = v;
-        }
+        GribMessage gm;
+        gm.index = g_GribMessages.size() + 1;
+        gm.filePath = path;
+        long offset = 0;
+        if (codes_get_long(h, "offset", &offset) == 0)
+            gm.fileOffset = offset;
+        else
+            gm.fileOffset = ftell(f);
+        size_t msgSize = 0;
+        if (codes_get_message_size(h, &msgSize) == 0)
+            gm.messageSize = msgSize;
+        endOffset = std::max(endOffset, gm.messageSize ? (long long)gm.fileOffset + (long long)gm.messageSize
+                                                       : (long long)ftell(f));
+        ReadMessageKeys(h, gm);
+        // The whole message is in memory already, so hashing it here costs
+        // no extra read.
+        const void *bytes = nullptr;
+        size_t byteCount = 0;
+        auto hashStart = std::chrono::steady_clock::now();
+        if (g_ContentHashing && codes_get_message(h, &bytes, &byteCount) == 0 && bytes)
+            gm.contentHash = ContentHash(bytes, byteCount);
+        hashSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - hashStart).count();
+        gm.keyValueMap["index"] = std::to_string(gm.index);
+        g_GribMessages.push_back(gm);
+    /*    std::cout << "Loaded GRIB #" << gm.index << ": shortName="
+                  << gm.shortName << " level=" << gm.level
+                  << " date/time=" << gm.dataDate << "/" << gm.dataTime
+                  << " Ni/Nj=" << gm.Ni << "/" << gm.Nj << std::endl;*/
+        codes_handle_delete(h);
+        h = nullptr;
     }
-    if (outMinVal == std::numeric_limits<double>::infinity())
-        outMinVal = 0;
-    if (outMaxVal == -std::numeric_limits<double>::infinity())
-        outMaxVal = 0;
+    g_Perf.scanMessages = g_GribMessages.size() - scanFirst;
+    g_Perf.scanBytes = (uint64_t)(endOffset - startOffset);
+    g_Perf.scanSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - scanStart).count();
+    g_Perf.scanHashSeconds = hashSeconds;
+    fclose(f);
+    return endOffset;
 }
 
-// ----------------------------------------------------------
-// Reopen a GRIB message from file (if needed).
-// ----------------------------------------------------------
-static codes_handle *ReopenGribMessage(GribMessage &gm)
+static void LoadGribFileAppend(const std::string &path)
 {
-    FILE *f = fopen(gm.filePath.c_str(), "rb");
-    if (!f)
-        return nullptr;
-    if (fseek(f, gm.fileOffset, SEEK_SET) != 0)
+    if (path == "-")
     {
-        fclose(f);
-        return nullptr;
+        std::string error;
+        if (!StartStdinStream(error))
+            fprintf(stderr, "gribview: %s\n", error.c_str());
+        return;
+    }
+    size_t before = g_GribMessages.size();
+    IndexGribFileFrom(path, 0);
+    if (g_GribMessages.size() > before)
+    {
+        namespace fs = std::filesystem;
+        fs::path parent = fs::path(path).parent_path();
+        if (parent.empty())
+            parent = fs::current_path();
+        UpdateSavePathsForDir(parent);
+        UpdateWindowTitle();
     }
-    int err = 0;
-    codes_handle *h = codes_handle_new_from_file(nullptr, f, PRODUCT_GRIB, &err);
-    fclose(f);
-    return h;
 }
 
 // ----------------------------------------------------------
-// Generate the display texture for the currently active message.
-// Before using the message handle, re-open it if needed.
+// Watch mode (--watch DIR|GLOB, File > Watch Directory...). Files in the
+// directory that match the pattern are indexed as they appear or grow,
+// each from the offset where its previous scan stopped; a file that was
+// rewritten rather than appended to replaces its old messages. New rows
+// go to the end of the view and the selection is left alone. On Linux inotify
+// triggers the scan; a directory poll every few seconds catches what it
+// misses (e.g. files written by another NFS client) and is the only
+// trigger elsewhere.
 // ----------------------------------------------------------
-static void GenerateTextureForSelectedMessage()
+static const double kWatchPollSeconds = 3.0;
+static const double kWatchSettleSeconds = 0.25; // gathers a burst of write events into one scan
+
+// For .gz/.zst files the size on disk and the resume offset (in the
+// uncompressed data) are unrelated, so they are kept apart.
+struct WatchedFile
 {
-    DestroyTexture(g_TextureID);
-    if (g_SelectedMessageIndex < 0 || g_SelectedMessageIndex >= (int)g_GribMessages.size())
-        return;
-    GribMessage &gm = g_GribMessages[g_SelectedMessageIndex];
-    if (!gm.message)
-        gm.message = ReopenGribMessage(gm);
-    if (!gm.message)
-        return;
-    std::vector<double> data;
-    double minVal, maxVal;
-    GetMessageValuesAndRange(gm.message, data, minVal, maxVal);
-    gm.minVal = minVal;
-    gm.maxVal = maxVal;
-    int width = (int)gm.Ni;
-    int height = (int)gm.Nj;
-    if (width <= 0 || height <= 0 || data.empty())
-        return;
-    if (g_AutoFit)
-    {
-        g_UserMinVal = (float)minVal;
-        g_UserMaxVal = (float)maxVal;
-    }
-    g_TexWidth = width;
-    g_TexHeight = height;
-    auto it = colormapMap.find(g_ChosenColormapName);
-    const ColorEntry *colorMap = (it != colormapMap.end()) ? it->second : greyColormap;
-    int mapSize = colormapSize;
-    double range = (double)g_UserMaxVal - (double)g_UserMinVal;
-    std::vector<unsigned char> imageRGBA(width * height * 4, 0);
-    for (int j = 0; j < height; j++)
+    uintmax_t size = 0;   // on disk at the last scan
+    std::filesystem::file_time_type modified;
+    long long resume = 0; // end of the last complete message
+};
+
+struct WatchState
+{
+    bool active = false;
+    std::string dir;
+    std::string pattern = "*";
+    std::map<std::string, WatchedFile> files; // by canonical path
+    int inotifyFd = -1;
+    bool pending = false;
+    std::chrono::steady_clock::time_point firstEvent;
+    std::chrono::steady_clock::time_point lastScan;
+    size_t messagesAdded = 0;
+    std::string status;
+};
+static WatchState g_Watch;
+
+// '*' and '?' wildcards, as in a shell glob on the file name.
+static bool WildcardMatch(const char *pattern, const char *name)
+{
+    const char *star = nullptr;
+    const char *resume = nullptr;
+    while (*name)
     {
-        for (int i = 0; i < width; i++)
+        if (*pattern == '?' || (*pattern != '*' && *pattern == *name))
         {
-            int idx = j * width + i;
-            double val = data[idx];
-            int rgbaI = 4 * idx;
-            if (std::isnan(val))
-            {
-                imageRGBA[rgbaI + 0] = 0;
-                imageRGBA[rgbaI + 1] = 0;
-                imageRGBA[rgbaI + 2] = 0;
-                imageRGBA[rgbaI + 3] = 0;
-            }
-            else
-            {
-                double clamped = val;
-                if (clamped < g_UserMinVal)
-                    clamped = g_UserMinVal;
-                if (clamped > g_UserMaxVal)
-                    clamped = g_UserMaxVal;
-                double t = (range > 1e-14) ? (clamped - g_UserMinVal) / range : 0.0;
-                if (t < 0.0)
-                    t = 0.0;
-                if (t > 1.0)
-                    t = 1.0;
-                int cIdx = (int)(t * (mapSize - 1));
-                if (cIdx < 0)
-                    cIdx = 0;
-                if (cIdx >= mapSize)
-                    cIdx = mapSize - 1;
-                const ColorEntry &c = colorMap[cIdx];
-                imageRGBA[rgbaI + 0] = c[0];
-                imageRGBA[rgbaI + 1] = c[1];
-                imageRGBA[rgbaI + 2] = c[2];
-                imageRGBA[rgbaI + 3] = 255;
-            }
+            pattern++;
+            name++;
         }
+        else if (*pattern == '*')
+        {
+            star = pattern++;
+            resume = name;
+        }
+        else if (star)
+        {
+            pattern = star + 1;
+            name = ++resume;
+        }
+        else
+            return false;
     }
-    g_TextureID = CreateTextureFromData(imageRGBA.data(), width, height);
+    while (*pattern == '*')
+        pattern++;
+    return *pattern == '\0';
 }
 
-// ----------------------------------------------------------
-// Selection helpers
-// ----------------------------------------------------------
-static void ClearAllSelections()
+static bool WatchMatches(const char *name)
 {
-    for (auto &msg : g_GribMessages)
-        msg.selected = false;
+    return name[0] != '.' && WildcardMatch(g_Watch.pattern.c_str(), name);
 }
 
-static void SelectRangeInclusive(int startIdx, int endIdx)
+static std::string WatchKey(const std::filesystem::path &path)
 {
-    if (g_GribMessages.empty())
-        return;
-    int maxIndex = (int)g_GribMessages.size() - 1;
-    startIdx = std::max(0, std::min(startIdx, maxIndex));
-    endIdx = std::max(0, std::min(endIdx, maxIndex));
-    if (startIdx > endIdx)
-        std::swap(startIdx, endIdx);
-    for (int i = 0; i <= maxIndex; ++i)
-        g_GribMessages[i].selected = (i >= startIdx && i <= endIdx);
+    std::error_code ec;
+    std::filesystem::path canonical = std::filesystem::weakly_canonical(path, ec);
+    return ec ? path.string() : canonical.string();
 }
 
-static void RefreshSelectionState(bool requestScroll, int preferredIndex = -1)
+static void StopWatch()
 {
-    int activeIndex = -1;
-    if (preferredIndex >= 0 &&
-        preferredIndex < (int)g_GribMessages.size() &&
-        g_GribMessages[preferredIndex].selected)
-    {
-        activeIndex = preferredIndex;
-    }
+#if defined(__linux__)
+    if (g_Watch.inotifyFd >= 0)
+        close(g_Watch.inotifyFd);
+#endif
+    g_Watch = WatchState();
+}
+
+// 'target' is a directory (every file in it) or a glob on the file name,
+// e.g. run/*.grib2. Files that are already loaded resume after their last
+// message instead of being indexed twice.
+static bool StartWatch(const std::string &target, std::string &error)
+{
+    namespace fs = std::filesystem;
+    StopWatch();
+    WatchState w;
+    std::error_code ec;
+    if (fs::is_directory(target, ec))
+        w.dir = target;
     else
     {
-        for (size_t j = 0; j < g_GribMessages.size(); j++)
+        fs::path p(target);
+        w.dir = p.has_parent_path() ? p.parent_path().string() : std::string(".");
+        w.pattern = p.filename().string();
+        if (!fs::is_directory(w.dir, ec))
         {
-            if (g_GribMessages[j].selected)
-            {
-                activeIndex = (int)j;
-                break;
-            }
+            error = "No such directory: " + w.dir;
+            return false;
         }
     }
-    g_SelectedMessageIndex = activeIndex;
-    if (g_SelectedMessageIndex >= 0)
+    for (const GribMessage &gm : g_GribMessages)
     {
-        if (requestScroll)
-            g_ScrollPendingIndex = g_SelectedMessageIndex;
-        GenerateTextureForSelectedMessage();
+        auto entry = w.files.emplace(WatchKey(gm.filePath), WatchedFile());
+        WatchedFile &wf = entry.first->second;
+        if (entry.second)
+        {
+            wf.size = fs::file_size(gm.filePath, ec);
+            wf.modified = fs::last_write_time(gm.filePath, ec);
+        }
+        wf.resume = std::max(wf.resume, (long long)gm.fileOffset + (long long)gm.messageSize);
     }
-    else
+#if defined(__linux__)
+    w.inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (w.inotifyFd >= 0 &&
+        inotify_add_watch(w.inotifyFd, w.dir.c_str(), IN_CLOSE_WRITE | IN_MODIFY | IN_CREATE | IN_MOVED_TO) < 0)
     {
-        DestroyTexture(g_TextureID);
+        close(w.inotifyFd);
+        w.inotifyFd = -1;
     }
+#endif
+    w.active = true;
+    w.pending = true; // first scan on the next poll
+    w.status = "Waiting for files";
+    g_Watch = std::move(w);
+    return true;
 }
 
-static void ClearAllMessages()
+// The file at 'key' was replaced. Its messages keep their indices, which
+// markers and the undo history hold, but go stale: they leave the view and
+// the indexes and are never read again.
+static size_t RetireFileMessages(const std::string &key)
 {
-    DestroyTexture(g_TextureID);
-    for (auto &msg : g_GribMessages)
+    std::map<std::string, bool> sameFile; // filePath -> is 'key'
+    size_t retired = 0;
+    for (size_t i = 0; i < g_GribMessages.size(); i++)
     {
-        if (msg.message)
+        GribMessage &gm = g_GribMessages[i];
+        if (gm.stale)
+            continue;
+        auto it = sameFile.find(gm.filePath);
+        if (it == sameFile.end())
+            it = sameFile.emplace(gm.filePath, WatchKey(gm.filePath) == key).first;
+        if (!it->second)
+            continue;
+        gm.stale = true;
+        gm.selected = false;
+        if (gm.message)
         {
-            codes_handle_delete(msg.message);
-            msg.message = nullptr;
+            codes_handle_delete(gm.message);
+            gm.message = nullptr;
         }
+        if ((int)i == g_SelectedMessageIndex)
+            g_SelectedMessageIndex = -1;
+        retired++;
     }
-    g_GribMessages.clear();
-    g_SelectedMessageIndex = -1;
-    g_LastSelectionAnchor = -1;
-    g_ScrollPendingIndex = -1;
-    g_SaveSelectionStatus.clear();
-    g_SaveSelectionSuccess = false;
-    ClearMarkerSeries();
-    g_ExtractionRunning = false;
-    g_ExtractionStatus = "";
-    UpdateWindowTitle();
+    return retired;
 }
 
-static void LoadFilesAndSelect(const std::vector<std::string> &paths)
+static void ScanWatchedDirectory()
 {
-    if (paths.empty())
-        return;
-    size_t previousCount = g_GribMessages.size();
-    for (const auto &p : paths)
-    {
-        LoadGribFileAppend(p);
-    }
-    if (g_GribMessages.size() > previousCount)
+    namespace fs = std::filesystem;
+    ScopedTrace trace("watch scan", "io");
+    g_Watch.pending = false;
+    g_Watch.lastScan = std::chrono::steady_clock::now();
+    std::vector<fs::path> files;
+    std::error_code ec;
+    for (fs::directory_iterator it(g_Watch.dir, ec), end; !ec && it != end; it.increment(ec))
     {
-        ClearAllSelections();
-        size_t selectIndex = previousCount;
-        if (selectIndex >= g_GribMessages.size())
-            selectIndex = g_GribMessages.size() - 1;
-        g_GribMessages[selectIndex].selected = true;
-        g_SelectedMessageIndex = (int)selectIndex;
-        g_LastSelectionAnchor = (int)selectIndex;
-        GenerateTextureForSelectedMessage();
+        std::error_code typeErr;
+        if (it->is_regular_file(typeErr) && WatchMatches(it->path().filename().string().c_str()))
+            files.push_back(it->path());
     }
-}
-
-static void PromptFileDialogIfNeeded()
-{
-    if (!g_RequestFileDialog)
-        return;
-    g_RequestFileDialog = false;
-    const char *patterns[] = {"*.grib", "*.grb", "*.grib2", "*.grb2", "*"};
-    const char *choice = tinyfd_openFileDialog("Open GRIB files",
-                                               "",
-                                               5,
-                                               patterns,
-                                               "GRIB files",
-                                               1);
-    if (!choice)
-        return;
-    std::vector<std::string> files;
-    std::string combined(choice);
-    size_t start = 0;
-    while (start < combined.size())
+    if (ec)
     {
-        size_t sep = combined.find('|', start);
-        std::string token = combined.substr(start, (sep == std::string::npos) ? std::string::npos : sep - start);
-        if (!token.empty())
-            files.push_back(token);
-        if (sep == std::string::npos)
-            break;
-        start = sep + 1;
-    }
-    LoadFilesAndSelect(files);
-}
-
-// ----------------------------------------------------------
-// Save current displayed image to PNG
-// ----------------------------------------------------------
-static void SaveCurrentImagePNG(const std::string &filename)
-{
-    if (g_SelectedMessageIndex < 0 || g_SelectedMessageIndex >= (int)g_GribMessages.size())
+        g_Watch.status = "Cannot read " + g_Watch.dir;
         return;
-    const GribMessage &gm = g_GribMessages[g_SelectedMessageIndex];
-    if (!gm.message)
-        return;
-    std::vector<double> data;
-    double minVal, maxVal;
-    GetMessageValuesAndRange(gm.message, data, minVal, maxVal);
-    int width = (int)gm.Ni;
-    int height = (int)gm.Nj;
-    if (width <= 0 || height <= 0 || data.empty())
-        return;
-    auto it = colormapMap.find(g_ChosenColormapName);
-    const ColorEntry *colorMap = (it != colormapMap.end()) ? it->second : greyColormap;
-    int mapSize = colormapSize;
-    double userMin = g_UserMinVal;
-    double userMax = g_UserMaxVal;
-    double range = userMax - userMin;
-    std::vector<unsigned char> imageRGBA(width * height * 4, 0);
-    for (int j = 0; j < height; j++)
-    {
-        for (int i = 0; i < width; i++)
-        {
-            int idx = j * width + i;
-            double val = data[idx];
-            int rgbaI = 4 * idx;
-            if (std::isnan(val))
-            {
-                imageRGBA[rgbaI + 0] = 0;
-                imageRGBA[rgbaI + 1] = 0;
-                imageRGBA[rgbaI + 2] = 0;
-                imageRGBA[rgbaI + 3] = 0;
-            }
-            else
-            {
-                double clamped = val;
-                if (clamped < userMin)
-                    clamped = userMin;
-                if (clamped > userMax)
-                    clamped = userMax;
-                double t = (range > 1e-14) ? (clamped - userMin) / range : 0.0;
-                if (t < 0.0)
-                    t = 0.0;
-                if (t > 1.0)
-                    t = 1.0;
-                int cIdx = (int)(t * (mapSize - 1));
-                if (cIdx < 0)
-                    cIdx = 0;
-                if (cIdx >= mapSize)
-                    cIdx = mapSize - 1;
-                const ColorEntry &c = colorMap[cIdx];
-                imageRGBA[rgbaI + 0] = c[0];
-                imageRGBA[rgbaI + 1] = c[1];
-                imageRGBA[rgbaI + 2] = c[2];
-                imageRGBA[rgbaI + 3] = 255;
-            }
+    }
+    // One file per output step is the common layout: take them in name order.
+    std::sort(files.begin(), files.end());
+    size_t before = g_GribMessages.size();
+    size_t grownFiles = 0;
+    size_t retired = 0;
+    for (const fs::path &path : files)
+    {
+        std::error_code sizeErr, timeErr;
+        uintmax_t size = fs::file_size(path, sizeErr);
+        fs::file_time_type modified = fs::last_write_time(path, timeErr);
+        if (sizeErr || timeErr)
+            continue;
+        std::string key = WatchKey(path);
+        auto known = g_Watch.files.find(key);
+        bool seen = known != g_Watch.files.end();
+        if (seen && known->second.size == size && known->second.modified == modified)
+            continue;
+        WatchedFile &wf = g_Watch.files[key];
+        bool compressed = DetectGribCompression(path.string()) != GribCompression::None;
+        // Appends only make a file longer; one that changed without
+        // growing was rewritten.
+        if ((seen && size <= wf.size) || (!compressed && (long long)size < wf.resume))
+        {
+            retired += RetireFileMessages(key);
+            wf.resume = 0;
         }
+        wf.size = size;
+        wf.modified = modified;
+        if (!compressed && (long long)size == wf.resume)
+            continue;
+        size_t count = g_GribMessages.size();
+        wf.resume = IndexGribFileFrom(path.string(), wf.resume);
+        if (g_GribMessages.size() > count)
+            grownFiles++;
     }
-    stbi_write_png(filename.c_str(), width, height, 4, imageRGBA.data(), width * 4);
+    size_t added = g_GribMessages.size() - before;
+    if (added == 0 && retired == 0)
+        return;
+    g_Watch.messagesAdded += added;
+    if (retired > 0)
+        RebuildDuplicates();
+    SyncViewWithMessages();
+    RebuildHypercube();
+    UpdateWindowTitle();
+    if (g_SelectedMessageIndex < 0)
+        SelectFirstRow();
+    g_Watch.status = "+" + std::to_string(added) + " message(s) from " + std::to_string(grownFiles) +
+                     " file(s), " + std::to_string(g_Watch.messagesAdded) + " since watching";
+    if (retired > 0)
+        g_Watch.status += ", " + std::to_string(retired) + " replaced";
 }
 
-// ----------------------------------------------------------
-// Save a single GRIB message to file
-// ----------------------------------------------------------
-static bool SaveSingleMessageGrib(GribMessage &gm, const std::string &outPath)
+// Called once per frame.
+static void PollWatch()
 {
-    if (!gm.message)
-        gm.message = ReopenGribMessage(gm);
-    if (!gm.message)
-        return false;
-    FILE *out = fopen(outPath.c_str(), "wb");
-    if (!out)
-        return false;
-    const void *buffer = nullptr;
-    size_t size = 0;
-    int err = codes_get_message(gm.message, &buffer, &size);
-    bool ok = (!err && buffer && size > 0);
-    if (ok)
+    if (!g_Watch.active)
+        return;
+    auto now = std::chrono::steady_clock::now();
+#if defined(__linux__)
+    if (g_Watch.inotifyFd >= 0)
     {
-        fwrite(buffer, 1, size, out);
+        alignas(struct inotify_event) char buf[4096];
+        ssize_t n;
+        while ((n = read(g_Watch.inotifyFd, buf, sizeof(buf))) > 0)
+        {
+            for (char *p = buf; p < buf + n;)
+            {
+                const struct inotify_event *ev = (const struct inotify_event *)p;
+                if (ev->len > 0 && WatchMatches(ev->name) && !g_Watch.pending)
+                {
+                    g_Watch.pending = true;
+                    g_Watch.firstEvent = now;
+                }
+                p += sizeof(struct inotify_event) + ev->len;
+            }
+        }
     }
-    fclose(out);
-    return ok;
+#endif
+    bool due = g_Watch.pending
+                   ? std::chrono::duration<double>(now - g_Watch.firstEvent).count() >= kWatchSettleSeconds
+                   : std::chrono::duration<double>(now - g_Watch.lastScan).count() >= kWatchPollSeconds;
+    if (due)
+        ScanWatchedDirectory();
 }
 
 // ----------------------------------------------------------
-// Save multiple GRIB messages to one file
+// Streaming input: "-" as a file name reads GRIB from stdin (a pipe from
+// mars, grib_copy, curl...). Each message is copied into a segment file in
+// a spill directory as it arrives, so the rest of the viewer sees ordinary
+// file-backed messages and only the message being read is held in memory.
+// A reader thread does the I/O and reads the table keys; the UI thread
+// appends the finished rows in batches.
 // ----------------------------------------------------------
-static bool SaveMessagesToGrib(const std::vector<GribMessage *> &messages,
-                               const std::string &outPath,
-                               size_t &savedCount)
+static const uint64_t kStreamSegmentBytes = 256ull << 20;
+static const double kStreamDrainSeconds = 0.5; // shortest gap between appends
+
+struct StreamSource
 {
-    savedCount = 0;
-    if (messages.empty())
-        return false;
-    FILE *out = fopen(outPath.c_str(), "wb");
-    if (!out)
-        return false;
-    bool ok = true;
-    for (GribMessage *gm : messages)
+    std::string spillDir;
+    std::thread reader;
+    std::mutex mutex;               // guards the fields below
+    std::vector<GribMessage> ready; // indexed, not yet appended
+    bool finished = false;
+    std::string error;
+    size_t messages = 0;
+    size_t segments = 0;
+    uint64_t bytes = 0;
+    std::chrono::steady_clock::time_point nextDrain; // UI thread only
+};
+static std::unique_ptr<StreamSource> g_Stream;
+static std::string g_SpillRoot; // --spill-dir; empty = system temp directory
+
+static long ReadStreamBytes(void *data, void *buffer, long len)
+{
+    return (long)fread(buffer, 1, (size_t)len, (FILE *)data);
+}
+
+static void RunStreamReader(StreamSource &s)
+{
+    FILE *segment = nullptr;
+    std::string segmentPath;
+    uint64_t segmentBytes = 0;
+    std::string error;
+    for (;;)
     {
-        if (!gm->message)
-            gm->message = ReopenGribMessage(*gm);
-        if (!gm->message)
+        size_t size = 0;
+        int err = 0;
+        void *msg = wmo_read_any_from_stream_malloc(stdin, ReadStreamBytes, &size, &err);
+        if (!msg)
         {
-            ok = false;
+            if (err != CODES_END_OF_FILE)
+                error = std::string("stdin: ") + codes_get_error_message(err);
             break;
         }
-        const void *buffer = nullptr;
-        size_t size = 0;
-        int err = codes_get_message(gm->message, &buffer, &size);
-        if (!err && buffer && size > 0)
+        ScopedTrace trace("stream message", "io");
+        ScopedMemCharge charge(kMemStaging, size);
+        if (size < 4 || memcmp(msg, "GRIB", 4) != 0) // BUFR etc. in the same stream
         {
-            fwrite(buffer, 1, size, out);
+            free(msg);
+            continue;
         }
-        else
+        if (!segment || segmentBytes + size > kStreamSegmentBytes)
+        {
+            if (segment)
+                fclose(segment);
+            char name[32];
+            snprintf(name, sizeof(name), "segment-%06zu.grib", s.segments + 1);
+            segmentPath = (std::filesystem::path(s.spillDir) / name).string();
+            segment = fopen(segmentPath.c_str(), "wb");
+            segmentBytes = 0;
+            if (!segment)
+            {
+                free(msg);
+                error = "cannot create " + segmentPath;
+                break;
+            }
+            std::lock_guard<std::mutex> lock(s.mutex);
+            s.segments++;
+        }
+        // Flushed per message: the UI thread may reopen it right away.
+        if (fwrite(msg, 1, size, segment) != size || fflush(segment) != 0)
         {
-            ok = false;
+            free(msg);
+            error = "cannot write " + segmentPath + " (disk full?)";
             break;
         }
+        GribMessage gm;
+        gm.filePath = segmentPath;
+        gm.fileOffset = (long)segmentBytes;
+        gm.messageSize = size;
+        segmentBytes += size;
+        if (g_ContentHashing)
+            gm.contentHash = ContentHash(msg, size);
+        codes_handle *h = codes_handle_new_from_message(nullptr, msg, size);
+        if (h)
+        {
+            ReadMessageKeys(h, gm);
+            codes_handle_delete(h);
+        }
+        free(msg);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.ready.push_back(std::move(gm));
+        s.messages++;
+        s.bytes += size;
     }
-    fclose(out);
-    if (!ok)
+    if (segment)
+        fclose(segment);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.finished = true;
+    s.error = error;
+}
+
+static bool StartStdinStream(std::string &error)
+{
+    namespace fs = std::filesystem;
+    if (g_Stream)
     {
-        remove(outPath.c_str());
+        error = "stdin is already being read";
         return false;
     }
-    savedCount = messages.size();
+#if defined(_WIN32)
+    _setmode(_fileno(stdin), _O_BINARY);
+#endif
+    std::error_code ec;
+    fs::path root = g_SpillRoot.empty() ? fs::temp_directory_path(ec) : fs::path(g_SpillRoot);
+    auto stamp = std::chrono::system_clock::now().time_since_epoch().count();
+    fs::path dir = root / ("gribview-stream-" + std::to_string((long long)stamp));
+    if (ec || !fs::create_directories(dir, ec))
+    {
+        error = "cannot create the spill directory " + dir.string();
+        return false;
+    }
+    g_Stream.reset(new StreamSource());
+    g_Stream->spillDir = dir.string();
+    StreamSource &s = *g_Stream;
+    s.reader = std::thread([&s]() { RunStreamReader(s); });
     return true;
 }
 
-// ----------------------------------------------------------
-// Mouse picking lat/lon
-// ----------------------------------------------------------
-static double GetLatLonFromMouse(float mx, float my,
-                                 float contentX, float contentY,
-                                 float &outLat, float &outLon)
+// Appends the messages read since the last append. Each append rebuilds
+// the view and the hypercube over every message, so appends are spaced by
+// kStreamDrainSeconds or four times the last rebuild, whichever is longer,
+// rather than made every frame; the first rows and the end of the stream
+// go in at once. Returns how many were appended.
+static size_t DrainStream()
 {
-    if (g_SelectedMessageIndex < 0 || g_SelectedMessageIndex >= (int)g_GribMessages.size())
-        return std::numeric_limits<double>::quiet_NaN();
-    const GribMessage &gm = g_GribMessages[g_SelectedMessageIndex];
-    if (!gm.message || gm.Ni <= 1 || gm.Nj <= 1)
-        return std::numeric_limits<double>::quiet_NaN();
-    float rx = mx - contentX - g_OffsetX;
-    float ry = my - contentY - g_OffsetY;
-    float di = rx / g_Zoom;
-    float dj = ry / g_Zoom;
-    if (di < 0.f || dj < 0.f || di > (float)(gm.Ni - 1) || dj > (float)(gm.Nj - 1))
-        return std::numeric_limits<double>::quiet_NaN();
-    bool desc = (gm.lat1 > gm.lat2);
-    double latRange = fabs(gm.lat1 - gm.lat2);
-    double lonRange = gm.lon2 - gm.lon1;
-    if (lonRange < 0)
-        lonRange += 360.0;
-    double fi = di / (gm.Ni - 1);
-    double fj = dj / (gm.Nj - 1);
-    if (!desc)
-        outLat = gm.lat1 + fj * latRange;
-    else
-        outLat = gm.lat1 - fj * latRange;
-    outLon = gm.lon1 + fi * lonRange;
-    if (outLon < 0)
-        outLon += 360.0;
-    outLon = fmod(outLon, 360.0);
-    std::vector<double> data;
-    double minv, maxv;
-    GetMessageValuesAndRange(gm.message, data, minv, maxv);
-    int idx = ((int)dj) * gm.Ni + (int)di;
-    if (idx < 0 || idx >= (int)data.size())
-        return std::numeric_limits<double>::quiet_NaN();
-    return data[idx];
+    if (!g_Stream)
+        return 0;
+    StreamSource &s = *g_Stream;
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<GribMessage> batch;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (t0 < s.nextDrain && !s.finished)
+            return 0;
+        batch.swap(s.ready);
+    }
+    if (batch.empty())
+        return 0;
+    for (GribMessage &gm : batch)
+    {
+        gm.index = (int)g_GribMessages.size() + 1;
+        gm.keyValueMap["index"] = std::to_string(gm.index);
+        g_GribMessages.push_back(std::move(gm));
+    }
+    SyncViewWithMessages();
+    RebuildHypercube();
+    UpdateWindowTitle();
+    if (g_SelectedMessageIndex < 0 && g_Window) // no texture without a GL context
+        SelectFirstRow();
+    double rebuild = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    s.nextDrain = t0 + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                           std::chrono::duration<double>(std::max(kStreamDrainSeconds, 4.0 * rebuild)));
+    return batch.size();
 }
 
-// ----------------------------------------------------------
-// Load a GRIB file and append its messages (do not clear previous ones).
-// Instead of keeping the handle, we record the file path and the file offset,
-// read minimal keys, then delete the handle.
-// ----------------------------------------------------------
-static void LoadGribFileAppend(const std::string &path)
+// Headless runs index the whole stream before exporting.
+static void WaitForStream()
 {
-    FILE *f = fopen(path.c_str(), "rb");
-    if (!f)
+    if (!g_Stream)
         return;
-    codes_handle *h = nullptr;
-    int err = 0;
-    const int headers_only = 0;
-    bool loadedAny = false;
-    while ((h = grib_new_from_file(nullptr, f,  headers_only, &err)) != nullptr)
-    {
-        GribMessage gm;
-        gm.index = g_GribMessages.size() + 1;
-        gm.filePath = path;
-        long offset = 0;
-        if (codes_get_long(h, "offset", &offset) == 0)
-            gm.fileOffset = offset;
-        else
-            gm.fileOffset = ftell(f);
-        // Retrieve essential fields:
-        codes_get_long(h, "level", &gm.level);
-        codes_get_long(h, "dataTime", &gm.dataTime);
-        codes_get_long(h, "dataDate", &gm.dataDate);
-        codes_get_long(h, "Ni", &gm.Ni);
-        codes_get_long(h, "Nj", &gm.Nj);
-        codes_get_double(h, "latitudeOfFirstGridPointInDegrees", &gm.lat1);
-        codes_get_double(h, "latitudeOfLastGridPointInDegrees", &gm.lat2);
-        codes_get_double(h, "longitudeOfFirstGridPointInDegrees", &gm.lon1);
-        codes_get_double(h, "longitudeOfLastGridPointInDegrees", &gm.lon2);
-        char snBuf[64];
-        size_t snLen = sizeof(snBuf);
-        if (codes_get_string(h, "shortName", snBuf, &snLen) == 0)
-            gm.shortName = snBuf;
-        char puBuf[128];
-        size_t puLen = sizeof(puBuf);
-        if (codes_get_string(h, "parameterUnits", puBuf, &puLen) == 0)
-            gm.parameterUnits = puBuf;
-        char pnBuf[256];
-        size_t pnLen = sizeof(pnBuf);
-        if (codes_get_string(h, "parameterName", pnBuf, &pnLen) == 0)
-            gm.parameterName = pnBuf;
-        gm.minVal = 0.0;
-        gm.maxVal = 0.0;
-        gm.keyValueMap["index"] = std::to_string(gm.index);
-        gm.keyValueMap["level"] = std::to_string(gm.level);
-        gm.keyValueMap["shortName"] = gm.shortName;
-        gm.keyValueMap["dataTime"] = std::to_string(gm.dataTime);
-        gm.keyValueMap["dataDate"] = std::to_string(gm.dataDate);
-        gm.keyValueMap["Ni"] = std::to_string(gm.Ni);
-        gm.keyValueMap["Nj"] = std::to_string(gm.Nj);
-        std::vector<std::string> keys = {"startStep", "endStep", "stepRange", "validityDate", "validityTime"};
+    if (g_Stream->reader.joinable())
+        g_Stream->reader.join();
+    DrainStream();
+    if (!g_Stream->error.empty())
+        fprintf(stderr, "gribview: %s\n", g_Stream->error.c_str());
+}
 
-        for (const auto& key : keys) {
-            long tmpVal;
-            if (codes_get_long(h, key.c_str(), &tmpVal) == 0) {
-                gm.keyValueMap[key] = std::to_string(tmpVal);
-            }
-        }
-        g_GribMessages.push_back(gm);
-        loadedAny = true;
-    /*    std::cout << "Loaded GRIB #" << gm.index << ": shortName="
-                  << gm.shortName << " level=" << gm.level
-                  << " date/time=" << gm.dataDate << "/" << gm.dataTime
-                  << " Ni/Nj=" << gm.Ni << "/" << gm.Nj << std::endl;*/
-        codes_handle_delete(h);
-        h = nullptr;
+// At exit: the reader may still be blocked on an open pipe, in which case
+// it is left behind. The spill directory is removed either way.
+static void CloseStream()
+{
+    if (!g_Stream)
+        return;
+    bool finished;
+    {
+        std::lock_guard<std::mutex> lock(g_Stream->mutex);
+        finished = g_Stream->finished;
     }
-    fclose(f);
-    if (loadedAny)
+    if (g_Stream->reader.joinable())
     {
-        namespace fs = std::filesystem;
-        fs::path parent = fs::path(path).parent_path();
-        if (parent.empty())
-            parent = fs::current_path();
-        UpdateSavePathsForDir(parent);
-        UpdateWindowTitle();
+        if (finished)
+            g_Stream->reader.join();
+        else
+            g_Stream->reader.detach();
     }
+    std::error_code ec;
+    std::filesystem::remove_all(g_Stream->spillDir, ec);
+    if (!finished)
+        g_Stream.release(); // still referenced by the detached reader
+    g_Stream.reset();
 }
 
 // ----------------------------------------------------------
@@ -1447,45 +7338,377 @@ static void ApplyBlenderInspiredStyle()
     colors[ImGuiCol_PlotHistogramHovered] = ImVec4(0.30f, 0.80f, 0.50f, 1.0f);
 }
 
-static void LoadPrimaryFont(ImGuiIO &io)
+static void LoadPrimaryFont(ImGuiIO &io)
+{
+    ImFontConfig cfg;
+    cfg.OversampleH = 4;
+    cfg.OversampleV = 4;
+    cfg.PixelSnapH = false;
+    const char *fontCandidates[] = {
+        "external/imgui/misc/fonts/Roboto-Medium.ttf",
+        "../external/imgui/misc/fonts/Roboto-Medium.ttf",
+        "../../external/imgui/misc/fonts/Roboto-Medium.ttf"};
+    for (const char *candidate : fontCandidates)
+    {
+        if (std::filesystem::exists(candidate))
+        {
+            ImFont *font = io.Fonts->AddFontFromFileTTF(candidate, 15.0f, &cfg);
+            if (font)
+            {
+                io.FontDefault = font;
+                break;
+            }
+        }
+    }
+    if (!io.FontDefault)
+        io.FontDefault = io.Fonts->AddFontDefault();
+    io.Fonts->Build();
+}
+
+// ----------------------------------------------------------
+// Table frame-time benchmark (--bench-table 10000,100000,...)
+// Fills the table with synthetic rows and reports the average and worst
+// frame time while the view jumps around the list.
+// ----------------------------------------------------------
+struct TableBenchState
+{
+    std::vector<size_t> rowCounts;
+    size_t current = 0;
+    int frame = 0;
+    Uint64 lastCounter = 0;
+    Uint64 accumCounter = 0;
+    Uint64 worstCounter = 0;
+};
+static TableBenchState g_TableBench;
+static const int kTableBenchWarmupFrames = 10;
+static const int kTableBenchMeasuredFrames = 200;
+
+static void ParseBenchRowCounts(const std::string &arg)
+{
+    std::stringstream ss(arg);
+    std::string token;
+    while (std::getline(ss, token, ','))
+    {
+        double v = 0.0;
+        if (parseDouble(token, v) && v >= 1.0)
+            g_TableBench.rowCounts.push_back((size_t)v);
+    }
+}
+
+static void FillSyntheticMessages(size_t count)
+{
+    static const char *names[] = {"t", "u", "v", "q", "z", "r", "w", "msl"};
+    static const long levels[] = {1000, 925, 850, 700, 500, 300, 250, 100};
+    ClearAllMessages();
+    g_GribMessages.reserve(count);
+    for (size_t k = 0; k < count; k++)
+    {
+        GribMessage gm;
+        gm.index = (int)k + 1;
+        gm.shortName = names[k % 8];
+        gm.level = levels[(k / 8) % 8];
+        gm.dataDate = 20240101;
+        gm.dataTime = 0;
+        gm.minVal = gm.maxVal = 0.0;
+        gm.fileOffset = (long)k;
+        long step = (long)(k / 64);
+        gm.keyValueMap["index"] = std::to_string(gm.index);
+        gm.keyValueMap["shortName"] = gm.shortName;
+        gm.keyValueMap["level"] = std::to_string(gm.level);
+        gm.keyValueMap["validityDate"] = std::to_string(gm.dataDate + step / 24);
+        gm.keyValueMap["validityTime"] = std::to_string((step % 24) * 100);
+        gm.keyValueMap["startStep"] = std::to_string(step);
+        g_GribMessages.push_back(std::move(gm));
+    }
+    SyncViewWithMessages();
+    g_GribMessages[0].selected = true;
+    g_SelectedMessageIndex = 0;
+    g_LastSelectionAnchor = 0;
+}
+
+// Called once per frame after the swap; returns false once every size has run.
+static bool StepTableBenchmark()
+{
+    TableBenchState &b = g_TableBench;
+    if (b.current >= b.rowCounts.size())
+        return false;
+    Uint64 now = SDL_GetPerformanceCounter();
+    if (b.frame == 0)
+    {
+        FillSyntheticMessages(b.rowCounts[b.current]);
+        b.accumCounter = 0;
+        b.worstCounter = 0;
+    }
+    else if (b.frame > kTableBenchWarmupFrames)
+    {
+        Uint64 dt = now - b.lastCounter;
+        b.accumCounter += dt;
+        b.worstCounter = std::max(b.worstCounter, dt);
+    }
+    b.lastCounter = now;
+    b.frame++;
+    // Jump to a pseudo-random row each frame so scrolling is part of the cost.
+    g_ScrollPendingIndex = (int)(((size_t)b.frame * 7919u) % g_GribMessages.size());
+    if (b.frame > kTableBenchWarmupFrames + kTableBenchMeasuredFrames)
+    {
+        double freq = (double)SDL_GetPerformanceFrequency();
+        double avgMs = 1000.0 * (double)b.accumCounter / freq / kTableBenchMeasuredFrames;
+        double worstMs = 1000.0 * (double)b.worstCounter / freq;
+        printf("bench-table rows=%zu frames=%d avg_ms=%.3f max_ms=%.3f\n",
+               b.rowCounts[b.current], kTableBenchMeasuredFrames, avgMs, worstMs);
+        fflush(stdout);
+        b.current++;
+        b.frame = 0;
+    }
+    return b.current < b.rowCounts.size();
+}
+
+// ----------------------------------------------------------
+// Command line
+// ----------------------------------------------------------
+struct CommandLine
+{
+    std::vector<std::string> files;
+    std::string splitPattern; // headless split export when set
+    std::string filter;       // query applied before a headless export
+    std::string tracePath;    // Chrome trace-event output, written at exit
+    std::string watchTarget;  // directory or glob indexed as files appear
+    std::string spillDir;     // where stdin streams are spilled
+    long long memLimit = -1;  // bytes, -1 = physical RAM
+    bool memReport = false;   // print the memory report and exit
+    bool dedup = false;       // collapse messages with identical bytes
+    bool help = false;
+};
+
+static void PrintUsage()
+{
+    printf("Usage: gribview [FILE...]\n"
+           "       gribview --split PATTERN [--filter EXPR] FILE...\n"
+           "       gribview --mem-report [--filter EXPR] FILE...\n"
+           "\n"
+           "FILE can be - to read GRIB from stdin, e.g. grib_copy in.grib - | gribview -\n"
+           "\n"
+           "  --split PATTERN     write every message to the file named by PATTERN,\n"
+           "                      where [key] is replaced by the message's value,\n"
+           "                      e.g. out/[shortName]_[level].grib; no window is opened\n"
+           "  --filter EXPR       only export messages matching the table query EXPR\n"
+           "  --bench-table N,..  run the table benchmark with N synthetic rows\n"
+           "  --dedup             hide messages whose bytes repeat one loaded earlier\n"
+           "                      (also applies to --split)\n"
+           "  --watch DIR|GLOB    keep indexing new and growing files in DIR, or those\n"
+           "                      matching GLOB (e.g. 'run/*.grib2'), as they are written\n"
+           "  --spill-dir DIR     where GRIB read from stdin ('-' as FILE) is kept while\n"
+           "                      the viewer runs (default: the system temp directory)\n"
+           "  --trace FILE        record a Chrome/Perfetto trace of the session to FILE\n"
+           "  --mem-report        load the files, print memory use per subsystem and exit;\n"
+           "                      with --split, print it once the export is done\n"
+           "  --mem-limit SIZE    warn when memory use reaches 90%% of SIZE, e.g. 48G or\n"
+           "                      512M (default: physical RAM, 0 turns the warning off)\n"
+           "  --help              show this message\n");
+}
+
+// "48G", "512M", "1.5T" (binary units) or plain bytes; -1 if malformed.
+static long long ParseByteSize(const std::string &text)
+{
+    char *end = nullptr;
+    double v = strtod(text.c_str(), &end);
+    if (end == text.c_str() || v < 0.0)
+        return -1;
+    static const char *kUnits = "KMGT";
+    double unit = 1.0;
+    if (*end != '\0')
+    {
+        const char *u = strchr(kUnits, toupper((unsigned char)*end));
+        if (!u || end[1] != '\0')
+            return -1;
+        for (const char *p = kUnits; p <= u; p++)
+            unit *= 1024.0;
+    }
+    return (long long)(v * unit);
+}
+
+static CommandLine ParseCommandLine(int argc, char **argv)
+{
+    CommandLine cl;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--bench-table" && i + 1 < argc)
+            ParseBenchRowCounts(argv[++i]);
+        else if (arg == "--split" && i + 1 < argc)
+            cl.splitPattern = argv[++i];
+        else if (arg == "--filter" && i + 1 < argc)
+            cl.filter = argv[++i];
+        else if (arg == "--trace" && i + 1 < argc)
+            cl.tracePath = argv[++i];
+        else if (arg == "--watch" && i + 1 < argc)
+            cl.watchTarget = argv[++i];
+        else if (arg == "--spill-dir" && i + 1 < argc)
+            cl.spillDir = argv[++i];
+        else if (arg == "--mem-report")
+            cl.memReport = true;
+        else if (arg == "--dedup")
+            cl.dedup = true;
+        else if (arg == "--mem-limit" && i + 1 < argc)
+        {
+            cl.memLimit = ParseByteSize(argv[++i]);
+            if (cl.memLimit < 0)
+            {
+                fprintf(stderr, "gribview: bad size for --mem-limit: %s\n", argv[i]);
+                cl.help = true;
+            }
+        }
+        else if (arg == "--help" || arg == "-h")
+            cl.help = true;
+        else
+            cl.files.push_back(arg);
+    }
+    return cl;
+}
+
+static void ApplyMemoryLimit(long long requested)
+{
+    if (requested >= 0)
+        g_MemLimitBytes = (uint64_t)requested;
+    else
+    {
+        int ramMb = SDL_GetSystemRAM();
+        g_MemLimitBytes = ramMb > 0 ? (uint64_t)ramMb << 20 : 0;
+    }
+}
+
+// Prints the memory report to stdout, and a warning to stderr when the
+// limit is near.
+static void PrintMemoryReport()
+{
+    MemoryReport r = ComputeMemoryReport();
+    printf("%s", FormatMemoryReport(r).c_str());
+    if (r.NearLimit())
+        fprintf(stderr, "gribview: warning: memory use %s is close to the %s limit\n",
+                FormatMemorySize(r.Used()).c_str(), FormatMemorySize(g_MemLimitBytes).c_str());
+}
+
+// Loads the inputs for a headless run and applies --filter. Returns false
+// (after printing why) when there is nothing to work on.
+static bool LoadHeadlessInputs(const CommandLine &cl, const char *mode)
+{
+    if (cl.files.empty())
+    {
+        fprintf(stderr, "gribview: %s needs at least one input file\n", mode);
+        return false;
+    }
+    ConfigureEcCodesEnvironment();
+    for (const std::string &path : cl.files)
+        LoadGribFileAppend(path);
+    WaitForStream();
+    SyncViewWithMessages();
+    if (!cl.filter.empty())
+    {
+        SetPathBuffer(g_FilterText, IM_ARRAYSIZE(g_FilterText), cl.filter);
+        ApplyTableFilter();
+        if (!g_FilterError.empty())
+        {
+            fprintf(stderr, "gribview: bad filter: %s\n", g_FilterError.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+// Loads the inputs without a window and writes them out through the split
+// exporter. Returns the process exit code.
+static int RunHeadlessSplit(const CommandLine &cl)
+{
+    if (!LoadHeadlessInputs(cl, "--split"))
+        return 1;
+    std::vector<GribMessage *> toWrite;
+    toWrite.reserve(g_ViewRows.size());
+    for (int idx : g_ViewRows)
+        toWrite.push_back(&g_GribMessages[idx]);
+    SplitResult result;
+    bool ok = SplitMessagesToPattern(toWrite, cl.splitPattern, result);
+    if (cl.memReport)
+        PrintMemoryReport();
+    size_t duplicates = g_DuplicateCount, conflicts = g_ConflictCount;
+    ClearAllMessages();
+    if (!ok)
+    {
+        fprintf(stderr, "gribview: %s\n", result.error.c_str());
+        return 1;
+    }
+    double mb = (double)result.bytes / (1024.0 * 1024.0);
+    printf("Wrote %zu message(s) to %zu file(s): %.1f MB in %.2f s (%.0f MB/s)\n",
+           result.messages, result.files, mb, result.seconds,
+           result.seconds > 0.0 ? mb / result.seconds : 0.0);
+    if (duplicates > 0 || conflicts > 0)
+        printf("%zu duplicate(s) %s, %zu message(s) with the same keys as another but different data\n",
+               duplicates, cl.dedup ? "skipped" : "written (use --dedup to skip them)", conflicts);
+    return 0;
+}
+
+// --mem-report without --split: index the inputs, decode the first visible
+// message once (so the decoded peak shows what one field costs) and print
+// the report.
+static int RunHeadlessMemReport(const CommandLine &cl)
 {
-    ImFontConfig cfg;
-    cfg.OversampleH = 4;
-    cfg.OversampleV = 4;
-    cfg.PixelSnapH = false;
-    const char *fontCandidates[] = {
-        "external/imgui/misc/fonts/Roboto-Medium.ttf",
-        "../external/imgui/misc/fonts/Roboto-Medium.ttf",
-        "../../external/imgui/misc/fonts/Roboto-Medium.ttf"};
-    for (const char *candidate : fontCandidates)
+    if (!LoadHeadlessInputs(cl, "--mem-report"))
+        return 1;
+    if (!g_ViewRows.empty())
     {
-        if (std::filesystem::exists(candidate))
-        {
-            ImFont *font = io.Fonts->AddFontFromFileTTF(candidate, 15.0f, &cfg);
-            if (font)
-            {
-                io.FontDefault = font;
-                break;
-            }
-        }
+        GribMessage &gm = g_GribMessages[g_ViewRows[0]];
+        std::vector<double> data;
+        LoadMessageData(gm, data);
+        ScopedMemCharge decoded(kMemDecoded, VectorBytes(data));
     }
-    if (!io.FontDefault)
-        io.FontDefault = io.Fonts->AddFontDefault();
-    io.Fonts->Build();
+    PrintMemoryReport();
+    ClearAllMessages();
+    return 0;
 }
 
 // ----------------------------------------------------------
-// Main
+// Main (left out when another tool, e.g. gribview_bench, includes this file)
 // ----------------------------------------------------------
+#ifndef GRIBVIEW_NO_MAIN
+// Writes the trace however main returns, after the stream reader is done.
+struct TraceFileGuard
+{
+    ~TraceFileGuard()
+    {
+        CloseStream();
+        WriteTraceFile();
+    }
+};
+
 int main(int argc, char **argv)
 {
+    CommandLine cl = ParseCommandLine(argc, argv);
+    if (cl.help)
+    {
+        PrintUsage();
+        return 0;
+    }
+    if (!cl.tracePath.empty())
+        StartTrace(cl.tracePath);
+    TraceFileGuard traceFile;
+    ApplyMemoryLimit(cl.memLimit);
+    g_SpillRoot = cl.spillDir;
+    g_CollapseDuplicates = cl.dedup;
+    if (!cl.splitPattern.empty() || cl.memReport)
+    {
+        return cl.splitPattern.empty() ? RunHeadlessMemReport(cl) : RunHeadlessSplit(cl);
+    }
+    const std::vector<std::string> &initialPaths = cl.files;
+    bool benchMode = !g_TableBench.rowCounts.empty();
+    if (!benchMode)
+    {
 #if defined(_WIN32)
-    (void)freopen("NUL", "w", stdout);
-    (void)freopen("NUL", "w", stderr);
+        (void)freopen("NUL", "w", stdout);
+        (void)freopen("NUL", "w", stderr);
 #else
-    (void)freopen("/dev/null", "w", stdout);
-    (void)freopen("/dev/null", "w", stderr);
+        (void)freopen("/dev/null", "w", stdout);
+        (void)freopen("/dev/null", "w", stderr);
 #endif
+    }
     // Initialize SDL and OpenGL
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER | SDL_INIT_GAMECONTROLLER) != 0)
         return 0;
@@ -1507,20 +7730,15 @@ int main(int argc, char **argv)
     
     if (!g_GLContext)
         return 0;
-    SDL_GL_SetSwapInterval(1);
+    SDL_GL_SetSwapInterval(benchMode ? 0 : 1);
     glewExperimental = GL_TRUE;
     if (glewInit() != GLEW_OK)
         return 0;
     glGetError();
     UpdateSavePathsForDir(GetHomeDirectory());
     // Load each file provided on the command line (appending messages)
-    if (argc > 1)
+    if (!initialPaths.empty())
     {
-        std::vector<std::string> initialPaths;
-        for (int i = 1; i < argc; i++)
-        {
-            initialPaths.emplace_back(argv[i]);
-        }
         LoadFilesAndSelect(initialPaths);
         if (!g_GribMessages.empty())
         {
@@ -1539,6 +7757,12 @@ int main(int argc, char **argv)
         g_SelectedMessageIndex = -1;
         g_LastSelectionAnchor = -1;
     }
+    if (!cl.watchTarget.empty())
+    {
+        std::string watchError;
+        if (!StartWatch(cl.watchTarget, watchError))
+            g_Watch.status = watchError;
+    }
     // ImGui initialization
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
@@ -1560,6 +7784,7 @@ int main(int argc, char **argv)
     static std::vector<std::string> colormapNames;
     while (!done)
     {
+        ScopedTrace frameTrace("frame", "ui");
         SDL_Event ev;
         while (SDL_PollEvent(&ev))
         {
@@ -1599,6 +7824,13 @@ int main(int argc, char **argv)
             if (!g_GribMessages.empty())
                 ClearAllMessages();
         }
+        if (superDown && !ioFrame.WantTextInput && ImGui::IsKeyPressed(ImGuiKey_Z))
+            UndoView();
+        if (!ioFrame.WantTextInput && ImGui::IsKeyPressed(ImGuiKey_F3, false))
+            g_ShowPerfHud = !g_ShowPerfHud;
+        RecordFrameTime(ioFrame.DeltaTime);
+        HandleHypercubeShortcuts(ioFrame);
+        UpdateMemoryReport();
         float menuBarHeight = 0.f;
         if (ImGui::BeginMainMenuBar())
         {
@@ -1607,6 +7839,16 @@ int main(int argc, char **argv)
             {
                 if (ImGui::MenuItem("Open...", "Cmd+O"))
                     g_RequestFileDialog = true;
+                if (ImGui::MenuItem("Watch Directory..."))
+                {
+                    const char *dir = tinyfd_selectFolderDialog("Watch directory for new GRIB files",
+                                                                g_LastOpenedDir.c_str());
+                    std::string watchError;
+                    if (dir && !StartWatch(dir, watchError))
+                        g_Watch.status = watchError;
+                }
+                if (ImGui::MenuItem("Stop Watching", nullptr, false, g_Watch.active))
+                    StopWatch();
                 bool canClear = !g_GribMessages.empty();
                 if (ImGui::MenuItem("Clear Loaded Files", "Cmd+Shift+W", false, canClear))
                 {
@@ -1616,16 +7858,74 @@ int main(int argc, char **argv)
                     done = true;
                 ImGui::EndMenu();
             }
+            if (ImGui::BeginMenu("View"))
+            {
+                bool hasMessages = !g_GribMessages.empty();
+                if (ImGui::MenuItem("Undo", "Cmd+Z", false, !g_ViewUndo.empty()))
+                    UndoView();
+                if (ImGui::MenuItem("Show All Messages", nullptr, false, hasMessages))
+                    ResetView();
+                ImGui::MenuItem("Hypercube", nullptr, &g_ShowHypercube);
+                ImGui::MenuItem("Vertical Profile", nullptr, &g_ShowProfile);
+                ImGui::MenuItem("Performance HUD", "F3", &g_ShowPerfHud);
+                ImGui::MenuItem("Memory", nullptr, &g_ShowMemory);
+                if (ImGui::MenuItem("Collapse Duplicates", nullptr, g_CollapseDuplicates))
+                    SetCollapseDuplicates(!g_CollapseDuplicates);
+                if (ImGui::MenuItem("Interpolate Reduced Grids", nullptr, &g_LinearReduced))
+                    GenerateTextureForSelectedMessage();
+                ImGui::Separator();
+                if (ImGui::MenuItem("Save View...", nullptr, false, hasMessages))
+                {
+                    const char *patterns[] = {"*.view"};
+                    const char *choice = tinyfd_saveFileDialog("Save table view", g_ViewPath, 1, patterns, "View files");
+                    if (choice)
+                    {
+                        SetPathBuffer(g_ViewPath, IM_ARRAYSIZE(g_ViewPath), choice);
+                        g_SaveSelectionSuccess = SaveViewToFile(g_ViewPath);
+                        g_SaveSelectionStatus = g_SaveSelectionSuccess ? "Saved view to " + std::string(g_ViewPath)
+                                                                       : "Failed to save view.";
+                    }
+                }
+                if (ImGui::MenuItem("Load View...", nullptr, false, hasMessages))
+                {
+                    const char *patterns[] = {"*.view"};
+                    const char *choice = tinyfd_openFileDialog("Load table view", g_ViewPath, 1, patterns, "View files", 0);
+                    if (choice)
+                    {
+                        SetPathBuffer(g_ViewPath, IM_ARRAYSIZE(g_ViewPath), choice);
+                        g_SaveSelectionSuccess = LoadViewFromFile(g_ViewPath);
+                        g_SaveSelectionStatus = g_SaveSelectionSuccess ? "Loaded view " + std::string(g_ViewPath)
+                                                                       : "View does not match the loaded files.";
+                    }
+                }
+                ImGui::EndMenu();
+            }
             if (ImGui::BeginMenu("About"))
             {
                 if (ImGui::MenuItem("About / Check for updates"))
                     g_ShowAbout = true;
                 ImGui::EndMenu();
             }
+            if (g_MemReport.NearLimit())
+            {
+                std::string warning = "Memory " + FormatMemorySize(g_MemReport.Used()) + " of " +
+                                      FormatMemorySize(g_MemLimitBytes);
+                ImGui::SameLine(ImGui::GetWindowWidth() - ImGui::CalcTextSize(warning.c_str()).x -
+                                ImGui::GetStyle().ItemSpacing.x * 2.0f);
+                ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1.0f, 0.35f, 0.3f, 1.0f));
+                if (ImGui::Selectable(warning.c_str(), false, ImGuiSelectableFlags_None,
+                                      ImGui::CalcTextSize(warning.c_str())))
+                    g_ShowMemory = true;
+                ImGui::PopStyleColor();
+            }
             ImGui::EndMainMenuBar();
         }
         PromptFileDialogIfNeeded();
+        PollWatch();
+        DrainStream();
         StepMarkerExtraction();
+        StepRegionExtraction();
+        StepProfileExtraction();
         // Left panel
         float leftPanelHeight = (float)g_WindowHeight - menuBarHeight;
         ImGui::SetNextWindowPos(ImVec2(0, menuBarHeight), ImGuiCond_Always);
@@ -1716,9 +8016,9 @@ int main(int argc, char **argv)
         }
         ImGui::Separator();
         int selectedCount = 0;
-        for (auto &msg : g_GribMessages)
+        for (int idx : g_ViewRows)
         {
-            if (msg.selected)
+            if (g_GribMessages[idx].selected)
                 selectedCount++;
         }
         ImGui::TextUnformatted("Message");
@@ -1734,18 +8034,73 @@ int main(int argc, char **argv)
         {
             std::vector<GribMessage *> toWrite;
             toWrite.reserve(selectedCount);
-            for (auto &msg : g_GribMessages)
+            for (int idx : g_ViewRows)
             {
-                if (msg.selected)
-                    toWrite.push_back(&msg);
+                if (g_GribMessages[idx].selected)
+                    toWrite.push_back(&g_GribMessages[idx]);
             }
             size_t saved = 0;
-            bool ok = SaveMessagesToGrib(toWrite, g_SaveGribPath, saved);
-            g_SaveSelectionSuccess = ok;
-            if (ok)
-                g_SaveSelectionStatus = "Saved " + std::to_string(saved) + " message(s) to " + std::string(g_SaveGribPath);
+            uint64_t savedBytes = 0;
+            auto t0 = std::chrono::steady_clock::now();
+            if (g_ExportTransform.Active())
+            {
+                TransformResult tr;
+                bool ok = !IsOutputPattern(g_SaveGribPath) &&
+                          SaveTransformedMessages(toWrite, g_SaveGribPath, g_ExportTransform, tr);
+                g_SaveSelectionSuccess = ok;
+                if (ok)
+                {
+                    double mbIn = (double)tr.bytesIn / (1024.0 * 1024.0);
+                    double mbOut = (double)tr.bytesOut / (1024.0 * 1024.0);
+                    double secs = tr.seconds > 0.0 ? tr.seconds : 1e-9;
+                    char stats[192];
+                    snprintf(stats, sizeof(stats), " (%.1f -> %.1f MB, %+.0f%%, %.0f msg/s, %.0f MB/s)",
+                             mbIn, mbOut, mbIn > 0.0 ? (mbOut / mbIn - 1.0) * 100.0 : 0.0,
+                             (double)tr.messages / secs, mbIn / secs);
+                    g_SaveSelectionStatus = "Saved " + std::to_string(tr.messages) + " re-encoded message(s) to " +
+                                            std::string(g_SaveGribPath) + stats;
+                    if (g_ExportTransform.tolerance > 0.0)
+                    {
+                        snprintf(stats, sizeof(stats), ", max error %g", tr.maxError);
+                        g_SaveSelectionStatus += stats;
+                    }
+                }
+                else if (IsOutputPattern(g_SaveGribPath))
+                    g_SaveSelectionStatus = "Re-encoded saves write a single file; remove the [key] placeholders.";
+                else
+                    g_SaveSelectionStatus = "Re-encoding failed: " + tr.error;
+            }
+            else if (IsOutputPattern(g_SaveGribPath))
+            {
+                SplitResult split;
+                bool ok = SplitMessagesToPattern(toWrite, g_SaveGribPath, split);
+                g_SaveSelectionSuccess = ok;
+                if (ok)
+                {
+                    char rate[96];
+                    double mb = (double)split.bytes / (1024.0 * 1024.0);
+                    snprintf(rate, sizeof(rate), " (%.1f MB, %.0f MB/s)", mb, split.seconds > 0.0 ? mb / split.seconds : 0.0);
+                    g_SaveSelectionStatus = "Wrote " + std::to_string(split.messages) + " message(s) to " +
+                                            std::to_string(split.files) + " file(s)" + rate;
+                }
+                else
+                    g_SaveSelectionStatus = "Split export failed: " + split.error;
+            }
             else
-            g_SaveSelectionStatus = "Failed to save selection. Check file permissions.";
+            {
+                bool ok = SaveMessagesToGrib(toWrite, g_SaveGribPath, saved, savedBytes);
+                double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+                g_SaveSelectionSuccess = ok;
+                if (ok)
+                {
+                    char rate[64];
+                    double mb = (double)savedBytes / (1024.0 * 1024.0);
+                    snprintf(rate, sizeof(rate), " (%.1f MB, %.0f MB/s)", mb, secs > 0.0 ? mb / secs : 0.0);
+                    g_SaveSelectionStatus = "Saved " + std::to_string(saved) + " message(s) to " + std::string(g_SaveGribPath) + rate;
+                }
+                else
+                    g_SaveSelectionStatus = "Failed to save selection. Check file permissions.";
+            }
         }
         ImGui::EndDisabled();
         ImGui::SameLine();
@@ -1761,6 +8116,43 @@ int main(int argc, char **argv)
             ImGui::Text("%d msg", selectedCount);
         else
             ImGui::Text("No selection");
+        if (ImGui::TreeNode("Crop / decimate on save"))
+        {
+            ExportTransform &t = g_ExportTransform;
+            ImGui::Checkbox("Crop to lat/lon box", &t.crop);
+            ImGui::SameLine();
+            if (ImGui::Button("Use viewport") && ViewportLatLonBox(t))
+                t.crop = true;
+            ImGui::BeginDisabled(!t.crop);
+            ImGui::SetNextItemWidth(120.0f);
+            ImGui::InputDouble("North", &t.north, 0.0, 0.0, "%.3f");
+            ImGui::SameLine();
+            ImGui::SetNextItemWidth(120.0f);
+            ImGui::InputDouble("South", &t.south, 0.0, 0.0, "%.3f");
+            ImGui::SetNextItemWidth(120.0f);
+            ImGui::InputDouble("West", &t.west, 0.0, 0.0, "%.3f");
+            ImGui::SameLine();
+            ImGui::SetNextItemWidth(120.0f);
+            ImGui::InputDouble("East", &t.east, 0.0, 0.0, "%.3f");
+            ImGui::EndDisabled();
+            ImGui::SetNextItemWidth(120.0f);
+            ImGui::InputInt("Keep every Nth point", &t.stride);
+            t.stride = std::clamp(t.stride, 1, 1000);
+            ImGui::TreePop();
+        }
+        if (ImGui::TreeNode("Repack on save"))
+        {
+            ExportTransform &t = g_ExportTransform;
+            ImGui::SetNextItemWidth(160.0f);
+            ImGui::Combo("Packing", &t.packing, kRepackTypes, IM_ARRAYSIZE(kRepackTypes));
+            ImGui::SetNextItemWidth(120.0f);
+            ImGui::InputInt("Bits per value (0 = keep)", &t.bitsPerValue);
+            t.bitsPerValue = std::clamp(t.bitsPerValue, 0, 32);
+            ImGui::SetNextItemWidth(120.0f);
+            ImGui::InputDouble("Max error (0 = off)", &t.tolerance, 0.0, 0.0, "%g");
+            t.tolerance = std::max(t.tolerance, 0.0);
+            ImGui::TreePop();
+        }
         if (!g_SaveSelectionStatus.empty())
         {
             ImVec4 color = g_SaveSelectionSuccess ? ImVec4(0.4f, 0.8f, 0.4f, 1.0f)
@@ -1772,6 +8164,26 @@ int main(int argc, char **argv)
         if (ImGui::Button("Add marker"))
         {
             g_AddMarkerMode = true;
+            g_RegionMode = 0;
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Import..."))
+        {
+            const char *patterns[] = {"*.csv", "*.txt"};
+            const char *choice = tinyfd_openFileDialog("Import markers", g_MarkersImportPath, 2, patterns, "Station lists", 0);
+            if (choice)
+            {
+                SetPathBuffer(g_MarkersImportPath, IM_ARRAYSIZE(g_MarkersImportPath), choice);
+                ImportMarkersCsv(g_MarkersImportPath, g_ExtractionStatus);
+            }
+        }
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip("CSV with name,lat,lon per line (or a header naming id/lat/lon columns)");
+        ImGui::SameLine();
+        if (ImGui::Button("Clear") && !g_Markers.empty())
+        {
+            ClearMarkers();
+            g_ExtractionStatus = "Markers cleared";
         }
         ImGui::SameLine();
         if (ImGui::Button("Run extraction"))
@@ -1783,48 +8195,74 @@ int main(int argc, char **argv)
             ImGui::Text("%s", g_ExtractionStatus.c_str());
         if (g_AddMarkerMode)
             ImGui::TextColored(ImVec4(0.9f, 0.8f, 0.2f, 1.0f), "Click map to place marker");
+        // The selected message is decoded once for the marker values and the
+        // region statistics; regions only need it when their cached
+        // statistics are for another message.
+        GribMessage *selectedGM = nullptr;
+        std::vector<double> selectedData;
+        bool selectedHasData = false;
+        if (g_SelectedMessageIndex >= 0 && g_SelectedMessageIndex < (int)g_GribMessages.size())
+        {
+            selectedGM = &g_GribMessages[g_SelectedMessageIndex];
+            bool regionsStale = std::any_of(g_Regions.begin(), g_Regions.end(), [](const Region &r)
+                                            { return r.current.messageIndex != g_SelectedMessageIndex; });
+            if (!g_Markers.empty() || regionsStale)
+                selectedHasData = LoadMessageData(*selectedGM, selectedData);
+        }
+        ScopedMemCharge decoded(kMemDecoded, VectorBytes(selectedData));
         if (g_Markers.empty())
             ImGui::Text("No markers yet");
         else
         {
-            GribMessage *selectedGM = nullptr;
-            std::vector<double> selectedData;
-            bool selectedHasData = false;
-            if (g_SelectedMessageIndex >= 0 && g_SelectedMessageIndex < (int)g_GribMessages.size())
-            {
-                selectedGM = &g_GribMessages[g_SelectedMessageIndex];
-                selectedHasData = LoadMessageData(*selectedGM, selectedData);
-            }
-            for (size_t i = 0; i < g_Markers.size(); i++)
+            // Only the rows in view are laid out (and sampled).
+            float rowHeight = ImGui::GetFrameHeightWithSpacing();
+            int removeIndex = -1;
+            ImGui::BeginChild("MarkerList", ImVec2(0.0f, rowHeight * (float)std::min<size_t>(g_Markers.size(), 8)));
+            ImGuiListClipper clipper;
+            clipper.Begin((int)g_Markers.size(), rowHeight);
+            while (clipper.Step())
             {
-                auto &m = g_Markers[i];
-                ImGui::PushID((int)i);
-                ImVec4 c = MarkerColorVec4((int)i);
-                char valBuf[32];
-                bool valOk = false;
-                double val = 0.0;
-                if (selectedHasData && selectedGM)
-                {
-                    if (SampleValueFromData(*selectedGM, selectedData, m.lat, m.lon, val))
-                        valOk = true;
-                }
-                if (valOk)
-                    snprintf(valBuf, sizeof(valBuf), "%.2f", val);
-                else
-                    snprintf(valBuf, sizeof(valBuf), "N/A");
-                ImGui::TextColored(c, "M%d lat=%.2f lon=%.2f val=%s", m.id, m.lat, m.lon, valBuf);
-                ImGui::SameLine();
-                if (ImGui::SmallButton("Remove"))
+                for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++)
                 {
-                    RemoveMarkerAt(i);
+                    auto &m = g_Markers[i];
+                    ImGui::PushID(i);
+                    ImVec4 c = MarkerColorVec4((int)i);
+                    char valBuf[32];
+                    bool valOk = false;
+                    double val = 0.0;
+                    if (selectedHasData && selectedGM)
+                    {
+                        if (SampleMarker(m, *selectedGM, selectedData, val))
+                            valOk = true;
+                    }
+                    if (valOk)
+                        snprintf(valBuf, sizeof(valBuf), "%.2f", val);
+                    else
+                        snprintf(valBuf, sizeof(valBuf), "N/A");
+                    if (m.name.empty())
+                        ImGui::TextColored(c, "M%d lat=%.2f lon=%.2f val=%s", m.id, m.lat, m.lon, valBuf);
+                    else
+                        ImGui::TextColored(c, "%s lat=%.2f lon=%.2f val=%s", m.name.c_str(), m.lat, m.lon, valBuf);
+                    ImGui::SameLine();
+                    ImGui::SetNextItemWidth(120.0f);
+                    if (ImGui::Combo("##interp", &m.interp, kInterpNames, kInterpCount))
+                    {
+                        m.stencils.clear();
+                        m.series.clear();
+                        m.status.clear();
+                    }
+                    ImGui::SameLine();
+                    if (ImGui::SmallButton("Remove"))
+                        removeIndex = i;
                     ImGui::PopID();
-                    break;
                 }
-                ImGui::PopID();
             }
+            ImGui::EndChild();
+            if (removeIndex >= 0)
+                RemoveMarkerAt((size_t)removeIndex);
             ImVec2 plotSize(ImGui::GetContentRegionAvail().x, 120.0f);
             DrawMarkersPlot(plotSize);
-            if (g_PlotClickRequest >= 0 && g_PlotClickRequest < (int)g_GribMessages.size())
+            if (RowOfMessage(g_PlotClickRequest) >= 0)
             {
                 ClearAllSelections();
                 g_GribMessages[g_PlotClickRequest].selected = true;
@@ -1852,6 +8290,80 @@ int main(int argc, char **argv)
             }
         }
         ImGui::Separator();
+        // Regions
+        if (ImGui::Button("Add box"))
+        {
+            g_RegionMode = 1;
+            g_RegionDraft.clear();
+            g_AddMarkerMode = false;
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Add polygon"))
+        {
+            g_RegionMode = 2;
+            g_RegionDraft.clear();
+            g_AddMarkerMode = false;
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Run region stats"))
+            StartRegionExtraction();
+        ImGui::SameLine();
+        if (!g_RegionsStatus.empty())
+            ImGui::Text("%s", g_RegionsStatus.c_str());
+        if (g_RegionMode == 1)
+            ImGui::TextColored(ImVec4(0.9f, 0.8f, 0.2f, 1.0f), "Drag on the map to draw a box (Esc cancels)");
+        else if (g_RegionMode == 2)
+            ImGui::TextColored(ImVec4(0.9f, 0.8f, 0.2f, 1.0f), "Click vertices, double-click to close (Esc cancels)");
+        if (!g_Regions.empty())
+        {
+            ImGui::SetNextItemWidth(120.0f);
+            if (ImGui::InputDouble("Percentile##regions", &g_RegionPercentile, 5.0, 10.0, "%.0f"))
+            {
+                g_RegionPercentile = std::clamp(g_RegionPercentile, 0.0, 100.0);
+                ClearRegionSeries();
+            }
+            std::vector<std::pair<double, float>> scratch;
+            int removeIndex = -1;
+            for (size_t i = 0; i < g_Regions.size(); i++)
+            {
+                Region &r = g_Regions[i];
+                ImGui::PushID((int)i);
+                if (selectedHasData && r.current.messageIndex != g_SelectedMessageIndex)
+                {
+                    RegionStats(*RegionMaskFor(r, *selectedGM), selectedData, g_RegionPercentile, r.current, scratch);
+                    r.current.messageIndex = g_SelectedMessageIndex;
+                }
+                RegionSample s{};
+                if (selectedGM && r.current.messageIndex == g_SelectedMessageIndex)
+                    s = r.current;
+                if (s.points > 0)
+                    ImGui::Text("R%d %s mean=%.2f min=%.2f max=%.2f p%.0f=%.2f (%u pts)", r.id, r.box ? "box" : "polygon",
+                                s.mean, s.min, s.max, g_RegionPercentile, s.percentile, s.points);
+                else
+                    ImGui::Text("R%d %s: no points", r.id, r.box ? "box" : "polygon");
+                ImGui::SameLine();
+                if (ImGui::SmallButton("Remove"))
+                    removeIndex = (int)i;
+                ImGui::PopID();
+            }
+            if (removeIndex >= 0)
+                RemoveRegionAt((size_t)removeIndex);
+            ImGui::PushItemWidth(-150.0f);
+            ImGui::InputText("CSV##regionscsv", g_RegionsCsvPath, IM_ARRAYSIZE(g_RegionsCsvPath));
+            ImGui::PopItemWidth();
+            ImGui::SameLine();
+            if (ImGui::Button("Browse##regionscsv"))
+            {
+                const char *patterns[] = {"*.csv"};
+                const char *choice = tinyfd_saveFileDialog("Save regions CSV", g_RegionsCsvPath, 1, patterns, "CSV files");
+                if (choice)
+                    SetPathBuffer(g_RegionsCsvPath, IM_ARRAYSIZE(g_RegionsCsvPath), choice);
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Save CSV##regions"))
+                g_RegionsStatus = SaveRegionsCsv() ? "CSV saved" : "Failed to save CSV";
+        }
+        ImGui::Separator();
         if (ImGui::Button("Keys Select"))
             ImGui::OpenPopup("KeysSelectPopup");
         ImGui::SameLine();
@@ -1905,6 +8417,53 @@ int main(int argc, char **argv)
         }
 
         ImGui::Separator();
+        // Query filter for the table (also limits what "Save selection" writes)
+        float selectAllWidth = ImGui::CalcTextSize("Select all").x + style.FramePadding.x * 2.0f;
+        ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x - selectAllWidth - style.ItemSpacing.x);
+        if (ImGui::InputTextWithHint("##tablefilter", "shortName in (u,v) && level <= 500",
+                                     g_FilterText, IM_ARRAYSIZE(g_FilterText)))
+        {
+            ApplyTableFilter();
+            for (size_t i = 0; i < g_GribMessages.size(); i++)
+            {
+                if (g_GribMessages[i].selected && RowOfMessage((int)i) < 0)
+                    g_GribMessages[i].selected = false;
+            }
+            if (RowOfMessage(g_SelectedMessageIndex) < 0)
+                SelectFirstRow();
+        }
+        ImGui::SameLine();
+        ImGui::BeginDisabled(g_ViewRows.empty());
+        if (ImGui::Button("Select all", ImVec2(selectAllWidth, 0.0f)))
+        {
+            for (int idx : g_ViewRows)
+                g_GribMessages[idx].selected = true;
+            if (g_LastSelectionAnchor < 0)
+                g_LastSelectionAnchor = g_ViewRows.front();
+            RefreshSelectionState(false, g_SelectedMessageIndex);
+        }
+        ImGui::EndDisabled();
+        if (!g_FilterError.empty())
+            ImGui::TextColored(ImVec4(0.9f, 0.3f, 0.3f, 1.0f), "%s", g_FilterError.c_str());
+        else if (!g_FilterMask.empty())
+            ImGui::TextDisabled("%zu of %zu messages match", g_ViewRows.size(), g_GribMessages.size());
+        if (g_DuplicateCount > 0 || g_ConflictCount > 0)
+            ImGui::TextDisabled("%zu duplicate(s)%s, %zu conflicting (same keys, different data)", g_DuplicateCount,
+                                g_CollapseDuplicates ? " hidden" : "", g_ConflictCount);
+        if (g_Stream)
+        {
+            std::lock_guard<std::mutex> lock(g_Stream->mutex);
+            ImGui::TextDisabled("stdin: %zu message(s), %.1f MB in %zu segment(s)%s", g_Stream->messages,
+                                (double)g_Stream->bytes / (1024.0 * 1024.0), g_Stream->segments,
+                                g_Stream->finished ? ", done" : "");
+            if (!g_Stream->error.empty())
+                ImGui::TextColored(ImVec4(0.9f, 0.3f, 0.3f, 1.0f), "%s", g_Stream->error.c_str());
+        }
+        if (g_Watch.active)
+            ImGui::TextDisabled("Watching %s/%s: %s", g_Watch.dir.c_str(), g_Watch.pattern.c_str(),
+                                g_Watch.status.c_str());
+        else if (!g_Watch.status.empty())
+            ImGui::TextColored(ImVec4(0.9f, 0.3f, 0.3f, 1.0f), "%s", g_Watch.status.c_str());
         // Table of GRIB messages
         if (g_UiState.displayedKeys.empty())
         {
@@ -1926,190 +8485,155 @@ int main(int argc, char **argv)
                     ImGui::TableSetupColumn(g_UiState.displayedKeys[col].c_str(),
                                             ImGuiTableColumnFlags_WidthStretch);
                 }
+                ImGui::TableSetupScrollFreeze(0, 1);
                 ImGui::TableHeadersRow();
                 if (ImGuiTableSortSpecs *sortSpecs = ImGui::TableGetSortSpecs())
                 {
-            if (sortSpecs->SpecsDirty && sortSpecs->SpecsCount > 0)
-            {
-                const ImGuiTableColumnSortSpecs *spec = &sortSpecs->Specs[0];
-                g_UiState.sortKey = g_UiState.displayedKeys[spec->ColumnIndex];
-                g_UiState.sortAscending = (spec->SortDirection == ImGuiSortDirection_Ascending);
-                std::stable_sort(g_GribMessages.begin(), g_GribMessages.end(),
-                                 [&](const GribMessage &ma, const GribMessage &mb)
-                                 {
-                                     return compareGribMessages(ma, mb,
-                                                                g_UiState.sortKey,
-                                                                g_UiState.sortAscending);
-                                 });
-                ClearMarkerSeries();
-                g_ExtractionRunning = false;
-                g_ExtractionStatus = "Markers cleared after reordering";
-                int activeIndex = -1;
-                for (size_t j = 0; j < g_GribMessages.size(); j++)
-                {
-                    if (g_GribMessages[j].selected)
+                    if (sortSpecs->SpecsDirty && sortSpecs->SpecsCount > 0)
                     {
-                                activeIndex = j;
-                                break;
-                            }
-                        }
-                        g_SelectedMessageIndex = activeIndex;
-                        g_LastSelectionAnchor = g_SelectedMessageIndex;
-                        sortSpecs->SpecsDirty = false;
+                        const ImGuiTableColumnSortSpecs *spec = &sortSpecs->Specs[0];
+                        g_UiState.sortKey = g_UiState.displayedKeys[spec->ColumnIndex];
+                        g_UiState.sortAscending = (spec->SortDirection == ImGuiSortDirection_Ascending);
+                        SortView(g_UiState.sortKey, g_UiState.sortAscending);
+                        if (g_SelectedMessageIndex >= 0)
+                            g_ScrollPendingIndex = g_SelectedMessageIndex;
                     }
+                    sortSpecs->SpecsDirty = false;
                 }
                 bool tableFocused = ImGui::IsWindowFocused(ImGuiFocusedFlags_ChildWindows);
                 if (tableFocused)
                 {
                     const ImGuiIO &io = ImGui::GetIO();
                     bool shiftDown = io.KeyShift;
-                    if (ImGui::IsKeyPressed(ImGuiKey_UpArrow))
+                    if (ImGui::IsKeyPressed(ImGuiKey_UpArrow) && !io.KeyAlt && !g_ViewRows.empty())
                     {
-                        if (!g_GribMessages.empty())
+                        int currentRow = RowOfMessage(g_SelectedMessageIndex);
+                        int newIndex = g_ViewRows[std::max(0, currentRow - 1)];
+                        if (shiftDown)
                         {
-                            int current = (g_SelectedMessageIndex >= 0) ? g_SelectedMessageIndex : 0;
-                            int newIndex = std::max(0, current - 1);
-                            if (shiftDown)
-                            {
-                                if (g_LastSelectionAnchor < 0)
-                                    g_LastSelectionAnchor = current;
-                                SelectRangeInclusive(g_LastSelectionAnchor, newIndex);
-                            }
-                            else
-                            {
-                                ClearAllSelections();
-                                g_GribMessages[newIndex].selected = true;
-                                g_LastSelectionAnchor = newIndex;
-                            }
-                            RefreshSelectionState(true, newIndex);
-                            if (!shiftDown && g_SelectedMessageIndex >= 0)
-                                g_LastSelectionAnchor = g_SelectedMessageIndex;
+                            if (g_LastSelectionAnchor < 0)
+                                g_LastSelectionAnchor = (currentRow >= 0) ? g_SelectedMessageIndex : newIndex;
+                            SelectRangeInclusive(g_LastSelectionAnchor, newIndex);
                         }
-                    }
-                    if (ImGui::IsKeyPressed(ImGuiKey_DownArrow))
-                    {
-                        if (!g_GribMessages.empty())
+                        else
                         {
-                            int lastIndex = (int)g_GribMessages.size() - 1;
-                            int current = (g_SelectedMessageIndex >= 0) ? g_SelectedMessageIndex : -1;
-                            int newIndex = (current < 0) ? 0 : std::min(current + 1, lastIndex);
-                            if (shiftDown)
-                            {
-                                if (g_LastSelectionAnchor < 0)
-                                    g_LastSelectionAnchor = (current >= 0) ? current : newIndex;
-                                SelectRangeInclusive(g_LastSelectionAnchor, newIndex);
-                            }
-                            else
-                            {
-                                ClearAllSelections();
-                                g_GribMessages[newIndex].selected = true;
-                                g_LastSelectionAnchor = newIndex;
-                            }
-                            RefreshSelectionState(true, newIndex);
-                            if (!shiftDown && g_SelectedMessageIndex >= 0)
-                                g_LastSelectionAnchor = g_SelectedMessageIndex;
+                            ClearAllSelections();
+                            g_GribMessages[newIndex].selected = true;
+                            g_LastSelectionAnchor = newIndex;
                         }
+                        RefreshSelectionState(true, newIndex);
+                        if (!shiftDown && g_SelectedMessageIndex >= 0)
+                            g_LastSelectionAnchor = g_SelectedMessageIndex;
                     }
-                    if (ImGui::IsKeyPressed(ImGuiKey_Delete) || ImGui::IsKeyPressed(ImGuiKey_Backspace))
+                    if (ImGui::IsKeyPressed(ImGuiKey_DownArrow) && !io.KeyAlt && !g_ViewRows.empty())
                     {
-                        std::vector<GribMessage> remaining;
-                        for (auto &msg : g_GribMessages)
-                        {
-                            if (msg.selected)
-                            {
-                                if (msg.message)
-                                    codes_handle_delete(msg.message);
-                            }
-                            else
-                                remaining.push_back(msg);
-                        }
-                        g_GribMessages = remaining;
-                        for (size_t i = 0; i < g_GribMessages.size(); i++)
-                        {
-                            g_GribMessages[i].index = i + 1;
-                        }
-                        if (!g_GribMessages.empty())
+                        int lastRow = (int)g_ViewRows.size() - 1;
+                        int currentRow = RowOfMessage(g_SelectedMessageIndex);
+                        int newIndex = g_ViewRows[(currentRow < 0) ? 0 : std::min(currentRow + 1, lastRow)];
+                        if (shiftDown)
                         {
-                            for (auto &msg : g_GribMessages)
-                                msg.selected = false;
-                            g_GribMessages[0].selected = true;
-                            g_SelectedMessageIndex = 0;
-                            GenerateTextureForSelectedMessage();
-                            g_LastSelectionAnchor = 0;
-                            ClearMarkerSeries();
-                            g_ExtractionRunning = false;
-                            g_ExtractionStatus = "Markers cleared after delete";
+                            if (g_LastSelectionAnchor < 0)
+                                g_LastSelectionAnchor = (currentRow >= 0) ? g_SelectedMessageIndex : newIndex;
+                            SelectRangeInclusive(g_LastSelectionAnchor, newIndex);
                         }
                         else
                         {
-                            g_SelectedMessageIndex = -1;
-                            g_LastSelectionAnchor = -1;
-                            DestroyTexture(g_TextureID);
-                            ClearMarkerSeries();
-                            g_ExtractionRunning = false;
-                            g_ExtractionStatus = "Markers cleared after delete";
+                            ClearAllSelections();
+                            g_GribMessages[newIndex].selected = true;
+                            g_LastSelectionAnchor = newIndex;
                         }
+                        RefreshSelectionState(true, newIndex);
+                        if (!shiftDown && g_SelectedMessageIndex >= 0)
+                            g_LastSelectionAnchor = g_SelectedMessageIndex;
+                    }
+                    if (ImGui::IsKeyPressed(ImGuiKey_Delete) || ImGui::IsKeyPressed(ImGuiKey_Backspace))
+                    {
+                        RemoveSelectedFromView();
+                        g_ExtractionRunning = false;
                     }
                 }
-                for (size_t i = 0; i < g_GribMessages.size(); i++)
+                // Only the rows inside the visible scroll region are submitted;
+                // the pending scroll target is forced in so SetScrollHereY() can
+                // still bring an off-screen selection into view.
+                ImGuiListClipper clipper;
+                clipper.Begin((int)g_ViewRows.size());
+                int pendingRow = RowOfMessage(g_ScrollPendingIndex);
+                if (pendingRow >= 0)
+                    clipper.IncludeItemByIndex(pendingRow);
+                while (clipper.Step())
                 {
-                    GribMessage &gm = g_GribMessages[i];
-                    bool isSelected = gm.selected;
-                    ImGui::TableNextRow(ImGuiTableRowFlags_None);
-                    ImGui::TableSetColumnIndex(0);
-                    ImGui::PushID((int)i);
-                    if (ImGui::Selectable("##rowSel", isSelected,
-                                          ImGuiSelectableFlags_SpanAllColumns | ImGuiSelectableFlags_AllowItemOverlap))
+                    for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++)
                     {
-                        ImGuiIO &rowIO = ImGui::GetIO();
-                        bool shiftDown = rowIO.KeyShift;
-                        bool toggleModifier = rowIO.KeyCtrl || rowIO.KeySuper;
-                        int clickedIndex = (int)i;
-                        if (shiftDown)
+                        int i = g_ViewRows[row];
+                        GribMessage &gm = g_GribMessages[i];
+                        bool isSelected = gm.selected;
+                        ImGui::TableNextRow(ImGuiTableRowFlags_None);
+                        if (gm.conflictWith >= 0)
+                            ImGui::TableSetBgColor(ImGuiTableBgTarget_RowBg0, IM_COL32(140, 40, 40, 110));
+                        else if (gm.duplicateOf >= 0)
+                            ImGui::TableSetBgColor(ImGuiTableBgTarget_RowBg0, IM_COL32(110, 110, 110, 60));
+                        ImGui::TableSetColumnIndex(0);
+                        ImGui::PushID(i);
+                        bool clicked = ImGui::Selectable("##rowSel", isSelected,
+                                                         ImGuiSelectableFlags_SpanAllColumns | ImGuiSelectableFlags_AllowItemOverlap);
+                        if (ImGui::IsItemHovered() && gm.conflictWith >= 0)
+                            ImGui::SetTooltip("Same keys as message #%d, different data",
+                                              g_GribMessages[gm.conflictWith].index);
+                        else if (ImGui::IsItemHovered() && gm.duplicateOf >= 0)
+                            ImGui::SetTooltip("Identical to message #%d", g_GribMessages[gm.duplicateOf].index);
+                        if (clicked)
                         {
-                            if (g_LastSelectionAnchor < 0)
-                                g_LastSelectionAnchor = (g_SelectedMessageIndex >= 0) ? g_SelectedMessageIndex : clickedIndex;
-                            SelectRangeInclusive(g_LastSelectionAnchor, clickedIndex);
-                            RefreshSelectionState(true, clickedIndex);
+                            ImGuiIO &rowIO = ImGui::GetIO();
+                            bool shiftDown = rowIO.KeyShift;
+                            bool toggleModifier = rowIO.KeyCtrl || rowIO.KeySuper;
+                            int clickedIndex = i;
+                            if (shiftDown)
+                            {
+                                if (g_LastSelectionAnchor < 0)
+                                    g_LastSelectionAnchor = (g_SelectedMessageIndex >= 0) ? g_SelectedMessageIndex : clickedIndex;
+                                SelectRangeInclusive(g_LastSelectionAnchor, clickedIndex);
+                                RefreshSelectionState(true, clickedIndex);
+                            }
+                            else if (toggleModifier)
+                            {
+                                gm.selected = !gm.selected;
+                                RefreshSelectionState(true, gm.selected ? clickedIndex : -1);
+                                if (gm.selected)
+                                    g_LastSelectionAnchor = clickedIndex;
+                                else if (g_SelectedMessageIndex < 0)
+                                    g_LastSelectionAnchor = -1;
+                            }
+                            else
+                            {
+                                ClearAllSelections();
+                                gm.selected = true;
+                                g_LastSelectionAnchor = clickedIndex;
+                                RefreshSelectionState(true, clickedIndex);
+                            }
                         }
-                        else if (toggleModifier)
+                        ImGui::PopID();
+                        ImGui::SameLine();
+                        auto it = gm.keyValueMap.find(g_UiState.displayedKeys[0]);
+                        if (it != gm.keyValueMap.end())
+                            ImGui::TextUnformatted(it->second.c_str());
+                        for (int col = 1; col < (int)g_UiState.displayedKeys.size(); col++)
                         {
-                            gm.selected = !gm.selected;
-                            RefreshSelectionState(true, gm.selected ? clickedIndex : -1);
-                            if (gm.selected)
-                                g_LastSelectionAnchor = clickedIndex;
-                            else if (g_SelectedMessageIndex < 0)
-                                g_LastSelectionAnchor = -1;
+                            ImGui::TableSetColumnIndex(col);
+                            const std::string &ky = g_UiState.displayedKeys[col];
+                            auto it2 = gm.keyValueMap.find(ky);
+                            if (it2 != gm.keyValueMap.end())
+                                ImGui::TextUnformatted(it2->second.c_str());
+                            else
+                                ImGui::TextUnformatted("");
                         }
-                        else
+                        if (g_ScrollPendingIndex == i)
                         {
-                            ClearAllSelections();
-                            gm.selected = true;
-                            g_LastSelectionAnchor = clickedIndex;
-                            RefreshSelectionState(true, clickedIndex);
+                            ImGui::SetScrollHereY();
+                            g_ScrollPendingIndex = -1;
                         }
                     }
-                    ImGui::PopID();
-                    ImGui::SameLine();
-                    auto it = gm.keyValueMap.find(g_UiState.displayedKeys[0]);
-                    if (it != gm.keyValueMap.end())
-                        ImGui::TextUnformatted(it->second.c_str());
-                    for (int col = 1; col < (int)g_UiState.displayedKeys.size(); col++)
-                    {
-                        ImGui::TableSetColumnIndex(col);
-                        const std::string &ky = g_UiState.displayedKeys[col];
-                        auto it2 = gm.keyValueMap.find(ky);
-                        if (it2 != gm.keyValueMap.end())
-                            ImGui::TextUnformatted(it2->second.c_str());
-                        else
-                            ImGui::TextUnformatted("");
-                    }
-                    if (g_ScrollPendingIndex == (int)i)
-                    {
-                        ImGui::SetScrollHereY();
-                        g_ScrollPendingIndex = -1;
-                    }
                 }
+                clipper.End();
                 ImGui::EndTable();
                 if (g_ScrollPendingIndex >= 0)
                     g_ScrollPendingIndex = -1;
@@ -2133,6 +8657,7 @@ int main(int argc, char **argv)
         ImDrawList *dl = ImGui::GetWindowDrawList();
         ImVec2 cp = ImGui::GetCursorScreenPos();
         ImVec2 mp = ImGui::GetIO().MousePos;
+        g_CanvasSize = ImVec2(cw, ch);
         float canvasWidth = (float)g_WindowWidth - 350.0f; 
         float canvasHeight = (float)g_WindowHeight - 30.0f; 
         if (ImGui::IsWindowHovered())
@@ -2200,22 +8725,59 @@ int main(int argc, char **argv)
                         g_AddMarkerMode = false;
                     }
                 }
-                if (!g_AddMarkerMode && g_DraggingMarkerIndex < 0 && ImGui::IsMouseClicked(ImGuiMouseButton_Left))
+                if (g_RegionMode != 0)
                 {
-                    for (int idx = (int)g_Markers.size() - 1; idx >= 0; --idx)
+                    float latC = 0.0f, lonC = 0.0f;
+                    bool onGrid = !std::isnan(GetLatLonFromMouse(mp.x, mp.y, cp.x, cp.y, latC, lonC));
+                    if (g_RegionMode == 1)
                     {
-                        ImVec2 pos;
-                        if (activeMsg && LatLonToScreen(*activeMsg, g_Markers[idx].lat, g_Markers[idx].lon, cp.x, cp.y, pos))
+                        if (ImGui::IsMouseClicked(ImGuiMouseButton_Left) && onGrid)
+                        {
+                            g_RegionDraft = {{(double)latC, (double)lonC}};
+                            g_RegionDraftX = mp.x;
+                        }
+                        else if (!g_RegionDraft.empty() && ImGui::IsMouseReleased(ImGuiMouseButton_Left))
                         {
-                            float dx = mp.x - pos.x;
-                            float dy = mp.y - pos.y;
-                            if ((dx * dx + dy * dy) <= 12.0f * 12.0f)
+                            auto [lat0, lon0] = g_RegionDraft.front();
+                            if (onGrid && lat0 != (double)latC && lon0 != (double)lonC)
                             {
-                                g_DraggingMarkerIndex = idx;
-                                break;
+                                bool startWest = g_RegionDraftX <= mp.x;
+                                AddBoxRegion(lat0, startWest ? lon0 : (double)lonC, (double)latC,
+                                             startWest ? (double)lonC : lon0);
+                                g_RegionMode = 0;
                             }
+                            g_RegionDraft.clear();
+                        }
+                    }
+                    else if (ImGui::IsMouseDoubleClicked(ImGuiMouseButton_Left))
+                    {
+                        if (g_RegionDraft.size() >= 3)
+                        {
+                            AddRegion(false, g_RegionDraft);
+                            g_RegionMode = 0;
                         }
+                        g_RegionDraft.clear();
                     }
+                    else if (ImGui::IsMouseClicked(ImGuiMouseButton_Left) && onGrid)
+                        g_RegionDraft.emplace_back((double)latC, (double)lonC);
+                }
+                ExportTransform pick;
+                if (!g_AddMarkerMode && g_RegionMode == 0 && g_DraggingMarkerIndex < 0 &&
+                    ImGui::IsMouseClicked(ImGuiMouseButton_Left) &&
+                    activeMsg && CanvasLatLonBox(*activeMsg, mp.x - cp.x - 12.0f, mp.y - cp.y - 12.0f,
+                                                 mp.x - cp.x + 12.0f, mp.y - cp.y + 12.0f, 12.0f, pick))
+                {
+                    ForEachMarkerNear(pick.south, pick.north, pick.west, pick.east, [&](int idx)
+                    {
+                        ImVec2 pos;
+                        if (idx <= g_DraggingMarkerIndex ||
+                            !LatLonToScreen(*activeMsg, g_Markers[idx].lat, g_Markers[idx].lon, cp.x, cp.y, pos))
+                            return;
+                        float dx = mp.x - pos.x;
+                        float dy = mp.y - pos.y;
+                        if ((dx * dx + dy * dy) <= 12.0f * 12.0f)
+                            g_DraggingMarkerIndex = idx; // the last drawn, on top
+                    });
                 }
                 if (g_DraggingMarkerIndex >= 0)
                 {
@@ -2227,6 +8789,8 @@ int main(int argc, char **argv)
                         {
                             g_Markers[g_DraggingMarkerIndex].lat = (double)latC;
                             g_Markers[g_DraggingMarkerIndex].lon = (double)lonC;
+                            g_Markers[g_DraggingMarkerIndex].stencils.clear();
+                            g_MarkerIndex.dirty = true;
                         }
                     }
                     else
@@ -2235,20 +8799,69 @@ int main(int argc, char **argv)
                     }
                 }
             }
-            if (activeMsg)
+            ExportTransform shown;
+            if (activeMsg && !g_Markers.empty() &&
+                CanvasLatLonBox(*activeMsg, 0.0f, 0.0f, g_CanvasSize.x, g_CanvasSize.y, 12.0f, shown))
             {
-                for (size_t mi = 0; mi < g_Markers.size(); mi++)
+                // Only the markers in the index cells on screen; drawn in
+                // marker order so later ones stay on top. Past a few hundred
+                // the labels and outlines go, which keeps 20k markers cheap.
+                std::vector<std::pair<int, ImVec2>> &visible = g_VisibleMarkers;
+                visible.clear();
+                ImVec2 clipMin = dl->GetClipRectMin(), clipMax = dl->GetClipRectMax();
+                ForEachMarkerNear(shown.south, shown.north, shown.west, shown.east, [&](int mi)
                 {
-                    const Marker &m = g_Markers[mi];
                     ImVec2 pos;
-                    if (!LatLonToScreen(*activeMsg, m.lat, m.lon, cp.x, cp.y, pos))
+                    if (LatLonToScreen(*activeMsg, g_Markers[mi].lat, g_Markers[mi].lon, cp.x, cp.y, pos) &&
+                        pos.x > clipMin.x - 12.0f && pos.x < clipMax.x + 12.0f && pos.y > clipMin.y - 12.0f &&
+                        pos.y < clipMax.y + 12.0f)
+                        visible.emplace_back(mi, pos);
+                });
+                std::sort(visible.begin(), visible.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+                bool detailed = visible.size() <= kMarkerLabelLimit;
+                ImU32 border = IM_COL32(30, 30, 30, 255);
+                char label[64];
+                for (const auto &[mi, pos] : visible)
+                {
+                    ImU32 col = MarkerColor(mi);
+                    if (!detailed)
+                    {
+                        dl->AddCircleFilled(pos, 3.5f, col, 8);
                         continue;
-                    ImU32 col = MarkerColor((int)mi);
-                    ImU32 border = IM_COL32(30, 30, 30, 255);
-                    dl->AddCircleFilled(pos, 6.5f, col);
+                    }
+                    const Marker &m = g_Markers[mi];
+                    dl->AddCircleFilled(pos, 6.5f, col, 16);
                     dl->AddCircle(pos, 8.0f, border, 20, 2.0f);
-                    std::string label = "M" + std::to_string(m.id);
-                    dl->AddText(ImVec2(pos.x + 10, pos.y - 10), IM_COL32(240, 240, 240, 255), label.c_str());
+                    if (m.name.empty())
+                        snprintf(label, sizeof(label), "M%d", m.id);
+                    else
+                        snprintf(label, sizeof(label), "%s", m.name.c_str());
+                    dl->AddText(ImVec2(pos.x + 10, pos.y - 10), IM_COL32(240, 240, 240, 255), label);
+                }
+            }
+            if (activeMsg && (!g_Regions.empty() || !g_RegionDraft.empty()))
+            {
+                std::vector<ImVec2> outline;
+                ImU32 col = IM_COL32(255, 210, 60, 255);
+                char label[32];
+                for (const Region &r : g_Regions)
+                {
+                    if (!RegionOutlineToScreen(*activeMsg, r.vertices, cp.x, cp.y, outline))
+                        continue;
+                    dl->AddPolyline(outline.data(), (int)outline.size(), col, ImDrawFlags_Closed, 2.0f);
+                    snprintf(label, sizeof(label), "R%d", r.id);
+                    dl->AddText(ImVec2(outline[0].x + 4, outline[0].y + 2), col, label);
+                }
+                if (RegionOutlineToScreen(*activeMsg, g_RegionDraft, cp.x, cp.y, outline))
+                {
+                    if (g_RegionMode == 1)
+                        dl->AddRect(ImVec2(std::min(outline[0].x, mp.x), std::min(outline[0].y, mp.y)),
+                                    ImVec2(std::max(outline[0].x, mp.x), std::max(outline[0].y, mp.y)), col, 0.0f, 0, 1.5f);
+                    else
+                    {
+                        outline.push_back(mp);
+                        dl->AddPolyline(outline.data(), (int)outline.size(), col, ImDrawFlags_None, 1.5f);
+                    }
                 }
             }
             if (ImGui::IsWindowHovered())
@@ -2262,6 +8875,13 @@ int main(int argc, char **argv)
         ImGui::EndChild();
         if (g_DraggingMarkerIndex >= 0 && !ImGui::IsMouseDown(ImGuiMouseButton_Left))
             g_DraggingMarkerIndex = -1;
+        if (g_RegionMode == 1 && !g_RegionDraft.empty() && !ImGui::IsMouseDown(ImGuiMouseButton_Left))
+            g_RegionDraft.clear();
+        if (g_RegionMode != 0 && !ioFrame.WantTextInput && ImGui::IsKeyPressed(ImGuiKey_Escape, false))
+        {
+            g_RegionMode = 0;
+            g_RegionDraft.clear();
+        }
         // Status bar
         ImVec2 sbPos = ImGui::GetCursorScreenPos();
         float sbH = 30.f;
@@ -2314,8 +8934,7 @@ int main(int argc, char **argv)
         if (g_ShowInspector && g_InspectorIndex >= 0 && g_InspectorIndex < (int)g_GribMessages.size())
         {
             GribMessage &inspMsg = g_GribMessages[g_InspectorIndex];
-            if (!inspMsg.message)
-                inspMsg.message = ReopenGribMessage(inspMsg);
+            EnsureMessageHandle(inspMsg);
             PopulateAllKeys(inspMsg);
             ImGui::SetNextWindowSize(ImVec2(500, 400), ImGuiCond_FirstUseEver);
             if (ImGui::Begin("Inspector", &g_ShowInspector, ImGuiWindowFlags_AlwaysAutoResize))
@@ -2347,6 +8966,10 @@ int main(int argc, char **argv)
             }
             ImGui::End();
         }
+        DrawHypercubeWindow();
+        DrawProfileWindow();
+        DrawMemoryWindow();
+        DrawPerfHud();
         if (g_ShowAbout)
         {
             ImGui::SetNextWindowSize(ImVec2(520, 0), ImGuiCond_FirstUseEver);
@@ -2380,6 +9003,8 @@ int main(int argc, char **argv)
         glClear(GL_COLOR_BUFFER_BIT);
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
         SDL_GL_SwapWindow(g_Window);
+        if (benchMode && !StepTableBenchmark())
+            done = true;
     }
     // Cleanup
     DestroyTexture(g_TextureID);
@@ -2397,8 +9022,11 @@ int main(int argc, char **argv)
             g_GribMessages[i].message = NULL;
         }
     }
+    StopWatch();
     return 0;
 }
+#endif // GRIBVIEW_NO_MAIN
+
 static void ConfigureEcCodesEnvironment()
 {
     namespace fs = std::filesystem;
@@ -0,0 +1,689 @@
+// gribview_bench.cpp
+// Reproducible throughput numbers for the hot paths of gribview: scanning a
+// file, decoding messages, colormapping a field, extracting marker samples
+// and exporting messages. Inputs are synthetic and seeded (or a file given
+// with --input); results are printed as JSON so runs can be compared across
+// commits.
+//
+// A gzip or zstd input (--input FILE.grib.gz, or --compress for the
+// synthetic one) adds the cost of reading through the checkpoint index
+// next to decompressing the whole file first.
+//
+// With --golden DIR it instead renders a fixed set of fields through the
+// colormap/PNG path and compares them with reference PNGs in DIR, so changes
+// to the renderer can be checked pixel by pixel. A missing reference is a
+// failure; --update-golden writes (or rewrites) the references. The ones for
+// the seeded synthetic cases live in tests/golden and run as a ctest.
+//
+// The viewer is compiled into this tool as-is, minus its main().
+#define GRIBVIEW_NO_MAIN
+#include "gribview.cpp"
+#include "synthetic_grib.h"
+
+struct BenchOptions
+{
+    SyntheticGribSpec spec;
+    std::string input;   // benchmark this file instead of a synthetic one
+    std::string workDir; // where synthetic inputs and exports are written
+    std::string jsonPath;
+    int repeat = 3;
+    int markers = 16;
+    std::string goldenDir;
+    bool updateGolden = false;
+    int tolerance = 1; // per channel, for --golden
+    std::string compress; // gzip or zstd: compress the synthetic input first
+};
+
+struct BenchResult
+{
+    std::string name;
+    double value;
+};
+
+static double Seconds(std::chrono::steady_clock::time_point t0)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// Runs 'fn' 'repeat' times and returns the fastest run, in seconds.
+template <typename Fn>
+static double BestOf(int repeat, Fn fn)
+{
+    double best = std::numeric_limits<double>::infinity();
+    for (int r = 0; r < repeat; r++)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        fn();
+        best = std::min(best, Seconds(t0));
+    }
+    return best > 0.0 ? best : 1e-9;
+}
+
+static void ReleaseHandles()
+{
+    for (GribMessage &gm : g_GribMessages)
+    {
+        if (gm.message)
+        {
+            codes_handle_delete(gm.message);
+            gm.message = nullptr;
+        }
+    }
+}
+
+static void PrintBenchUsage()
+{
+    printf("Usage: gribview_bench [options]\n"
+           "  --messages N     synthetic messages (default 200)\n"
+           "  --grid NIxNJ     synthetic grid size (default 720x361)\n"
+           "  --seed S         random seed (default 42)\n"
+           "  --input FILE     benchmark FILE instead of synthetic data\n"
+           "  --compress C     gzip or zstd the synthetic input (zstd as 4 MB frames)\n"
+           "  --repeat R       runs per stage, fastest is kept (default 3)\n"
+           "  --markers M      markers for the extraction stage (default 16)\n"
+           "  --workdir DIR    scratch directory (default: system temp)\n"
+           "  --json FILE      write results to FILE instead of stdout\n"
+           "  --golden DIR     compare rendered images with the PNGs in DIR instead\n"
+           "  --update-golden  (re)write the reference PNGs in DIR\n"
+           "  --tolerance N    allowed difference per colour channel (default 1)\n");
+}
+
+static bool ParseBenchOptions(int argc, char **argv, BenchOptions &opts)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--messages" && hasValue)
+            opts.spec.messages = (size_t)std::max(1LL, atoll(argv[++i]));
+        else if (arg == "--grid" && hasValue)
+        {
+            long ni = 0, nj = 0;
+            if (sscanf(argv[++i], "%ldx%ld", &ni, &nj) != 2 || ni < 2 || nj < 2)
+                return false;
+            opts.spec.ni = ni;
+            opts.spec.nj = nj;
+        }
+        else if (arg == "--seed" && hasValue)
+            opts.spec.seed = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--input" && hasValue)
+            opts.input = argv[++i];
+        else if (arg == "--compress" && hasValue)
+        {
+            opts.compress = argv[++i];
+            if (opts.compress != "gzip" && opts.compress != "zstd")
+                return false;
+        }
+        else if (arg == "--repeat" && hasValue)
+            opts.repeat = std::max(1, atoi(argv[++i]));
+        else if (arg == "--markers" && hasValue)
+            opts.markers = std::max(1, atoi(argv[++i]));
+        else if (arg == "--workdir" && hasValue)
+            opts.workDir = argv[++i];
+        else if (arg == "--json" && hasValue)
+            opts.jsonPath = argv[++i];
+        else if (arg == "--golden" && hasValue)
+            opts.goldenDir = argv[++i];
+        else if (arg == "--update-golden")
+            opts.updateGolden = true;
+        else if (arg == "--tolerance" && hasValue)
+            opts.tolerance = std::max(0, atoi(argv[++i]));
+        else
+            return false;
+    }
+    return true;
+}
+
+static void WriteBenchJson(FILE *f, const BenchOptions &opts, const std::string &input,
+                           uint64_t inputBytes, const std::vector<BenchResult> &results)
+{
+    fprintf(f, "{\n");
+    fprintf(f, "  \"tool\": \"gribview_bench\",\n");
+    fprintf(f, "  \"version\": \"%s\",\n", PROJECT_VERSION);
+    fprintf(f, "  \"input\": {\n");
+    fprintf(f, "    \"synthetic\": %s,\n", opts.input.empty() ? "true" : "false");
+    if (opts.input.empty())
+    {
+        fprintf(f, "    \"seed\": %llu,\n", (unsigned long long)opts.spec.seed);
+        fprintf(f, "    \"ni\": %ld,\n", opts.spec.ni);
+        fprintf(f, "    \"nj\": %ld,\n", opts.spec.nj);
+    }
+    else
+    {
+        std::string escaped;
+        for (char c : input)
+        {
+            if (c == '"' || c == '\\')
+                escaped += '\\';
+            escaped += c;
+        }
+        fprintf(f, "    \"path\": \"%s\",\n", escaped.c_str());
+    }
+    fprintf(f, "    \"messages\": %zu,\n", g_GribMessages.size());
+    fprintf(f, "    \"bytes\": %llu\n", (unsigned long long)inputBytes);
+    fprintf(f, "  },\n");
+    fprintf(f, "  \"repeat\": %d,\n", opts.repeat);
+    fprintf(f, "  \"results\": {\n");
+    for (size_t i = 0; i < results.size(); i++)
+        fprintf(f, "    \"%s\": %.6g%s\n", results[i].name.c_str(), results[i].value,
+                i + 1 < results.size() ? "," : "");
+    fprintf(f, "  }\n}\n");
+}
+
+// ----------------------------------------------------------
+// Compressed inputs
+// ----------------------------------------------------------
+static const size_t kBenchZstdFrame = 4u << 20;
+
+// gzip as one member; zstd as independent frames, which is what gives a
+// zstd file checkpoints.
+static bool CompressBenchInput(const std::string &src, const std::string &dst, const std::string &kind,
+                               std::string &error)
+{
+    FILE *in = fopen(src.c_str(), "rb");
+    if (!in)
+    {
+        error = "cannot read " + src;
+        return false;
+    }
+    std::vector<char> chunk(kBenchZstdFrame);
+    bool ok = false;
+    if (kind == "gzip")
+    {
+#if defined(GRIBVIEW_HAVE_ZLIB)
+        gzFile out = gzopen(dst.c_str(), "wb6");
+        ok = out != nullptr;
+        size_t n = 0;
+        while (ok && (n = fread(chunk.data(), 1, chunk.size(), in)) > 0)
+            ok = gzwrite(out, chunk.data(), (unsigned)n) == (int)n;
+        if (out && gzclose(out) != Z_OK)
+            ok = false;
+#endif
+    }
+    else
+    {
+#if defined(GRIBVIEW_HAVE_ZSTD)
+        FILE *out = fopen(dst.c_str(), "wb");
+        ok = out != nullptr;
+        std::vector<char> frame(ZSTD_compressBound(chunk.size()));
+        size_t n = 0;
+        while (ok && (n = fread(chunk.data(), 1, chunk.size(), in)) > 0)
+        {
+            size_t z = ZSTD_compress(frame.data(), frame.size(), chunk.data(), n, 3);
+            ok = !ZSTD_isError(z) && fwrite(frame.data(), 1, z, out) == z;
+        }
+        if (out && fclose(out) != 0)
+            ok = false;
+#endif
+    }
+    fclose(in);
+    if (!ok)
+        error = GribCompressionSupported(kind == "gzip" ? GribCompression::Gzip : GribCompression::Zstd)
+                    ? "cannot write " + dst
+                    : "built without " + kind + " support";
+    return ok;
+}
+
+// The uncompressed data of 'src' to 'dst', as a user would with gunzip.
+static bool DecompressBenchInput(const std::string &src, GribCompression kind, const std::string &dst)
+{
+    CompressedDecoder d;
+    std::string error;
+    if (!d.Start(src, kind, CompressedCheckpoint(), error))
+        return false;
+    FILE *out = fopen(dst.c_str(), "wb");
+    if (!out)
+        return false;
+    std::vector<char> buffer(kCopyBufferSize);
+    bool ok = true;
+    size_t n = 0;
+    while (ok && (n = d.Read(buffer.data(), buffer.size())) > 0)
+        ok = fwrite(buffer.data(), 1, n, out) == n;
+    if (fclose(out) != 0)
+        ok = false;
+    return ok && d.Error().empty();
+}
+
+// ----------------------------------------------------------
+// Golden-image check
+// ----------------------------------------------------------
+struct GoldenCase
+{
+    std::string name;
+    bool fromFile;           // render a message of the input through SaveCurrentImagePNG
+    int messageIndex;        // for fromFile
+    std::vector<double> data; // for synthetic cases
+    int width, height;
+    std::string colormap;
+    double minVal, maxVal;
+};
+
+static std::vector<GoldenCase> BuildGoldenCases(const BenchOptions &opts)
+{
+    std::vector<GoldenCase> cases;
+    const int w = 256, h = 128;
+    std::mt19937_64 rng(opts.spec.seed);
+    GoldenCase c;
+    c.fromFile = false;
+    c.messageIndex = -1;
+    c.width = w;
+    c.height = h;
+    SyntheticField(rng, w, h, c.data);
+    auto range = std::minmax_element(c.data.begin(), c.data.end());
+    double lo = *range.first, hi = *range.second;
+
+    c.name = "synthetic_magma";
+    c.colormap = "magma";
+    c.minVal = lo;
+    c.maxVal = hi;
+    cases.push_back(c);
+
+    c.name = "synthetic_viridis_clamped";
+    c.colormap = "viridis";
+    c.minVal = lo + (hi - lo) * 0.25;
+    c.maxVal = hi - (hi - lo) * 0.25;
+    cases.push_back(c);
+
+    std::vector<bool> mask;
+    SyntheticMissingMask(rng, w, h, 0.3, mask);
+    for (size_t p = 0; p < mask.size(); p++)
+        if (mask[p])
+            c.data[p] = std::numeric_limits<double>::quiet_NaN();
+    c.name = "synthetic_grey_missing";
+    c.colormap = "grey";
+    c.minVal = lo;
+    c.maxVal = hi;
+    cases.push_back(c);
+
+    std::fill(c.data.begin(), c.data.end(), 273.15);
+    c.name = "constant_turbo";
+    c.colormap = "turbo";
+    c.minVal = c.maxVal = 273.15;
+    cases.push_back(c);
+
+    // A few real messages when there is an input file.
+    for (int m = 0; m < 3 && m < (int)g_GribMessages.size(); m++)
+    {
+        GoldenCase f;
+        f.name = "message_" + std::to_string(m + 1);
+        f.fromFile = true;
+        f.messageIndex = m;
+        f.width = (int)g_GribMessages[m].grid->Ni;
+        f.height = (int)g_GribMessages[m].grid->Nj;
+        f.colormap = "jet";
+        f.minVal = f.maxVal = 0.0;
+        cases.push_back(f);
+    }
+    return cases;
+}
+
+static bool RenderGoldenCase(GoldenCase &c, const std::string &outPath)
+{
+    if (c.fromFile)
+    {
+        GribMessage &gm = g_GribMessages[c.messageIndex];
+        if (!EnsureMessageHandle(gm))
+            return false;
+        std::vector<double> data;
+        double mn, mx;
+        GetMessageValuesAndRange(gm.message, data, mn, mx);
+        g_SelectedMessageIndex = c.messageIndex;
+        g_ChosenColormapName = c.colormap;
+        g_UserMinVal = (float)mn;
+        g_UserMaxVal = (float)mx;
+        std::error_code ec;
+        std::filesystem::remove(outPath, ec);
+        SaveCurrentImagePNG(outPath);
+        codes_handle_delete(gm.message);
+        gm.message = nullptr;
+        return std::filesystem::exists(outPath);
+    }
+    auto it = colormapMap.find(c.colormap);
+    const ColorEntry *colorMap = (it != colormapMap.end()) ? it->second : greyColormap;
+    std::vector<unsigned char> rgba;
+    ColormapToRGBA(c.data, c.width, c.height, (float)c.minVal, (float)c.maxVal, colorMap, (int)colormapSize, rgba);
+    return stbi_write_png(outPath.c_str(), c.width, c.height, 4, rgba.data(), c.width * 4) != 0;
+}
+
+static int RunGoldenCheck(const BenchOptions &opts, const std::filesystem::path &workDir)
+{
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    if (opts.updateGolden)
+        fs::create_directories(opts.goldenDir, ec);
+    if (!opts.input.empty())
+    {
+        LoadGribFileAppend(opts.input);
+        ReleaseHandles();
+    }
+    std::vector<GoldenCase> cases = BuildGoldenCases(opts);
+    int failures = 0;
+    for (GoldenCase &c : cases)
+    {
+        std::string rendered = (workDir / (c.name + ".png")).string();
+        std::string golden = (fs::path(opts.goldenDir) / (c.name + ".png")).string();
+        auto t0 = std::chrono::steady_clock::now();
+        bool ok = RenderGoldenCase(c, rendered);
+        double ms = Seconds(t0) * 1000.0;
+        std::vector<unsigned char> got, want;
+        int gw = 0, gh = 0, ww = 0, wh = 0;
+        if (!ok || !ReadPngRGBA(rendered.c_str(), got, gw, gh))
+        {
+            printf("%-28s ERROR   could not render\n", c.name.c_str());
+            failures++;
+            continue;
+        }
+        bool haveGolden = ReadPngRGBA(golden.c_str(), want, ww, wh);
+        if (opts.updateGolden)
+        {
+            bool written = fs::copy_file(rendered, golden, fs::copy_options::overwrite_existing, ec);
+            if (!written)
+                failures++;
+            printf("%-28s %-7s %8.2f ms  %dx%d\n", c.name.c_str(),
+                   !written ? "ERROR" : haveGolden ? "UPDATED" : "NEW", ms, gw, gh);
+            continue;
+        }
+        if (!haveGolden)
+        {
+            printf("%-28s FAIL    %8.2f ms  no reference %s (run with --update-golden)\n", c.name.c_str(), ms,
+                   golden.c_str());
+            failures++;
+            continue;
+        }
+        if (gw != ww || gh != wh)
+        {
+            printf("%-28s FAIL    %8.2f ms  size %dx%d, expected %dx%d\n", c.name.c_str(), ms, gw, gh, ww, wh);
+            failures++;
+            continue;
+        }
+        int maxDiff = 0;
+        size_t badPixels = 0;
+        for (size_t p = 0; p < got.size(); p += 4)
+        {
+            int pixelDiff = 0;
+            for (int ch = 0; ch < 4; ch++)
+                pixelDiff = std::max(pixelDiff, std::abs((int)got[p + ch] - (int)want[p + ch]));
+            maxDiff = std::max(maxDiff, pixelDiff);
+            if (pixelDiff > opts.tolerance)
+                badPixels++;
+        }
+        bool pass = badPixels == 0;
+        if (!pass)
+            failures++;
+        printf("%-28s %-7s %8.2f ms  max diff %d, %zu pixel(s) over tolerance\n", c.name.c_str(),
+               pass ? "PASS" : "FAIL", ms, maxDiff, badPixels);
+    }
+    ClearAllMessages();
+    printf("%zu case(s), %d failure(s)\n", cases.size(), failures);
+    return failures == 0 ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    BenchOptions opts;
+    if (!ParseBenchOptions(argc, argv, opts))
+    {
+        PrintBenchUsage();
+        return 1;
+    }
+    ConfigureEcCodesEnvironment();
+    namespace fs = std::filesystem;
+    fs::path workDir = opts.workDir.empty() ? fs::temp_directory_path() / "gribview_bench" : fs::path(opts.workDir);
+    std::error_code ec;
+    fs::create_directories(workDir, ec);
+    if (!opts.goldenDir.empty())
+        return RunGoldenCheck(opts, workDir);
+    std::string input = opts.input;
+    if (input.empty())
+    {
+        input = (workDir / ("synthetic_" + std::to_string(opts.spec.seed) + ".grib")).string();
+        std::string error;
+        if (!WriteSyntheticGribFile(input, opts.spec, error))
+        {
+            fprintf(stderr, "gribview_bench: %s\n", error.c_str());
+            return 1;
+        }
+        if (!opts.compress.empty())
+        {
+            std::string packed = input + (opts.compress == "gzip" ? ".gz" : ".zst");
+            if (!CompressBenchInput(input, packed, opts.compress, error))
+            {
+                fprintf(stderr, "gribview_bench: %s\n", error.c_str());
+                return 1;
+            }
+            input = packed;
+        }
+    }
+    GribCompression compression = DetectGribCompression(input);
+    uint64_t inputBytes = (uint64_t)fs::file_size(input, ec);
+    std::vector<BenchResult> results;
+
+    // Scan without the content hashes for duplicate detection first, to
+    // report what they add to the scan below.
+    g_ContentHashing = false;
+    double unhashedScan = BestOf(opts.repeat, [&]()
+                                 {
+                                     ClearAllMessages();
+                                     LoadGribFileAppend(input);
+                                     ReleaseHandles();
+                                 });
+    g_ContentHashing = true;
+
+    // Scan: build the message table from the file.
+    double t = BestOf(opts.repeat, [&]()
+                      {
+                          ClearAllMessages();
+                          LoadGribFileAppend(input);
+                          ReleaseHandles();
+                      });
+    size_t count = g_GribMessages.size();
+    if (count == 0)
+    {
+        fprintf(stderr, "gribview_bench: no GRIB messages in %s\n", input.c_str());
+        return 1;
+    }
+    SyncViewWithMessages();
+    results.push_back({"scan_msgs_per_s", (double)count / t});
+    results.push_back({"scan_mb_per_s", (double)inputBytes / (1024.0 * 1024.0) / t});
+    results.push_back({"scan_hash_overhead_percent", 100.0 * (t - unhashedScan) / unhashedScan});
+    double compressedScan = t;
+    if (g_Perf.scanHashSeconds > 0.0)
+        results.push_back({"hash_mb_per_s", (double)g_Perf.scanBytes / (1024.0 * 1024.0) / g_Perf.scanHashSeconds});
+
+    // Compressed input: one message at a time in a seeded random order,
+    // through the checkpoint index and, for comparison, decompressing from
+    // the start of the file as a reader without an index must.
+    if (compression != GribCompression::None)
+    {
+        std::shared_ptr<CompressedGribIndex> packed = FindCompressedIndex(input);
+        std::vector<size_t> shuffled(count);
+        for (size_t i = 0; i < count; i++)
+            shuffled[i] = i;
+        std::mt19937_64 order(opts.spec.seed);
+        for (size_t i = count; i > 1; i--) // not std::shuffle, whose order differs between libraries
+            std::swap(shuffled[i - 1], shuffled[(size_t)(order() % i)]);
+        t = BestOf(opts.repeat, [&]()
+                   {
+                       for (size_t i : shuffled)
+                       {
+                           codes_handle *h = ReopenGribMessage(g_GribMessages[i]);
+                           if (h)
+                               codes_handle_delete(h);
+                       }
+                   });
+        results.push_back({"compressed_reopen_ms", t * 1000.0 / (double)count});
+        size_t sample = std::min<size_t>(count, 16);
+        t = BestOf(1, [&]()
+                   {
+                       std::vector<char> bytes;
+                       for (size_t k = 0; k < sample; k++)
+                       {
+                           const GribMessage &gm = g_GribMessages[shuffled[k]];
+                           CompressedDecoder d;
+                           std::string error;
+                           bytes.resize(gm.messageSize);
+                           if (d.Start(input, compression, CompressedCheckpoint(), error))
+                           {
+                               d.Skip((uint64_t)gm.fileOffset);
+                               d.Read(bytes.data(), bytes.size());
+                           }
+                           codes_handle *h = codes_handle_new_from_message_copy(nullptr, bytes.data(), bytes.size());
+                           if (h)
+                               codes_handle_delete(h);
+                       }
+                   });
+        results.push_back({"unindexed_reopen_ms", t * 1000.0 / (double)sample});
+        if (packed)
+        {
+            results.push_back({"checkpoints", (double)packed->points.size()});
+            results.push_back({"checkpoint_index_kb", (double)packed->MemoryBytes() / 1024.0});
+            results.push_back({"compression_ratio", (double)packed->uncompressedBytes /
+                                                        (double)std::max<uint64_t>(1, packed->compressedBytes)});
+        }
+    }
+
+    // Decode: reopen every message and read its values and range.
+    uint64_t encodedBytes = 0, decodedValues = 0;
+    t = BestOf(opts.repeat, [&]()
+               {
+                   encodedBytes = decodedValues = 0;
+                   std::vector<double> data;
+                   for (GribMessage &gm : g_GribMessages)
+                   {
+                       codes_handle *h = ReopenGribMessage(gm);
+                       if (!h)
+                           continue;
+                       size_t size = 0;
+                       codes_get_message_size(h, &size);
+                       double mn, mx;
+                       GetMessageValuesAndRange(h, data, mn, mx);
+                       encodedBytes += size;
+                       decodedValues += data.size();
+                       codes_handle_delete(h);
+                   }
+               });
+    results.push_back({"decode_mb_per_s", (double)encodedBytes / (1024.0 * 1024.0) / t});
+    results.push_back({"decode_mvalues_per_s", (double)decodedValues / 1e6 / t});
+
+    // Colormap: the texture loop on the first field, enough passes for
+    // roughly 50 million pixels per run.
+    std::vector<double> field;
+    GribMessage &first = g_GribMessages.front();
+    LoadMessageData(first, field);
+    ReleaseHandles();
+    const GridGeometry &grid = *first.grid;
+    size_t pixels = (size_t)std::max(0L, grid.Ni) * (size_t)std::max(0L, grid.Nj);
+    if (pixels > 0 && field.size() >= pixels)
+    {
+        double mn = *std::min_element(field.begin(), field.end());
+        double mx = *std::max_element(field.begin(), field.end());
+        size_t passes = std::max<size_t>(1, 50000000 / pixels);
+        std::vector<unsigned char> rgba;
+        t = BestOf(opts.repeat, [&]()
+                   {
+                       for (size_t p = 0; p < passes; p++)
+                           ColormapToRGBA(field, (int)grid.Ni, (int)grid.Nj, mn, mx,
+                                          magmaColormap, (int)colormapSize, rgba);
+                   });
+        results.push_back({"colormap_mpix_per_s", (double)(pixels * passes) / 1e6 / t});
+    }
+
+    // Extract: sample every message at seeded marker positions, then write
+    // the series as CSV the way the Markers panel does.
+    std::mt19937_64 rng(opts.spec.seed);
+    g_Markers.clear();
+    for (int m = 0; m < opts.markers; m++)
+    {
+        double lat = std::min(grid.lat1, grid.lat2) + SyntheticUnit(rng) * fabs(grid.lat1 - grid.lat2);
+        double lon = grid.lon1 + SyntheticUnit(rng) * 359.0;
+        CreateMarkerAt(lat, fmod(lon, 360.0));
+    }
+    // Nearest, then bilinear (weights worked out once per grid).
+    auto extract = [&](int interp)
+    {
+        for (Marker &mk : g_Markers)
+            mk.interp = interp;
+        return BestOf(opts.repeat, [&]()
+                      {
+                          ClearMarkerSeries();
+                          std::vector<double> data;
+                          for (int idx : g_ViewRows)
+                          {
+                              GribMessage &gm = g_GribMessages[idx];
+                              bool hasData = LoadMessageData(gm, data);
+                              for (Marker &mk : g_Markers)
+                              {
+                                  double v = std::numeric_limits<double>::quiet_NaN();
+                                  if (hasData)
+                                      SampleMarker(mk, gm, data, v);
+                                  mk.series.push_back({idx, v});
+                              }
+                              if (gm.message)
+                                  codes_handle_delete(gm.message);
+                              gm.message = nullptr;
+                          }
+                      });
+    };
+    t = extract(kInterpBilinear);
+    results.push_back({"extract_bilinear_samples_per_s", (double)(count * g_Markers.size()) / t});
+    t = extract(kInterpNearest);
+    results.push_back({"extract_samples_per_s", (double)(count * g_Markers.size()) / t});
+    {
+        // Messages share one geometry per grid; report what that saves.
+        size_t grids = 0, users = 0;
+        uint64_t shared = 0, unshared = 0;
+        GridRegistryBytes(grids, users, shared, unshared);
+        results.push_back({"grids", (double)grids});
+        results.push_back({"grid_shared_kb", (double)shared / 1024.0});
+        results.push_back({"grid_unshared_kb", (double)unshared / 1024.0});
+    }
+    SetPathBuffer(g_MarkersCsvPath, IM_ARRAYSIZE(g_MarkersCsvPath), (workDir / "markers.csv").string());
+    t = BestOf(opts.repeat, [&]() { SaveMarkersCsv(); });
+    results.push_back({"csv_rows_per_s", (double)(count * g_Markers.size()) / t});
+
+    // Export: write every message to a new file.
+    std::vector<GribMessage *> all;
+    for (GribMessage &gm : g_GribMessages)
+        all.push_back(&gm);
+    std::string exportPath = (workDir / "export.grib").string();
+    uint64_t exported = 0;
+    t = BestOf(opts.repeat, [&]()
+               {
+                   size_t saved = 0;
+                   SaveMessagesToGrib(all, exportPath, saved, exported);
+               });
+    results.push_back({"export_mb_per_s", (double)exported / (1024.0 * 1024.0) / t});
+    ReleaseHandles();
+
+    // The alternative to the index: decompress to a plain file, then scan
+    // that. Last, since it replaces the loaded messages.
+    if (compression != GribCompression::None)
+    {
+        std::string plain = (workDir / "decompressed.grib").string();
+        t = BestOf(opts.repeat, [&]()
+                   {
+                       ClearAllMessages();
+                       if (DecompressBenchInput(input, compression, plain))
+                           LoadGribFileAppend(plain);
+                   });
+        results.push_back({"compressed_scan_s", compressedScan});
+        results.push_back({"decompress_then_scan_s", t});
+        remove(plain.c_str());
+    }
+
+    FILE *out = stdout;
+    if (!opts.jsonPath.empty())
+    {
+        out = fopen(opts.jsonPath.c_str(), "w");
+        if (!out)
+        {
+            fprintf(stderr, "gribview_bench: cannot write %s\n", opts.jsonPath.c_str());
+            return 1;
+        }
+    }
+    WriteBenchJson(out, opts, input, inputBytes, results);
+    if (out != stdout)
+        fclose(out);
+    ClearAllMessages();
+    return 0;
+}
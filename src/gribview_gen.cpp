@@ -0,0 +1,141 @@
+// gribview_gen.cpp
+// Writes deterministic synthetic GRIB corpora (see synthetic_grib.h) for
+// benchmarks and performance testing: the same options and seed always give
+// the same file, so large scenarios can be rebuilt offline instead of shipped.
+#include <chrono>
+#include <cstdlib>
+#include <sstream>
+#include "synthetic_grib.h"
+
+static void PrintGenUsage()
+{
+    printf("Usage: gribview_gen --out FILE [options]\n"
+           "  --messages N        number of messages (default 200)\n"
+           "  --grid NIxNJ        global regular lat/lon grid (default 720x361)\n"
+           "  --edition 1|2       GRIB edition (default 2)\n"
+           "  --packing TYPE      ecCodes packingType, e.g. grid_simple, grid_ccsds,\n"
+           "                      grid_jpeg, grid_second_order (default grid_simple)\n"
+           "  --bits N            bitsPerValue, 0 keeps the sample's (default 16)\n"
+           "  --params A,B,..     shortNames on pressure levels (default t)\n"
+           "  --levels L1,L2,..   pressure levels in hPa (default 500)\n"
+           "  --steps S1,S2,..    forecast steps in hours, or FIRST:LAST:INC\n"
+           "                      (default: 0, 1, 2, ... one per message group)\n"
+           "  --missing F         fraction of points masked by a bitmap (default 0)\n"
+           "  --date YYYYMMDD     first dataDate (default 20240101)\n"
+           "  --seed S            random seed (default 42)\n"
+           "\n"
+           "Messages cycle through levels, then params, then steps; the date\n"
+           "advances by one day each time the step list wraps.\n");
+}
+
+static std::vector<std::string> SplitList(const std::string &text)
+{
+    std::vector<std::string> items;
+    std::stringstream ss(text);
+    std::string item;
+    while (std::getline(ss, item, ','))
+    {
+        if (!item.empty())
+            items.push_back(item);
+    }
+    return items;
+}
+
+static bool ParseLongList(const std::string &text, std::vector<long> &out)
+{
+    out.clear();
+    long first = 0, last = 0, inc = 0;
+    if (sscanf(text.c_str(), "%ld:%ld:%ld", &first, &last, &inc) == 3)
+    {
+        if (inc <= 0 || last < first)
+            return false;
+        for (long v = first; v <= last; v += inc)
+            out.push_back(v);
+        return true;
+    }
+    for (const std::string &item : SplitList(text))
+    {
+        char *end = nullptr;
+        long v = strtol(item.c_str(), &end, 10);
+        if (!end || *end != '\0')
+            return false;
+        out.push_back(v);
+    }
+    return !out.empty();
+}
+
+int main(int argc, char **argv)
+{
+    SyntheticGribSpec spec;
+    std::string outPath;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        bool ok = true;
+        if (arg == "--out" && hasValue)
+            outPath = argv[++i];
+        else if (arg == "--messages" && hasValue)
+            spec.messages = (size_t)std::max(1LL, atoll(argv[++i]));
+        else if (arg == "--grid" && hasValue)
+            ok = sscanf(argv[++i], "%ldx%ld", &spec.ni, &spec.nj) == 2 && spec.ni > 1 && spec.nj > 1;
+        else if (arg == "--edition" && hasValue)
+        {
+            spec.edition = atoi(argv[++i]);
+            ok = spec.edition == 1 || spec.edition == 2;
+        }
+        else if (arg == "--packing" && hasValue)
+            spec.packing = argv[++i];
+        else if (arg == "--bits" && hasValue)
+            spec.bitsPerValue = std::max(0L, atol(argv[++i]));
+        else if (arg == "--params" && hasValue)
+        {
+            spec.params = SplitList(argv[++i]);
+            ok = !spec.params.empty();
+        }
+        else if (arg == "--levels" && hasValue)
+            ok = ParseLongList(argv[++i], spec.levels);
+        else if (arg == "--steps" && hasValue)
+            ok = ParseLongList(argv[++i], spec.steps);
+        else if (arg == "--missing" && hasValue)
+        {
+            spec.missingFraction = atof(argv[++i]);
+            ok = spec.missingFraction >= 0.0 && spec.missingFraction < 1.0;
+        }
+        else if (arg == "--date" && hasValue)
+            spec.date = atol(argv[++i]);
+        else if (arg == "--seed" && hasValue)
+            spec.seed = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--help" || arg == "-h")
+        {
+            PrintGenUsage();
+            return 0;
+        }
+        else
+            ok = false;
+        if (!ok)
+        {
+            fprintf(stderr, "gribview_gen: bad argument %s\n", arg.c_str());
+            PrintGenUsage();
+            return 1;
+        }
+    }
+    if (outPath.empty())
+    {
+        PrintGenUsage();
+        return 1;
+    }
+    auto t0 = std::chrono::steady_clock::now();
+    std::string error;
+    uint64_t bytes = 0;
+    if (!WriteSyntheticGribFile(outPath, spec, error, &bytes))
+    {
+        fprintf(stderr, "gribview_gen: %s\n", error.c_str());
+        return 1;
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    double mb = (double)bytes / (1024.0 * 1024.0);
+    printf("Wrote %zu message(s), %.1f MB to %s in %.2f s (%.0f MB/s)\n",
+           spec.messages, mb, outPath.c_str(), secs, secs > 0.0 ? mb / secs : 0.0);
+    return 0;
+}
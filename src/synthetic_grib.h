@@ -0,0 +1,214 @@
+// synthetic_grib.h
+// Deterministic synthetic GRIB files built from the ecCodes samples, so that
+// benchmarks can run on inputs of any size without shipping data.
+#pragma once
+
+#include <eccodes.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+struct SyntheticGribSpec
+{
+    size_t messages = 200;
+    long ni = 720;
+    long nj = 361;
+    uint64_t seed = 42;
+    int edition = 2;                          // 1 or 2
+    std::string packing = "grid_simple";      // any ecCodes packingType
+    long bitsPerValue = 16;
+    std::vector<std::string> params = {"t"};  // shortNames on pressure levels
+    std::vector<long> levels = {500};         // hPa
+    std::vector<long> steps;                  // hours; empty = 0, 1, 2, ...
+    double missingFraction = 0.0;             // share of points masked by the bitmap
+    long date = 20240101;                     // first dataDate
+};
+
+// Uniform in [0, 1). Spelled out because std::uniform_real_distribution
+// may give different numbers with different standard libraries, and the
+// same seed must give the same data everywhere.
+static double SyntheticUnit(std::mt19937_64 &rng)
+{
+    return (double)(rng() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// A few random plane waves plus a little noise: smooth enough that packing
+// behaves as on real fields, and identical for a given seed. The waves are
+// separable, so the cost per point is a handful of multiply-adds.
+static void SyntheticField(std::mt19937_64 &rng, long ni, long nj, std::vector<double> &values)
+{
+    const int waves = 4;
+    std::vector<double> colWave((size_t)waves * (size_t)ni), rowWave((size_t)waves * (size_t)nj);
+    for (int w = 0; w < waves; w++)
+    {
+        double kx = 1.0 + std::floor(SyntheticUnit(rng) * 6.0);
+        double ky = 1.0 + std::floor(SyntheticUnit(rng) * 4.0);
+        double phase = SyntheticUnit(rng) * 6.283185307179586;
+        double amp = 2.0 + SyntheticUnit(rng) * 8.0;
+        for (long i = 0; i < ni; i++)
+            colWave[(size_t)w * ni + i] = amp * std::sin(kx * (double)i / (double)ni * 6.283185307179586 + phase);
+        for (long j = 0; j < nj; j++)
+            rowWave[(size_t)w * nj + j] = std::cos(ky * (double)j / (double)(nj > 1 ? nj - 1 : 1) * 3.141592653589793);
+    }
+    double base = 250.0 + SyntheticUnit(rng) * 40.0;
+    values.resize((size_t)ni * (size_t)nj);
+    for (long j = 0; j < nj; j++)
+    {
+        double *row = values.data() + (size_t)j * (size_t)ni;
+        for (long i = 0; i < ni; i++)
+        {
+            double v = base;
+            for (int w = 0; w < waves; w++)
+                v += colWave[(size_t)w * ni + i] * rowWave[(size_t)w * nj + j];
+            row[i] = v + (SyntheticUnit(rng) - 0.5) * 0.1;
+        }
+    }
+}
+
+// Masks the lowest 'fraction' of a second smooth field, which gives
+// blob-shaped missing areas (like a land/sea mask) rather than salt noise.
+static void SyntheticMissingMask(std::mt19937_64 &rng, long ni, long nj, double fraction, std::vector<bool> &mask)
+{
+    mask.assign((size_t)ni * (size_t)nj, false);
+    if (fraction <= 0.0)
+        return;
+    std::vector<double> field, sorted;
+    SyntheticField(rng, ni, nj, field);
+    sorted = field;
+    size_t k = std::min(sorted.size() - 1, (size_t)(fraction * (double)sorted.size()));
+    std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+    double threshold = fraction >= 1.0 ? std::numeric_limits<double>::infinity() : sorted[k];
+    for (size_t p = 0; p < field.size(); p++)
+        mask[p] = field[p] < threshold;
+}
+
+// yyyymmdd plus a number of days (proleptic Gregorian calendar).
+static long SyntheticAddDays(long yyyymmdd, long days)
+{
+    long y = yyyymmdd / 10000, m = (yyyymmdd / 100) % 100, d = yyyymmdd % 100;
+    // days_from_civil / civil_from_days (H. Hinnant)
+    y -= m <= 2;
+    long era = (y >= 0 ? y : y - 399) / 400;
+    long yoe = y - era * 400;
+    long doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    long z = era * 146097 + doe + days; // days since 0000-03-01
+    era = (z >= 0 ? z : z - 146096) / 146097;
+    doe = z - era * 146097;
+    yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    y = yoe + era * 400;
+    doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    long mp = (5 * doy + 2) / 153;
+    d = doy - (153 * mp + 2) / 5 + 1;
+    m = mp + (mp < 10 ? 3 : -9);
+    y += m <= 2;
+    return y * 10000 + m * 100 + d;
+}
+
+// Writes spec.messages messages on a global regular lat/lon grid. Messages
+// cycle through levels, then parameters, then steps; once all steps are
+// used the date moves on by one day. Returns false (with a reason in
+// 'error') if the sample cannot be loaded or the file cannot be written.
+static bool WriteSyntheticGribFile(const std::string &path, const SyntheticGribSpec &spec, std::string &error,
+                                   uint64_t *bytesWritten = nullptr)
+{
+    const char *sample = spec.edition == 1 ? "regular_ll_pl_grib1" : "regular_ll_pl_grib2";
+    codes_handle *h = codes_grib_handle_new_from_samples(nullptr, sample);
+    if (!h)
+    {
+        error = std::string("cannot load the ecCodes sample ") + sample + " (check ECCODES_SAMPLES_PATH)";
+        return false;
+    }
+    FILE *f = fopen(path.c_str(), "wb");
+    if (!f)
+    {
+        codes_handle_delete(h);
+        error = "cannot create " + path;
+        return false;
+    }
+    int err = 0;
+    err |= codes_set_long(h, "Ni", spec.ni);
+    err |= codes_set_long(h, "Nj", spec.nj);
+    err |= codes_set_double(h, "latitudeOfFirstGridPointInDegrees", 90.0);
+    err |= codes_set_double(h, "longitudeOfFirstGridPointInDegrees", 0.0);
+    err |= codes_set_double(h, "latitudeOfLastGridPointInDegrees", -90.0);
+    err |= codes_set_double(h, "longitudeOfLastGridPointInDegrees", 360.0 - 360.0 / (double)spec.ni);
+    err |= codes_set_double(h, "iDirectionIncrementInDegrees", 360.0 / (double)spec.ni);
+    err |= codes_set_double(h, "jDirectionIncrementInDegrees", 180.0 / (double)(spec.nj > 1 ? spec.nj - 1 : 1));
+    if (err != 0)
+        error = "cannot set the grid on " + std::string(sample);
+    size_t plen = spec.packing.size();
+    if (err == 0 && codes_set_string(h, "packingType", spec.packing.c_str(), &plen) != 0)
+    {
+        err = 1;
+        error = "packing " + spec.packing + " is not available for GRIB" + std::to_string(spec.edition);
+    }
+    if (err == 0 && spec.bitsPerValue > 0)
+        err |= codes_set_long(h, "bitsPerValue", spec.bitsPerValue);
+    bool useBitmap = spec.missingFraction > 0.0;
+    double missingValue = 9999.0;
+    if (err == 0 && useBitmap)
+    {
+        err |= codes_set_double(h, "missingValue", missingValue);
+        err |= codes_set_long(h, "bitmapPresent", 1);
+    }
+    std::mt19937_64 rng(spec.seed);
+    std::vector<double> values;
+    std::vector<bool> mask;
+    std::vector<std::string> params = spec.params.empty() ? std::vector<std::string>{"t"} : spec.params;
+    std::vector<long> levels = spec.levels.empty() ? std::vector<long>{500} : spec.levels;
+    size_t perStep = params.size() * levels.size();
+    uint64_t written = 0;
+    for (size_t m = 0; m < spec.messages && err == 0; m++)
+    {
+        size_t stepIndex = m / perStep;
+        long step = (long)stepIndex;
+        long day = 0;
+        if (!spec.steps.empty())
+        {
+            step = spec.steps[stepIndex % spec.steps.size()];
+            day = (long)(stepIndex / spec.steps.size());
+        }
+        const std::string &param = params[(m / levels.size()) % params.size()];
+        size_t len = param.size();
+        err |= codes_set_string(h, "shortName", param.c_str(), &len);
+        err |= codes_set_long(h, "level", levels[m % levels.size()]);
+        err |= codes_set_long(h, "dataDate", SyntheticAddDays(spec.date, day));
+        err |= codes_set_long(h, "step", step);
+        if (err != 0)
+        {
+            error = "cannot set keys for message " + std::to_string(m + 1) + " (shortName " + param + ")";
+            break;
+        }
+        SyntheticField(rng, spec.ni, spec.nj, values);
+        if (useBitmap)
+        {
+            SyntheticMissingMask(rng, spec.ni, spec.nj, spec.missingFraction, mask);
+            for (size_t p = 0; p < values.size(); p++)
+                if (mask[p])
+                    values[p] = missingValue;
+        }
+        err |= codes_set_double_array(h, "values", values.data(), values.size());
+        const void *buf = nullptr;
+        size_t size = 0;
+        if (err == 0 && (codes_get_message(h, &buf, &size) != 0 || fwrite(buf, 1, size, f) != size))
+            err = 1;
+        written += size;
+        if (err != 0)
+            error = "failed to encode or write message " + std::to_string(m + 1) + " to " + path;
+    }
+    codes_handle_delete(h);
+    if (fclose(f) != 0 && err == 0)
+    {
+        err = 1;
+        error = "failed to write " + path;
+    }
+    if (bytesWritten)
+        *bytesWritten = written;
+    return err == 0;
+}
@@ -0,0 +1,70 @@
+// gribview_query_test.cpp
+// Checks the table filter language (QueryParser/EvaluateQuery) against a
+// handful of hand-made rows: which rows each expression keeps, and which
+// expressions are rejected. Prints one line per case and exits non-zero on
+// a mismatch; run by ctest as gribview_query.
+//
+// The viewer is compiled into this test as-is, minus its main().
+#define GRIBVIEW_NO_MAIN
+#include "gribview.cpp"
+
+struct QueryCase
+{
+    const char *expression;
+    const char *expected; // one character per row: 1 kept, 0 dropped; nullptr = must not compile
+};
+
+static void AddRow(const char *shortName, long level, const char *typeOfLevel)
+{
+    GribMessage gm;
+    gm.index = (int)g_GribMessages.size() + 1;
+    gm.shortName = shortName;
+    gm.level = level;
+    gm.keyValueMap["index"] = std::to_string(gm.index);
+    gm.keyValueMap["shortName"] = shortName;
+    gm.keyValueMap["level"] = std::to_string(level);
+    gm.keyValueMap["typeOfLevel"] = typeOfLevel;
+    g_GribMessages.push_back(gm);
+}
+
+int main()
+{
+    AddRow("2t", 2, "heightAboveGround");
+    AddRow("10u", 10, "heightAboveGround");
+    AddRow("10v", 10, "heightAboveGround");
+    AddRow("t", 850, "isobaricInhPa");
+    AddRow("t", 500, "isobaricInhPa");
+    const QueryCase cases[] = {
+        {"shortName in (2t,10u)", "11000"},
+        {"shortName not in (2t, 10u)", "00111"},
+        {"shortName=2t", "10000"},
+        {"shortName == '10v'", "00100"},
+        {"shortName = t and level <= 500", "00001"},
+        {"level in (10, 850)", "01110"},
+        {"level > 1e1", "00011"},
+        {"level * 2 >= .5e3", "00011"},
+        {"typeOfLevel = isobaricInhPa or shortName = 2t", "10011"},
+        {"shortName in (2t,10u", nullptr},
+        {"level >", nullptr},
+    };
+    int failures = 0;
+    for (const QueryCase &c : cases)
+    {
+        std::vector<uint8_t> mask;
+        std::string error;
+        bool ok = EvaluateQuery(c.expression, mask, error);
+        std::string got;
+        if (ok)
+        {
+            for (uint8_t keep : mask)
+                got += keep ? '1' : '0';
+        }
+        bool pass = c.expected ? (ok && got == c.expected) : !ok;
+        if (!pass)
+            failures++;
+        printf("%-4s %-48s %s\n", pass ? "PASS" : "FAIL", c.expression, ok ? got.c_str() : error.c_str());
+    }
+    ClearAllMessages();
+    printf("%zu case(s), %d failure(s)\n", sizeof(cases) / sizeof(cases[0]), failures);
+    return failures == 0 ? 0 : 1;
+}